@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <string>
 #include <utility>
 
 #include "types.hh"
@@ -11,7 +12,10 @@
 
 class AST {
  public:
+  AST() : line_pos(0) {}
   virtual ~AST() {}
+
+  int line_pos;
 };
 
 class Inst : public AST {
@@ -50,7 +54,12 @@ struct InstReturn : Inst {
   std::unique_ptr<Exp> exp;
 };
 
+// Variables are identified by an index unique within their function;
+// arguments come first. Shadowed names get distinct indices.
 struct InstAssign : Inst {
+  std::string name;
+  int var;
+  Type type;
 };
 
 struct InstAssignExp : InstAssign {
@@ -61,6 +70,18 @@ struct InstAssignIncDec : InstAssign {
   Op op;
 };
 
+// a[i] = e; type is the type of the array.
+struct InstAssignIndex : InstAssign {
+  std::unique_ptr<Exp> index, exp;
+};
+
+struct InstDecl : Inst {
+  Type type;
+  std::vector<std::string> names;
+  std::vector<int> vars;
+  std::vector<std::unique_ptr<Exp>> inits; // null when not initialized
+};
+
 struct InstExp : Inst {
   InstExp(std::unique_ptr<Exp> && e) : exp(std::move(e)) {};
   std::unique_ptr<Exp> exp;
@@ -74,13 +95,24 @@ class Literal : public Exp {
   }
 
   Type GetType() const {
-    return LiteralToBasicType<T>::type::value;
+    return LiteralToBasicType<T>::value;
+  }
+
+  const T & Value() const {
+    return value;
   }
 
  private:
   T value;
 };
 
+// Stands for an expression the checker rejected.
+struct ErrorExp : Exp {
+  Type GetType() const {
+    return basic_type::error_;
+  }
+};
+
 struct UnaryExp : Exp {
   Type GetType() const {
     return type;
@@ -101,7 +133,41 @@ struct BinaryExp : Exp {
   std::unique_ptr<Exp> lhs, rhs;
 };
 
+// a[i]; type is the element type.
+struct IndexExp : Exp {
+  Type GetType() const {
+    return type;
+  }
+
+  Type type;
+  std::unique_ptr<Exp> array, index;
+};
+
+// a.length
+struct LengthExp : Exp {
+  Type GetType() const {
+    return type;
+  }
+
+  Type type;
+  std::unique_ptr<Exp> array;
+};
+
+// new T[n]; type is T[].
+struct NewArrayExp : Exp {
+  Type GetType() const {
+    return type;
+  }
+
+  Type type;
+  std::unique_ptr<Exp> length;
+};
+
 struct FunDef : Inst {
+  std::string name;
+  Type type;
+  std::vector<Type> arg_types;
+  int vars; // number of variables, arguments included
   std::unique_ptr<InstBlock> body;
 };
 
@@ -111,6 +177,7 @@ class FunCall : public Exp {
     return type;
   }
 
+  std::string name;
   std::vector<std::unique_ptr<Exp>> args;
   Type type;
 };
@@ -120,6 +187,8 @@ class VarRef : public Exp {
   Type GetType() const {
     return type;
   }
+  std::string name;
+  int var;
   Type type;
 };
 
@@ -0,0 +1,167 @@
+#include "passes.hh"
+
+#include <sstream>
+
+namespace ir {
+
+namespace {
+
+bool Dominates(const std::vector<BlockId> & idom, BlockId a, BlockId b) {
+  for ( ; b != kNoBlock ; b = idom[b])
+    if (b == a)
+      return true;
+  return false;
+}
+
+// The compare o with its operands swapped: a o b is b Swapped(o) a.
+Opcode Swapped(Opcode o) {
+  switch (o) {
+    case Opcode::lt: return Opcode::gt;
+    case Opcode::le: return Opcode::ge;
+    case Opcode::gt: return Opcode::lt;
+    case Opcode::ge: return Opcode::le;
+    default: return o;
+  }
+}
+
+// The compare that is true when o is false.
+Opcode Negated(Opcode o) {
+  switch (o) {
+    case Opcode::lt: return Opcode::ge;
+    case Opcode::le: return Opcode::gt;
+    case Opcode::gt: return Opcode::le;
+    case Opcode::ge: return Opcode::lt;
+    case Opcode::eq: return Opcode::ne;
+    default: return Opcode::eq;
+  }
+}
+
+class BCEPass : public FunctionPass {
+ public:
+  explicit BCEPass(std::vector<Remark> * r) : remarks(r) {}
+
+  const char * Name() const {
+    return "bce";
+  }
+
+  bool RunOnFunction(Module &, Function & f) {
+    if (f.blocks.empty())
+      return false;
+    const auto idom = f.Dominators();
+    std::vector<bool> removed(f.insts.size(), false);
+    std::vector<Value> checks;
+    for (auto & loop : FindLoops(f, idom)) {
+      CountedLoop c;
+      if (! FindCountedLoop(f, loop, c))
+        continue;
+      int proven = 0, kept = 0;
+      for (BlockId b = 0 ; b < f.blocks.size() ; ++b) {
+        if (f.blocks[b].removed || ! Dominates(idom, c.body, b))
+          continue;
+        for (auto v : f.blocks[b].insts) {
+          const Inst & inst = f.insts[v];
+          if (inst.op != Opcode::check || inst.operands[1] != c.iv || removed[v])
+            continue;
+          if (InBounds(f, c, inst.operands[0])) {
+            removed[v] = true;
+            checks.push_back(v);
+            ++proven;
+          } else {
+            ++kept;
+          }
+        }
+      }
+
+      const int line = f.insts[c.test].line_pos;
+      std::ostringstream message;
+      if (proven) {
+        message << proven << " bounds check" << (proven > 1 ? "s" : "") << " removed: the index stays in bounds";
+        Report(Remark::Kind::passed, f, line, message.str());
+      }
+      if (kept) {
+        message.str("");
+        message << kept << " bounds check" << (kept > 1 ? "s" : "") << " kept: the loop's range is not known to fit the array";
+        Report(Remark::Kind::missed, f, line, message.str());
+      }
+    }
+    if (checks.empty())
+      return false;
+    f.Remove(checks);
+    return true;
+  }
+
+ private:
+  // Whether the induction variable of c is a valid index into array
+  // wherever the loop's test has just held. That is when it counts up by
+  // one from at least 0 while less than the array's length, or down by
+  // one from below the length while at least 0; either way it cannot
+  // wrap around.
+  bool InBounds(const Function & f, const CountedLoop & c, Value array) const {
+    const Inst & test = f.insts[c.test];
+    const bool iv_first = test.operands[0] == c.iv;
+    const Value bound = test.operands[iv_first ? 1 : 0];
+    // The test as iv o bound, in the body.
+    Opcode o = iv_first ? test.op : Swapped(test.op);
+    if (f.insts[f.Terminator(test.block)].targets[0] != c.body)
+      o = Negated(o);
+
+    if (c.step == 1)
+      return o == Opcode::lt && IsLength(f, bound, array) && NonNegative(f, c.start);
+    if (c.step == -1) {
+      int64_t k;
+      const bool at_least_zero = IsInt(f, bound, k) && ((o == Opcode::ge && k == 0) || (o == Opcode::gt && k == -1));
+      return at_least_zero && BelowLength(f, c.start, array);
+    }
+    return false;
+  }
+
+  static bool IsInt(const Function & f, Value v, int64_t & k) {
+    if (f.insts[v].op != Opcode::const_int)
+      return false;
+    k = f.insts[v].imm;
+    return true;
+  }
+
+  // Whether v is the length of array.
+  static bool IsLength(const Function & f, Value v, Value array) {
+    const Inst & a = f.insts[array];
+    if (a.op == Opcode::new_array && a.operands[0] == v)
+      return true;
+    const Inst & inst = f.insts[v];
+    return inst.op == Opcode::length && inst.operands[0] == array;
+  }
+
+  static bool NonNegative(const Function & f, Value v) {
+    int64_t k;
+    return (IsInt(f, v, k) && k >= 0) || f.insts[v].op == Opcode::length;
+  }
+
+  // Whether v is the length of array minus a positive constant.
+  static bool BelowLength(const Function & f, Value v, Value array) {
+    const Inst & inst = f.insts[v];
+    int64_t k;
+    if (inst.op == Opcode::sub)
+      return IsLength(f, inst.operands[0], array) && IsInt(f, inst.operands[1], k) && k >= 1;
+    if (inst.op != Opcode::add)
+      return false;
+    for (size_t i = 0 ; i < 2 ; ++i)
+      if (IsLength(f, inst.operands[i], array) && IsInt(f, inst.operands[1 - i], k) && k <= -1)
+        return true;
+    return false;
+  }
+
+  void Report(Remark::Kind kind, const Function & f, int line, const std::string & message) {
+    if (remarks)
+      remarks->push_back(Remark{kind, Name(), f.name, line, message});
+  }
+
+  std::vector<Remark> * remarks;
+};
+
+}
+
+std::unique_ptr<Pass> CreateBCEPass(std::vector<Remark> * remarks) {
+  return std::unique_ptr<Pass>(new BCEPass(remarks));
+}
+
+}
@@ -0,0 +1,232 @@
+#include "cfg.hh"
+
+#include <algorithm>
+
+namespace cfg {
+
+namespace {
+
+enum class Test {
+  unknown,
+  always,
+  never,
+};
+
+Test Evaluate(const Exp * e) {
+  if (auto lit = dynamic_cast<const Literal<bool> *>(e))
+    return lit->Value() ? Test::always : Test::never;
+  return Test::unknown;
+}
+
+std::unique_ptr<Inst> EmptyBlock(const Inst & replaced) {
+  std::unique_ptr<Inst> block(new InstBlock);
+  block->line_pos = replaced.line_pos;
+  return block;
+}
+
+class Pruner {
+ public:
+  explicit Pruner(const Graph & graph) : g(graph), removed(0) {}
+
+  void Prune(InstBlock & block) {
+    auto & list = block.instructions;
+    auto dead = std::stable_partition(list.begin(), list.end(),
+        [this](const std::unique_ptr<Inst> & i) { return g.Reachable(i.get()); });
+    removed += list.end() - dead;
+    list.erase(dead, list.end());
+    for (auto & i : list)
+      Prune(i);
+  }
+
+  // Simplifies the reachable statement i in place.
+  void Prune(std::unique_ptr<Inst> & i) {
+    if (auto block = dynamic_cast<InstBlock *>(i.get())) {
+      Prune(*block);
+    } else if (auto inst = dynamic_cast<InstIf *>(i.get())) {
+      switch (Evaluate(inst->test.get())) {
+        case Test::always:
+          ++removed;
+          i = std::move(inst->if_inst);
+          Prune(i);
+          break;
+        case Test::never:
+          ++removed;
+          i = inst->else_inst ? std::move(inst->else_inst) : EmptyBlock(*inst);
+          Prune(i);
+          break;
+        case Test::unknown:
+          Prune(inst->if_inst);
+          if (inst->else_inst)
+            Prune(inst->else_inst);
+          break;
+      }
+    } else if (auto inst = dynamic_cast<InstWhile *>(i.get())) {
+      if (Evaluate(inst->test.get()) == Test::never) {
+        ++removed;
+        i = EmptyBlock(*inst);
+      } else {
+        Prune(inst->body);
+      }
+    } else if (auto inst = dynamic_cast<InstFor *>(i.get())) {
+      if (Evaluate(inst->test.get()) == Test::never) {
+        ++removed;
+        i = std::move(inst->pre_inst);
+      } else {
+        Prune(inst->body);
+      }
+    }
+  }
+
+  const Graph & g;
+  int removed;
+};
+
+}
+
+Graph::Graph(const InstBlock & body) {
+  NewBlock();
+  NewBlock();
+  end = Add(&body, kEntry);
+  ComputeReachable();
+}
+
+BlockId Graph::NewBlock() {
+  blocks.resize(blocks.size() + 1);
+  return blocks.size() - 1;
+}
+
+void Graph::Edge(BlockId from, BlockId to) {
+  blocks[from].succs.push_back(to);
+  blocks[to].preds.push_back(from);
+}
+
+BlockId Graph::Add(const Inst * i, BlockId b) {
+  if (! i)
+    return b;
+  block_of[i] = b;
+  blocks[b].insts.push_back(i);
+
+  if (auto block = dynamic_cast<const InstBlock *>(i)) {
+    for (auto & j : block->instructions)
+      b = Add(j.get(), b);
+    return b;
+  }
+  if (auto inst = dynamic_cast<const InstIf *>(i)) {
+    const Test test = Evaluate(inst->test.get());
+    BlockId then_block = NewBlock();
+    BlockId else_block = NewBlock();
+    BlockId join = NewBlock();
+    if (test != Test::never)
+      Edge(b, then_block);
+    if (test != Test::always)
+      Edge(b, else_block);
+    Edge(Add(inst->if_inst.get(), then_block), join);
+    Edge(Add(inst->else_inst.get(), else_block), join);
+    return join;
+  }
+  if (auto inst = dynamic_cast<const InstWhile *>(i)) {
+    const Test test = Evaluate(inst->test.get());
+    BlockId header = NewBlock();
+    BlockId body = NewBlock();
+    BlockId after = NewBlock();
+    Edge(b, header);
+    if (test != Test::never)
+      Edge(header, body);
+    if (test != Test::always)
+      Edge(header, after);
+    Edge(Add(inst->body.get(), body), header);
+    return after;
+  }
+  if (auto inst = dynamic_cast<const InstFor *>(i)) {
+    const Test test = Evaluate(inst->test.get());
+    b = Add(inst->pre_inst.get(), b);
+    BlockId header = NewBlock();
+    BlockId body = NewBlock();
+    BlockId after = NewBlock();
+    Edge(b, header);
+    if (test != Test::never)
+      Edge(header, body);
+    if (test != Test::always)
+      Edge(header, after);
+    Edge(Add(inst->post_inst.get(), Add(inst->body.get(), body)), header);
+    return after;
+  }
+  if (dynamic_cast<const InstReturn *>(i)) {
+    Edge(b, kExit);
+    // Whatever follows starts a block without predecessors.
+    return NewBlock();
+  }
+  return b;
+}
+
+void Graph::ComputeReachable() {
+  reachable.assign(blocks.size(), false);
+  std::vector<std::pair<BlockId, size_t>> stack = {{kEntry, 0}};
+  reachable[kEntry] = true;
+  while (! stack.empty()) {
+    BlockId b = stack.back().first;
+    if (stack.back().second < blocks[b].succs.size()) {
+      BlockId s = blocks[b].succs[stack.back().second++];
+      if (! reachable[s]) {
+        reachable[s] = true;
+        stack.push_back(std::make_pair(s, 0));
+      }
+    } else {
+      order.push_back(b);
+      stack.pop_back();
+    }
+  }
+  std::reverse(order.begin(), order.end());
+}
+
+bool Graph::Reachable(const Inst * i) const {
+  auto b = block_of.find(i);
+  return b != block_of.end() && reachable[b->second];
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+std::vector<BlockId> Graph::Dominators() const {
+  std::vector<BlockId> idom(blocks.size(), kNoBlock);
+  std::vector<size_t> number(blocks.size(), 0);
+  for (size_t i = 0 ; i < order.size() ; ++i)
+    number[order[i]] = i;
+
+  auto intersect = [&](BlockId a, BlockId b) {
+    while (a != b) {
+      while (number[a] > number[b])
+        a = idom[a];
+      while (number[b] > number[a])
+        b = idom[b];
+    }
+    return a;
+  };
+
+  idom[kEntry] = kEntry;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1 ; i < order.size() ; ++i) {
+      BlockId b = order[i];
+      BlockId new_idom = kNoBlock;
+      for (auto p : blocks[b].preds) {
+        if (idom[p] == kNoBlock)
+          continue;
+        new_idom = new_idom == kNoBlock ? p : intersect(p, new_idom);
+      }
+      if (idom[b] != new_idom) {
+        idom[b] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  idom[kEntry] = kNoBlock;
+  return idom;
+}
+
+int RemoveUnreachable(InstBlock & body, const Graph & g) {
+  Pruner pruner(g);
+  pruner.Prune(body);
+  return pruner.removed;
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef JLC_CFG_HH_
+#define JLC_CFG_HH_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hh"
+
+// Control-flow graph of a checked function body at statement level. Each
+// statement is recorded in the block where it starts; compound statements
+// then continue in blocks of their own. Tests that are boolean literals
+// only get the edge they can take, so `while (false)` bodies are
+// unreachable and nothing follows `while (true)`.
+namespace cfg {
+
+typedef uint32_t BlockId;
+
+const BlockId kNoBlock = ~BlockId(0);
+
+struct Block {
+  std::vector<const Inst *> insts;
+  std::vector<BlockId> succs;
+  std::vector<BlockId> preds;
+};
+
+class Graph {
+ public:
+  explicit Graph(const InstBlock & body);
+
+  static const BlockId kEntry = 0;
+  // Every return jumps here.
+  static const BlockId kExit = 1;
+
+  std::vector<Block> blocks;
+  // Where control falls off the end of the body.
+  BlockId end;
+
+  // Blocks reachable from the entry.
+  const std::vector<bool> & Reachable() const {
+    return reachable;
+  }
+
+  bool Reachable(const Inst * i) const;
+
+  // True if control can reach the end of the body without a return.
+  bool FallsOffEnd() const {
+    return reachable[end];
+  }
+
+  // Immediate dominator of each block; kNoBlock for the entry and for
+  // unreachable blocks.
+  std::vector<BlockId> Dominators() const;
+
+ private:
+  BlockId NewBlock();
+  void Edge(BlockId from, BlockId to);
+  // Adds statement i starting in block b; returns the block after it.
+  BlockId Add(const Inst * i, BlockId b);
+  void ComputeReachable();
+
+  std::unordered_map<const Inst *, BlockId> block_of;
+  std::vector<bool> reachable;
+  std::vector<BlockId> order; // reverse post-order of the reachable blocks
+};
+
+// Drops the statements of body that g finds unreachable and folds
+// conditionals on boolean literals to the branch they take. g must have
+// been built from body. Returns the number of statements removed.
+int RemoveUnreachable(InstBlock & body, const Graph & g);
+
+}
+
+#endif // JLC_CFG_HH_
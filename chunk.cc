@@ -0,0 +1,250 @@
+#include "chunk.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "parser.hh"
+#include "scan.hh"
+#include "source_iterator.hh"
+
+namespace chunk {
+
+namespace {
+
+// Smaller chunks are not worth a thread.
+const size_t kMinChunkSize = 1 << 20;
+// More chunks than threads even out functions of different sizes.
+const size_t kChunksPerThread = 4;
+
+const size_t kNone = std::string::npos;
+
+// Where the skipper and the grammar are at a position: between tokens, or
+// in a comment or string literal. slash and star are a '/' in code and a
+// '*' in a block comment, which may start or end a comment.
+enum class State : uint8_t {
+  code,
+  slash,
+  line_comment,
+  block_comment,
+  star,
+  string,
+};
+
+struct Slice {
+  size_t begin, end;
+  State entry, exit;
+  // Change in brace depth.
+  long depth;
+  // first_close[k]: the position after the first '}' that leaves the depth
+  // k below the one at begin, or kNone.
+  std::vector<size_t> first_close;
+  size_t lines;
+};
+
+void Scan(const std::string & source, Slice & s) {
+  const char * base = source.data();
+  const char * end = base + s.end;
+  State state = s.entry;
+  long depth = 0;
+  s.first_close.clear();
+
+  for (const char * p = base + s.begin ; p < end ; ++p) {
+    const char c = *p;
+    switch (state) {
+      case State::slash:
+        if (c == '/') {
+          state = State::line_comment;
+          break;
+        }
+        if (c == '*') {
+          state = State::block_comment;
+          break;
+        }
+        state = State::code;
+        // Not a comment; c is code.
+      case State::code:
+        if (c == '/') {
+          state = State::slash;
+        } else if (c == '#') {
+          state = State::line_comment;
+        } else if (c == '"') {
+          state = State::string;
+        } else if (c == '{') {
+          ++depth;
+        } else if (c == '}' && --depth <= 0) {
+          const size_t k = -depth;
+          if (k >= s.first_close.size())
+            s.first_close.resize(k + 1, kNone);
+          if (s.first_close[k] == kNone)
+            s.first_close[k] = p + 1 - base;
+        }
+        break;
+      case State::line_comment:
+        p = scan::FindNewline(p, end);
+        if (p < end)
+          state = State::code;
+        break;
+      case State::star:
+        if (c == '/') {
+          state = State::code;
+          break;
+        }
+        if (c == '*')
+          break;
+        state = State::block_comment;
+        // Fall through to look for the end.
+      case State::block_comment:
+        p = scan::FindCommentEnd(p, end);
+        if (p < end)
+          ++p, state = State::code;
+        else if (end[-1] == '*')
+          state = State::star;
+        break;
+      case State::string:
+        p = scan::FindQuote(p, end);
+        if (p < end)
+          state = State::code;
+        break;
+    }
+  }
+
+  s.exit = state;
+  s.depth = depth;
+}
+
+// Runs body on threads, the calling one included.
+template <class F>
+void OnThreads(size_t threads, F body) {
+  std::vector<std::thread> workers;
+  for (size_t i = 1 ; i < threads ; ++i)
+    workers.emplace_back(body);
+  body();
+  for (auto & w : workers)
+    w.join();
+}
+
+}
+
+std::vector<Chunk> Split(const std::string & source, size_t count, size_t threads) {
+  const size_t n = source.size();
+  std::vector<Chunk> chunks(1, Chunk{0, n, 1});
+  if (count <= 1 || n < count)
+    return chunks;
+
+  std::vector<Slice> slices(count);
+  for (size_t i = 0 ; i < count ; ++i) {
+    slices[i].begin = n / count * i;
+    slices[i].end = i + 1 < count ? n / count * (i + 1) : n;
+    slices[i].entry = State::code;
+  }
+
+  std::atomic<size_t> next(0);
+  OnThreads(std::min(threads, count), [&] {
+    for (size_t i ; (i = next++) < count ; ) {
+      Slice & s = slices[i];
+      Scan(source, s);
+      const char prev = s.begin ? source[s.begin - 1] : 0;
+      s.lines = scan::CountLines(source.data() + s.begin, source.data() + s.end, prev);
+    }
+  });
+
+  // Follow the slices in order and cut at the first function end in each
+  // one but the first.
+  State state = State::code;
+  long depth = 0;
+  size_t line = 1;
+  for (auto & s : slices) {
+    if (s.entry != state) {
+      s.entry = state;
+      Scan(source, s);
+    }
+    const size_t at = depth < static_cast<long>(s.first_close.size()) ? s.first_close[depth] : kNone;
+    if (&s != &slices[0] && at != kNone && at < n) {
+      const char prev = s.begin ? source[s.begin - 1] : 0;
+      chunks.back().end = at;
+      chunks.push_back(Chunk{at, n, line + scan::CountLines(source.data() + s.begin, source.data() + at, prev)});
+    }
+    state = s.exit;
+    depth += s.depth;
+    line += s.lines;
+    if (depth < 0) {
+      chunks.resize(1);
+      chunks[0].end = n;
+      break;
+    }
+  }
+
+  return chunks;
+}
+
+bool Parse(const std::string & source, size_t threads, std::vector<std::unique_ptr<Function>> & functions,
+    parser::ParseError & error, trace::Recorder * trace) {
+  typedef parser::JavaletteParser<SourceIterator, Tags<Tag>> Parser;
+  typedef parser::JavaletteSkipper<SourceIterator> Skipper;
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t count = std::min(threads * kChunksPerThread, source.size() / kMinChunkSize);
+  std::vector<Chunk> chunks;
+  {
+    trace::Span span(trace, "parse", "split");
+    chunks = Split(source, count, threads);
+  }
+
+  std::vector<std::vector<std::unique_ptr<Function>>> parsed(chunks.size());
+  std::vector<parser::ParseError> errors(chunks.size());
+  std::vector<char> ok(chunks.size(), false);
+  std::atomic<size_t> next(0);
+  OnThreads(std::min(threads, chunks.size()), [&] {
+    Tags<Tag> tags;
+    Parser p(tags, parser::ParseUnit::function);
+    Skipper s;
+    for (size_t i ; (i = next++) < chunks.size() ; ) {
+      trace::Span span(trace, "parse", trace ? "chunk at line " + std::to_string(chunks[i].line) : std::string());
+      SourceIterator iter(source.data() + chunks[i].begin, chunks[i].line);
+      SourceIterator end(source.data() + chunks[i].end);
+      s.unterminated_comment = false;
+      try {
+        // Skipping first puts the error of a function that does not start
+        // on its first token, and lets the last chunk hold nothing but
+        // what follows the last function. A program has at least one.
+        boost::spirit::qi::skip_over(iter, end, s);
+        while (iter != end || (i == 0 && parsed[i].empty())) {
+          std::unique_ptr<Function> f(new Function);
+          p.error = parser::ParseError();
+          if (! boost::spirit::qi::phrase_parse(iter, end, p, s, f->tree)) {
+            errors[i] = parser::LastError(p, s);
+            if (errors[i].message.empty()) {
+              errors[i].message = "Expecting function-decl here";
+              errors[i].line = get_line(iter);
+            }
+            break;
+          }
+          f->tags.tags.swap(tags.tags);
+          parsed[i].push_back(std::move(f));
+        }
+        ok[i] = iter == end && (i > 0 || ! parsed[i].empty());
+      } catch (boost::spirit::qi::expectation_failure<SourceIterator> & e) {
+        // Only the skipper rethrows, at an unterminated comment.
+        errors[i] = parser::LastError(p, s);
+        errors[i].line = get_line(e.first);
+      }
+      tags.tags.clear();
+    }
+  });
+
+  // The first error in the source, as a sequential parse would stop at.
+  for (size_t i = 0 ; i < chunks.size() ; ++i) {
+    if (! ok[i]) {
+      error = errors[i];
+      return false;
+    }
+  }
+  for (auto & p : parsed)
+    for (auto & f : p)
+      functions.push_back(std::move(f));
+  return true;
+}
+
+}
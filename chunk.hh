@@ -0,0 +1,51 @@
+#ifndef JLC_CHUNK_HH_
+#define JLC_CHUNK_HH_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/spirit/include/support_utree.hpp>
+
+#include "tags.hh"
+#include "trace.hh"
+
+namespace parser {
+struct ParseError;
+}
+
+// Parallel parsing of large programs. The source is cut between top-level
+// function definitions into chunks, which worker threads parse one function
+// at a time; the functions come back in source order with their own tags.
+namespace chunk {
+
+// [begin, end) of the source, starting on line. Chunks other than the
+// first begin right after the '}' closing a function body.
+struct Chunk {
+  size_t begin, end;
+  size_t line;
+};
+
+// Cuts source into at most count chunks of roughly equal size. A pre-pass
+// on threads follows comments, string literals and braces the way
+// JavaletteSkipper and the grammar do, speculating that each slice of the
+// source starts outside of them; a slice that does not gets scanned again.
+// Unbalanced braces leave one chunk, for the grammar to report.
+std::vector<Chunk> Split(const std::string & source, size_t count, size_t threads);
+
+struct Function {
+  boost::spirit::utree tree;
+  Tags<Tag> tags;
+};
+
+// Parses source on threads (0 for one per core) into functions, each as a
+// phrase_parse with parser::ParseUnit::function would. Returns false with
+// the first error in the source if a chunk fails to parse. Splitting and
+// each chunk are spans of trace, if given, on the threads that did them.
+bool Parse(const std::string & source, size_t threads, std::vector<std::unique_ptr<Function>> & functions,
+    parser::ParseError & error, trace::Recorder * trace = 0);
+
+}
+
+#endif // JLC_CHUNK_HH_
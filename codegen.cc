@@ -0,0 +1,1402 @@
+#include "codegen.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "dwarf.hh"
+#include "elf.hh"
+#include "x86.hh"
+
+namespace x86 {
+
+namespace {
+
+const Reg kIntArgs[] = {rdi, rsi, rdx, rcx, r8, r9};
+const int kIntArgCount = 6;
+const int kXmmArgCount = 8;
+
+// Where each argument of a call is passed: a register index, or a slot in
+// the outgoing stack area.
+struct ArgLocation {
+  bool stack;
+  int index;
+};
+
+std::vector<ArgLocation> Classify(const std::vector<Type> & types, int & stack_slots) {
+  std::vector<ArgLocation> locations;
+  int ints = 0, xmms = 0;
+  stack_slots = 0;
+  for (auto t : types) {
+    if (t == basic_type::double_ && xmms < kXmmArgCount)
+      locations.push_back(ArgLocation{false, xmms++});
+    else if (t != basic_type::double_ && ints < kIntArgCount)
+      locations.push_back(ArgLocation{false, ints++});
+    else
+      locations.push_back(ArgLocation{true, stack_slots++});
+  }
+  return locations;
+}
+
+int32_t Slot(uint32_t var) {
+  return -8 * static_cast<int32_t>(var + 1);
+}
+
+// Strings and arrays are pointers.
+bool IsPointer(Type t) {
+  return t == basic_type::string_ || IsArray(t);
+}
+
+// Arrays hold their length as 8 bytes, then 4-byte ints and booleans or
+// 8-byte doubles.
+const int32_t kElementsOffset = 8;
+
+int ElementSize(Type array) {
+  return ElementType(array) == basic_type::double_ ? 8 : 4;
+}
+
+// The counters follow the count, keys_size and path_size words of
+// jlc_profile.
+const int64_t kCountersOffset = 24;
+
+// What the code generators share: the code with its line table, the
+// object around it, and the calls of jlc_bounds_error by line.
+class Emitter {
+ protected:
+  // Notes that the code from here on comes from line.
+  void Line(int line) {
+    if (line <= 0)
+      return;
+    if (! lines.empty() && lines.back().address == as.Position())
+      lines.back().line = line;
+    else if (lines.empty() || lines.back().line != line)
+      lines.push_back(dwarf::Row{as.Position(), line});
+  }
+
+  // Goes through scratch.
+  void LoadDouble(Xmm x, double d, Reg scratch = rax) {
+    int64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    as.MovImm64(scratch, bits);
+    as.MovqToXmm(x, scratch);
+  }
+
+  void String(const std::string & s, Reg r = rax) {
+    auto i = strings.find(s);
+    uint32_t offset;
+    if (i != strings.end()) {
+      offset = i->second;
+    } else {
+      offset = object.rodata.size();
+      object.rodata.insert(object.rodata.end(), s.begin(), s.end());
+      object.rodata.push_back(0);
+      strings[s] = offset;
+    }
+    size_t pos = as.LeaRip(r);
+    object.AddRelocation(pos, object.SectionSymbol(elf::rodata), elf::R_X86_64_PC32, int64_t(offset) - 4);
+  }
+
+  void CallExternal(const std::string & name) {
+    size_t pos = as.CallExternal();
+    object.AddRelocation(pos, object.External(name), elf::R_X86_64_PLT32, -4);
+  }
+
+  // The label of the call of jlc_bounds_error for line.
+  Label BoundsError(int line) {
+    auto e = bounds_errors.find(line);
+    if (e == bounds_errors.end())
+      e = bounds_errors.insert(std::make_pair(line, as.NewLabel())).first;
+    return e->second;
+  }
+
+  void EmitBoundsErrors() {
+    for (auto & e : bounds_errors) {
+      as.Bind(e.second);
+      Line(e.first);
+      as.MovImm32(rdi, e.first);
+      CallExternal("jlc_bounds_error");
+    }
+    bounds_errors.clear();
+  }
+
+  Assembler as;
+  elf::ObjectWriter object;
+  std::unordered_map<std::string, uint32_t> strings;
+  std::map<int, Label> bounds_errors;
+  std::vector<dwarf::Row> lines;
+};
+
+// Integer and boolean values are computed in eax, strings and arrays in rax
+// and doubles in xmm0. Binary operators push their left operand while the
+// right one is computed; depth counts those pushes to keep calls aligned.
+//
+// Array accesses are bounds checked, with a jump to a call of
+// jlc_bounds_error, except in for loops that provably stay in bounds; see
+// MarkInBounds.
+class CodeGen : public FlatVisitor<CodeGen>, private Emitter {
+ public:
+  CodeGen(const FlatAST & a, TailCallStats & stats, const EmitOptions & o) :
+    FlatVisitor(a), options(o), tail_calls(stats), depth(0), current(0), incoming_slots(0)
+  {
+  }
+
+  std::string Run() {
+    const size_t n = ast.functions.size();
+    std::vector<size_t> order;
+    for (size_t i = 0 ; i < n ; ++i) {
+      functions[Name(i)] = i;
+      entries.push_back(as.NewLabel());
+      bodies.push_back(as.NewLabel());
+      order.push_back(i);
+    }
+    if (options.profile)
+      std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return Entries(a) > Entries(b); });
+
+    // Cold code goes after the functions that ran and before those that
+    // did not.
+    std::vector<size_t> starts(n), ends(n);
+    for (auto i : order) {
+      if (options.profile && Entries(i) == 0)
+        EmitColdCode();
+      starts[i] = as.Position();
+      trace::Span span(options.trace, "emit", Name(i));
+      Function(i);
+      EmitBoundsErrors();
+      ends[i] = as.Position();
+    }
+    EmitColdCode();
+    as.Finish();
+
+    // The cold code of f is a local function f.cold to debuggers and
+    // profilers, as GCC names it.
+    std::vector<dwarf::Subprogram> subprograms;
+    for (size_t i = 0 ; i < n ; ++i) {
+      object.AddSymbol(Name(i), elf::text, starts[i], ends[i] - starts[i], true);
+      subprograms.push_back(dwarf::Subprogram{Name(i), ast.line_pos[ast.functions[i]], starts[i], ends[i], false});
+    }
+    for (auto & r : cold_ranges) {
+      const std::string name = Name(r.function) + ".cold";
+      object.AddSymbol(name, elf::text, r.begin, r.end - r.begin, true, true);
+      subprograms.push_back(dwarf::Subprogram{name, ast.line_pos[ast.functions[r.function]], r.begin, r.end, true});
+    }
+    dwarf::Emit(object, options.source_file, subprograms, lines, as.Position());
+    if (! options.profile_generate.empty())
+      ProfileData();
+    object.text = std::move(as.code);
+    return object.Write();
+  }
+
+  void Visit(NodeId n) {
+    if (n != kNoNode)
+      Line(ast.line_pos[n]);
+    FlatVisitor::Visit(n);
+  }
+
+  void VisitBlock(NodeId n) {
+    VisitChildren(n);
+  }
+
+  void VisitIf(NodeId n) {
+    const NodeId else_inst = ast.Child(n, 2);
+    const uint64_t runs = Profiled(n, profile::Counter::if_);
+    const uint64_t taken = Profiled(n, profile::Counter::then_);
+    Label end = as.NewLabel();
+    Count(n, profile::Counter::if_);
+    Visit(ast.Child(n, 0));
+    as.Test32(rax, rax);
+    if (runs > 0 && taken == 0) {
+      as.JumpIf(not_equal, Cold(ast.Child(n, 1), n, end));
+      Visit(else_inst);
+    } else if (runs > 0 && taken == runs && else_inst != kNoNode) {
+      as.JumpIf(equal, Cold(else_inst, kNoNode, end));
+      Then(n);
+    } else if (else_inst != kNoNode && runs - taken > taken) {
+      Label then_label = as.NewLabel();
+      as.JumpIf(not_equal, then_label);
+      Visit(else_inst);
+      as.Jump(end);
+      as.Bind(then_label);
+      Then(n);
+    } else {
+      Label else_label = as.NewLabel();
+      as.JumpIf(equal, else_label);
+      Then(n);
+      if (else_inst != kNoNode)
+        as.Jump(end);
+      as.Bind(else_label);
+      Visit(else_inst);
+    }
+    as.Bind(end);
+  }
+
+  void VisitWhile(NodeId n) {
+    Loop(n, ast.Child(n, 0), kNoNode, ast.Child(n, 1));
+  }
+
+  void VisitFor(NodeId n) {
+    MarkInBounds(n);
+    Visit(ast.Child(n, 0));
+    Loop(n, ast.Child(n, 1), ast.Child(n, 2), ast.Child(n, 3));
+  }
+
+  void VisitReturn(NodeId n) {
+    NodeId call = ast.TailCall(n);
+    if (call != kNoNode && TailCall(call))
+      return;
+    Visit(ast.Child(n, 0));
+    as.Leave();
+    as.Ret();
+  }
+
+  void VisitAssignExp(NodeId n) {
+    Visit(ast.Child(n, 0));
+    Store(ast.type[n], ast.data[n]);
+  }
+
+  void VisitAssignIncDec(NodeId n) {
+    const int32_t slot = Slot(ast.data[n]);
+    if (ast.type[n] == basic_type::double_) {
+      as.LoadSd(xmm0, rbp, slot);
+      LoadDouble(xmm1, 1.0);
+      if (ast.op[n] == op::inc_)
+        as.Addsd(xmm0, xmm1);
+      else
+        as.Subsd(xmm0, xmm1);
+      as.StoreSd(rbp, slot, xmm0);
+    } else {
+      as.Load32(rax, rbp, slot);
+      as.AddImm32(rax, ast.op[n] == op::inc_ ? 1 : -1);
+      as.Store32(rbp, slot, rax);
+    }
+  }
+
+  // a[i] = e
+  void VisitAssignIndex(NodeId n) {
+    const Type t = ast.type[n];
+    Visit(ast.Child(n, 0));
+    Push(basic_type::int_);
+    Visit(ast.Child(n, 1));
+    as.Pop(rcx);
+    --depth;
+    as.Mov32(rcx, rcx);
+    as.Load(rdx, rbp, Slot(ast.data[n]));
+    BoundsCheck(n, rdx);
+    if (ElementType(t) == basic_type::double_)
+      as.StoreSd(rdx, rcx, 8, kElementsOffset, xmm0);
+    else
+      as.Store32(rdx, rcx, 4, kElementsOffset, rax);
+  }
+
+  void VisitDeclVar(NodeId n) {
+    NodeId init = ast.Child(n, 0);
+    if (init != kNoNode) {
+      Visit(init);
+    } else if (ast.type[n] == basic_type::double_) {
+      LoadDouble(xmm0, 0);
+    } else if (ast.type[n] == basic_type::string_) {
+      String("");
+    } else if (IsArray(ast.type[n])) {
+      as.Xor32(rax, rax);
+      NewArray(ast.type[n], ast.line_pos[n]);
+    } else {
+      as.Xor32(rax, rax);
+    }
+    Store(ast.type[n], ast.data[n]);
+  }
+
+  void VisitLiteral(NodeId n) {
+    switch (ast.kind[n]) {
+      case NodeKind::lit_int:
+        as.MovImm32(rax, ast.ints[ast.data[n]]);
+        break;
+      case NodeKind::lit_double:
+        LoadDouble(xmm0, ast.doubles[ast.data[n]]);
+        break;
+      case NodeKind::lit_bool:
+        as.MovImm32(rax, ast.data[n]);
+        break;
+      default: {
+        // The parser keeps the quotes of string literals.
+        const std::string & s = ast.strings[ast.data[n]];
+        String(s.size() >= 2 && s[0] == '"' ? s.substr(1, s.size() - 2) : s);
+        break;
+      }
+    }
+  }
+
+  void VisitVarRef(NodeId n) {
+    const int32_t slot = Slot(ast.data[n]);
+    if (ast.type[n] == basic_type::double_)
+      as.LoadSd(xmm0, rbp, slot);
+    else if (IsPointer(ast.type[n]))
+      as.Load(rax, rbp, slot);
+    else
+      as.Load32(rax, rbp, slot);
+  }
+
+  // a[i]. A variable a is loaded after i, which cannot change it, so
+  // nothing is pushed.
+  void VisitIndex(NodeId n) {
+    const NodeId array = ast.Child(n, 0);
+    if (ast.kind[array] == NodeKind::var_ref) {
+      Visit(ast.Child(n, 1));
+      as.Mov32(rcx, rax);
+      as.Load(rax, rbp, Slot(ast.data[array]));
+    } else {
+      Visit(array);
+      Push(ast.type[array]);
+      Visit(ast.Child(n, 1));
+      as.Mov32(rcx, rax);
+      as.Pop(rax);
+      --depth;
+    }
+    BoundsCheck(n, rax);
+    if (ast.type[n] == basic_type::double_)
+      as.LoadSd(xmm0, rax, rcx, 8, kElementsOffset);
+    else
+      as.Load32(rax, rax, rcx, 4, kElementsOffset);
+  }
+
+  void VisitLength(NodeId n) {
+    Visit(ast.Child(n, 0));
+    as.Load32(rax, rax, 0);
+  }
+
+  void VisitNewArray(NodeId n) {
+    Visit(ast.Child(n, 0));
+    NewArray(ast.type[n], ast.line_pos[n]);
+  }
+
+  void VisitFunCall(NodeId n) {
+    std::vector<Type> types;
+    for (const NodeId * c = ast.ChildrenBegin(n) ; c != ast.ChildrenEnd(n) ; ++c) {
+      Visit(*c);
+      types.push_back(ast.type[*c]);
+      Push(ast.type[*c]);
+    }
+
+    int stack_slots;
+    auto locations = Classify(types, stack_slots);
+    const int args = types.size();
+    const int32_t pad = (depth + stack_slots) % 2 ? 8 : 0;
+    const int32_t area = pad + 8 * stack_slots;
+    if (area)
+      as.SubImm(rsp, area);
+
+    // Argument i was pushed at [rsp + area + 8 * (args - 1 - i)].
+    for (int i = 0 ; i < args ; ++i) {
+      const int32_t from = area + 8 * (args - 1 - i);
+      if (locations[i].stack) {
+        as.Load(rax, rsp, from);
+        as.Store(rsp, 8 * locations[i].index, rax);
+      } else if (types[i] == basic_type::double_) {
+        as.LoadSd(Xmm(locations[i].index), rsp, from);
+      } else {
+        as.Load(kIntArgs[locations[i].index], rsp, from);
+      }
+    }
+
+    const std::string & name = ast.strings[ast.data[n]];
+    auto f = functions.find(name);
+    if (f != functions.end())
+      as.Call(entries[f->second]);
+    else
+      CallExternal(name);
+
+    if (area + 8 * args)
+      as.AddImm(rsp, area + 8 * args);
+    depth -= args;
+  }
+
+  void VisitUnary(NodeId n) {
+    Visit(ast.Child(n, 0));
+    if (ast.op[n] == op::not_) {
+      as.XorImm32(rax, 1);
+    } else if (ast.op[n] == op::minus_) {
+      if (ast.type[n] == basic_type::double_) {
+        as.MovqFromXmm(rax, xmm0);
+        as.FlipSign(rax);
+        as.MovqToXmm(xmm0, rax);
+      } else {
+        as.Neg32(rax);
+      }
+    }
+  }
+
+  void VisitBinary(NodeId n) {
+    const Op o = ast.op[n];
+    if (o == op::and_ || o == op::or_) {
+      Label end = as.NewLabel();
+      Visit(ast.Child(n, 0));
+      as.Test32(rax, rax);
+      as.JumpIf(o == op::and_ ? equal : not_equal, end);
+      Visit(ast.Child(n, 1));
+      as.Bind(end);
+      return;
+    }
+
+    const Type t = ast.type[ast.Child(n, 0)];
+    Visit(ast.Child(n, 0));
+    Push(t);
+    Visit(ast.Child(n, 1));
+
+    if (t == basic_type::double_) {
+      as.Movapd(xmm1, xmm0);
+      as.Pop(rax);
+      as.MovqToXmm(xmm0, rax);
+      --depth;
+      DoubleOp(o);
+    } else {
+      as.Mov(rcx, rax);
+      as.Pop(rax);
+      --depth;
+      if (IsPointer(t))
+        Compare(o, true);
+      else
+        IntOp(o);
+    }
+  }
+
+ private:
+  // Code placed out of line: inst, preceded by the then counter of
+  // counted_if unless that is kNoNode, and followed by a jump to back.
+  struct ColdCode {
+    Label entry;
+    NodeId inst;
+    NodeId counted_if;
+    Label back;
+    size_t function;
+    int incoming_slots;
+  };
+
+  struct ColdRange {
+    size_t function;
+    size_t begin, end;
+  };
+
+  const std::string & Name(size_t function) const {
+    return ast.strings[ast.data[ast.functions[function]]];
+  }
+
+  uint64_t Entries(size_t function) const {
+    return options.profile->Entries(Name(function));
+  }
+
+  profile::Key Key(NodeId n, profile::Counter kind) const {
+    return profile::Key{Name(current), ast.line_pos[n], n - ast.FunctionBegin(current), kind};
+  }
+
+  // How often the counter of n ran in the profile, 0 without one.
+  uint64_t Profiled(NodeId n, profile::Counter kind) const {
+    return options.profile ? options.profile->Count(Key(n, kind)) : 0;
+  }
+
+  // Increments the counter of n when instrumenting. Clobbers the flags.
+  void Count(NodeId n, profile::Counter kind) {
+    if (options.profile_generate.empty())
+      return;
+    const uint32_t counter = keys.Add(Key(n, kind));
+    size_t pos = as.IncRip();
+    object.AddRelocation(pos, object.SectionSymbol(elf::data), elf::R_X86_64_PC32, kCountersOffset + 8 * int64_t(counter) - 4);
+  }
+
+  void Then(NodeId n) {
+    Count(n, profile::Counter::then_);
+    Visit(ast.Child(n, 1));
+  }
+
+  // Returns the label of inst moved out of line.
+  Label Cold(NodeId inst, NodeId counted_if, Label back) {
+    cold.push_back(ColdCode{as.NewLabel(), inst, counted_if, back, current, incoming_slots});
+    return cold.back().entry;
+  }
+
+  // Emits the cold code of each function in one range, with the calls of
+  // jlc_bounds_error it jumps to.
+  void EmitColdCode() {
+    while (! cold.empty()) {
+      const size_t function = cold[0].function;
+      const size_t begin = as.Position();
+      // Cold code may move more code of its function out of line.
+      for (size_t i = 0 ; i < cold.size() ; ++i) {
+        if (cold[i].function != function)
+          continue;
+        const ColdCode c = cold[i];
+        current = c.function;
+        incoming_slots = c.incoming_slots;
+        as.Bind(c.entry);
+        Line(ast.line_pos[c.inst]);
+        if (c.counted_if != kNoNode)
+          Then(c.counted_if);
+        else
+          Visit(c.inst);
+        as.Jump(c.back);
+      }
+      cold.erase(std::remove_if(cold.begin(), cold.end(), [function](const ColdCode & c) {
+        return c.function == function;
+      }), cold.end());
+      EmitBoundsErrors();
+      cold_ranges.push_back(ColdRange{function, begin, as.Position()});
+    }
+  }
+
+  // jlc_profile, see profile.hh.
+  void ProfileData() {
+    const std::string encoded = keys.Encode();
+    const std::string & path = options.profile_generate;
+    auto & data = object.data;
+    for (uint64_t word : {uint64_t(keys.size()), uint64_t(encoded.size()), uint64_t(path.size() + 1)})
+      for (int i = 0 ; i < 8 ; ++i)
+        data.push_back(word >> (8 * i));
+    data.resize(data.size() + 8 * keys.size(), 0);
+    data.insert(data.end(), encoded.begin(), encoded.end());
+    data.insert(data.end(), path.begin(), path.end());
+    data.push_back(0);
+    object.AddSymbol("jlc_profile", elf::data, 0, data.size(), false);
+  }
+
+  void Function(size_t index) {
+    const NodeId fun = ast.functions[index];
+    current = index;
+    as.Bind(entries[index]);
+    Line(ast.line_pos[fun]);
+
+    const int vars = ast.function_vars[index];
+    as.Push(rbp);
+    as.Mov(rbp, rsp);
+    if (vars)
+      as.SubImm(rsp, (8 * vars + 15) / 16 * 16);
+
+    const auto & types = ast.function_args[index];
+    auto locations = Classify(types, incoming_slots);
+    for (size_t i = 0 ; i < types.size() ; ++i) {
+      if (locations[i].stack) {
+        as.Load(rax, rbp, 16 + 8 * locations[i].index);
+        as.Store(rbp, Slot(i), rax);
+      } else if (types[i] == basic_type::double_) {
+        as.StoreSd(rbp, Slot(i), Xmm(locations[i].index));
+      } else {
+        as.Store(rbp, Slot(i), kIntArgs[locations[i].index]);
+      }
+    }
+
+    // Self tail calls jump past the entry counter.
+    Count(fun, profile::Counter::entry);
+    as.Bind(bodies[index]);
+    Visit(ast.Child(fun, 0));
+
+    // Falling off the end is only possible in void functions.
+    if (ast.type[fun] == basic_type::void_) {
+      as.Leave();
+      as.Ret();
+    } else {
+      as.Ud2();
+    }
+  }
+
+  // Compiles `return call` into a jump when the callee is defined in this
+  // program. A self call stores the new arguments into their slots and
+  // jumps back to the body. A sibling call passes its arguments in place of
+  // the caller's and jumps to the callee with the caller's frame popped, so
+  // the callee returns straight to our caller; this needs its stack
+  // arguments to fit in the caller's incoming ones.
+  bool TailCall(NodeId call) {
+    auto f = functions.find(ast.strings[ast.data[call]]);
+    if (f == functions.end())
+      return false;
+    const size_t callee = f->second;
+    const auto & types = ast.function_args[callee];
+    int stack_slots;
+    auto locations = Classify(types, stack_slots);
+    if (callee != current && stack_slots > incoming_slots)
+      return false;
+
+    for (const NodeId * c = ast.ChildrenBegin(call) ; c != ast.ChildrenEnd(call) ; ++c) {
+      Visit(*c);
+      Push(ast.type[*c]);
+    }
+    const int args = types.size();
+    depth -= args;
+
+    if (callee == current) {
+      for (int i = args - 1 ; i >= 0 ; --i) {
+        as.Pop(rax);
+        as.Store(rbp, Slot(i), rax);
+      }
+      as.Jump(bodies[callee]);
+      ++tail_calls.self;
+      return true;
+    }
+
+    for (int i = 0 ; i < args ; ++i) {
+      const int32_t from = 8 * (args - 1 - i);
+      if (locations[i].stack) {
+        as.Load(rax, rsp, from);
+        as.Store(rbp, 16 + 8 * locations[i].index, rax);
+      } else if (types[i] == basic_type::double_) {
+        as.LoadSd(Xmm(locations[i].index), rsp, from);
+      } else {
+        as.Load(kIntArgs[locations[i].index], rsp, from);
+      }
+    }
+    as.Leave();
+    as.Jump(entries[callee]);
+    ++tail_calls.sibling;
+    return true;
+  }
+
+  // Loops that iterate in the profile test at the bottom, so each
+  // iteration takes a single branch.
+  void Loop(NodeId n, NodeId test, NodeId post, NodeId body) {
+    Label top = as.NewLabel();
+    Count(n, profile::Counter::loop);
+    if (Profiled(n, profile::Counter::body) > Profiled(n, profile::Counter::loop)) {
+      Label check = as.NewLabel();
+      as.Jump(check);
+      as.Bind(top);
+      Count(n, profile::Counter::body);
+      Visit(body);
+      Visit(post);
+      as.Bind(check);
+      Visit(test);
+      as.Test32(rax, rax);
+      as.JumpIf(not_equal, top);
+      return;
+    }
+    Label end = as.NewLabel();
+    as.Bind(top);
+    Visit(test);
+    as.Test32(rax, rax);
+    as.JumpIf(equal, end);
+    Count(n, profile::Counter::body);
+    Visit(body);
+    Visit(post);
+    as.Jump(top);
+    as.Bind(end);
+  }
+
+  // Marks the accesses a[i] in the body of for loop n that its header
+  // keeps in bounds, when neither i nor a is assigned in the body:
+  //
+  //   for (i = c; i < a.length; i++), with a constant c >= 0, and
+  //   for (i = a.length - c; i >= 0; i--), with a constant c >= 1.
+  //
+  // i then stays within [0, a.length) in the body, and ++ cannot overflow
+  // since i < a.length.
+  void MarkInBounds(NodeId n) {
+    const NodeId pre = ast.Child(n, 0), test = ast.Child(n, 1), post = ast.Child(n, 2), body = ast.Child(n, 3);
+    if (pre == kNoNode || post == kNoNode || ast.kind[pre] != NodeKind::inst_assign_exp ||
+        ast.kind[post] != NodeKind::inst_assign_incdec || ast.data[post] != ast.data[pre] ||
+        ast.kind[test] != NodeKind::binary)
+      return;
+    const uint32_t i = ast.data[pre];
+    const NodeId start = ast.Child(pre, 0), lhs = ast.Child(test, 0), rhs = ast.Child(test, 1);
+    if (! IsVar(lhs, i))
+      return;
+    NodeId length;
+    int c;
+    if (ast.op[post] == op::inc_) {
+      if (ast.op[test] != op::lt_ || ! IsInt(start, c) || c < 0)
+        return;
+      length = rhs;
+    } else {
+      if (ast.op[test] != op::gte_ || ! IsInt(rhs, c) || c != 0 ||
+          ast.kind[start] != NodeKind::binary || ast.op[start] != op::minus_ ||
+          ! IsInt(ast.Child(start, 1), c) || c < 1)
+        return;
+      length = ast.Child(start, 0);
+    }
+    if (ast.kind[length] != NodeKind::array_length || ast.kind[ast.Child(length, 0)] != NodeKind::var_ref)
+      return;
+    const uint32_t a = ast.data[ast.Child(length, 0)];
+    if (Assigns(body, i) || Assigns(body, a))
+      return;
+    MarkAccesses(body, a, i);
+  }
+
+  bool IsVar(NodeId n, uint32_t var) const {
+    return ast.kind[n] == NodeKind::var_ref && ast.data[n] == var;
+  }
+
+  bool IsInt(NodeId n, int & value) const {
+    if (ast.kind[n] != NodeKind::lit_int)
+      return false;
+    value = ast.ints[ast.data[n]];
+    return true;
+  }
+
+  // Whether the statements under n assign var.
+  bool Assigns(NodeId n, uint32_t var) const {
+    if (n == kNoNode)
+      return false;
+    switch (ast.kind[n]) {
+      case NodeKind::inst_assign_exp:
+      case NodeKind::inst_assign_incdec:
+      case NodeKind::decl_var:
+        if (ast.data[n] == var)
+          return true;
+        break;
+      default:
+        break;
+    }
+    for (const NodeId * c = ast.ChildrenBegin(n) ; c != ast.ChildrenEnd(n) ; ++c)
+      if (Assigns(*c, var))
+        return true;
+    return false;
+  }
+
+  // Marks a[i] and a[i] = e under n.
+  void MarkAccesses(NodeId n, uint32_t a, uint32_t i) {
+    if (n == kNoNode)
+      return;
+    if ((ast.kind[n] == NodeKind::array_index && IsVar(ast.Child(n, 0), a) && IsVar(ast.Child(n, 1), i)) ||
+        (ast.kind[n] == NodeKind::inst_assign_index && ast.data[n] == a && IsVar(ast.Child(n, 0), i)))
+      in_bounds.insert(n);
+    for (const NodeId * c = ast.ChildrenBegin(n) ; c != ast.ChildrenEnd(n) ; ++c)
+      MarkAccesses(*c, a, i);
+  }
+
+  // Jumps to jlc_bounds_error unless ecx indexes the array in reg, or n
+  // is known to be in bounds. ecx is taken as unsigned, so negative
+  // indices fail the test too.
+  void BoundsCheck(NodeId n, Reg array) {
+    if (in_bounds.count(n))
+      return;
+    as.Cmp32(rcx, array, 0);
+    as.JumpIf(above_equal, BoundsError(ast.line_pos[n]));
+  }
+
+  // rax = new t[eax] at line.
+  void NewArray(Type t, int line) {
+    as.Mov32(rdi, rax);
+    as.MovImm32(rsi, ElementSize(t));
+    as.MovImm32(rdx, line);
+    CallRuntime("jlc_new_array");
+  }
+
+  void Push(Type t) {
+    if (t == basic_type::double_)
+      as.MovqFromXmm(rax, xmm0);
+    as.Push(rax);
+    ++depth;
+  }
+
+  void Store(Type t, uint32_t var) {
+    if (t == basic_type::double_)
+      as.StoreSd(rbp, Slot(var), xmm0);
+    else
+      as.Store(rbp, Slot(var), rax);
+  }
+
+  // Calls a runtime helper from within an expression, with the stack
+  // aligned.
+  void CallRuntime(const std::string & name) {
+    if (depth % 2)
+      as.SubImm(rsp, 8);
+    CallExternal(name);
+    if (depth % 2)
+      as.AddImm(rsp, 8);
+  }
+
+  // eax = eax o ecx
+  void IntOp(Op o) {
+    switch (o) {
+      case op::plus_: as.Add32(rax, rcx); break;
+      case op::minus_: as.Sub32(rax, rcx); break;
+      case op::mul_: as.Imul32(rax, rcx); break;
+      case op::div_:
+      case op::mod_:
+        as.Cdq();
+        as.Idiv32(rcx);
+        if (o == op::mod_)
+          as.Mov32(rax, rdx);
+        break;
+      default:
+        Compare(o, false);
+        break;
+    }
+  }
+
+  void Compare(Op o, bool wide) {
+    if (wide)
+      as.Cmp(rax, rcx);
+    else
+      as.Cmp32(rax, rcx);
+    Cond c = equal;
+    switch (o) {
+      case op::lt_: c = less; break;
+      case op::lte_: c = less_equal; break;
+      case op::gt_: c = greater; break;
+      case op::gte_: c = greater_equal; break;
+      case op::eq_: c = equal; break;
+      case op::neq_: c = not_equal; break;
+    }
+    as.Set(c, rax);
+    as.Movzx8(rax, rax);
+  }
+
+  // xmm0 = xmm0 o xmm1, or eax = xmm0 o xmm1 for comparisons. Unordered
+  // operands compare unequal and neither less nor greater.
+  void DoubleOp(Op o) {
+    switch (o) {
+      case op::plus_: as.Addsd(xmm0, xmm1); return;
+      case op::minus_: as.Subsd(xmm0, xmm1); return;
+      case op::mul_: as.Mulsd(xmm0, xmm1); return;
+      case op::div_: as.Divsd(xmm0, xmm1); return;
+      case op::mod_:
+        CallRuntime("jlc_fmod");
+        return;
+      case op::lt_: as.Ucomisd(xmm1, xmm0); as.Set(above, rax); break;
+      case op::lte_: as.Ucomisd(xmm1, xmm0); as.Set(above_equal, rax); break;
+      case op::gt_: as.Ucomisd(xmm0, xmm1); as.Set(above, rax); break;
+      case op::gte_: as.Ucomisd(xmm0, xmm1); as.Set(above_equal, rax); break;
+      case op::eq_:
+        as.Ucomisd(xmm0, xmm1);
+        as.Set(equal, rax);
+        as.Set(not_parity, rcx);
+        as.And32(rax, rcx);
+        break;
+      case op::neq_:
+        as.Ucomisd(xmm0, xmm1);
+        as.Set(not_equal, rax);
+        as.Set(parity, rcx);
+        as.Or32(rax, rcx);
+        break;
+    }
+    as.Movzx8(rax, rax);
+  }
+
+  const EmitOptions & options;
+  // Function indices by name, with the labels of their entries and of
+  // their bodies after the prologue.
+  std::unordered_map<std::string, size_t> functions;
+  std::vector<Label> entries;
+  std::vector<Label> bodies;
+  // Array accesses MarkInBounds proved safe.
+  std::unordered_set<NodeId> in_bounds;
+  TailCallStats & tail_calls;
+  int depth;
+  // The function being generated and its stack-passed argument count.
+  size_t current;
+  int incoming_slots;
+  std::vector<ColdCode> cold;
+  std::vector<ColdRange> cold_ranges;
+  profile::Keys keys;
+};
+
+// Code generator from the optimized IR. Every value lives in a stack slot
+// and is loaded into registers for each instruction using it; constants
+// are folded into those instructions instead. A phi has a second slot its
+// predecessors store into before they branch, which is copied into its own
+// slot at the start of its block, so that phis reading each other see the
+// values of the previous iteration.
+//
+// Integer and boolean values are loaded as 32 bits, strings, arrays and
+// doubles as 64, so values can be moved through general registers.
+class SsaCodeGen : private Emitter {
+ public:
+  SsaCodeGen(const ir::Module & module, TailCallStats & stats, const EmitOptions & o) :
+    m(module), options(o), tail_calls(stats), f(0), incoming_slots(0)
+  {
+  }
+
+  std::string Run() {
+    const size_t n = m.functions.size();
+    std::vector<size_t> order;
+    for (size_t i = 0 ; i < n ; ++i) {
+      functions[m.functions[i].name] = i;
+      entries.push_back(as.NewLabel());
+      order.push_back(i);
+    }
+    if (options.profile)
+      std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return options.profile->Entries(m.functions[a].name) > options.profile->Entries(m.functions[b].name);
+      });
+
+    std::vector<size_t> starts(n), ends(n);
+    for (auto i : order) {
+      starts[i] = as.Position();
+      trace::Span span(options.trace, "emit", m.functions[i].name);
+      Function(i);
+      ends[i] = as.Position();
+    }
+    as.Finish();
+
+    std::vector<dwarf::Subprogram> subprograms;
+    for (size_t i = 0 ; i < n ; ++i) {
+      const ir::Function & g = m.functions[i];
+      object.AddSymbol(g.name, elf::text, starts[i], ends[i] - starts[i], true, g.local);
+      subprograms.push_back(dwarf::Subprogram{g.name, g.line_pos, starts[i], ends[i], g.local});
+    }
+    dwarf::Emit(object, options.source_file, subprograms, lines, as.Position());
+    object.text = std::move(as.code);
+    return object.Write();
+  }
+
+ private:
+  const ir::Inst & Def(ir::Value v) const {
+    return f->insts[v];
+  }
+
+  // Numbers the slots of the values of f; phis get two.
+  int AssignSlots() {
+    slots.assign(f->insts.size(), -1);
+    incoming.assign(f->insts.size(), -1);
+    int count = 0;
+    for (ir::Value v = 0 ; v < f->insts.size() ; ++v) {
+      const ir::Inst & i = f->insts[v];
+      if (i.block == ir::kNoBlock || i.type == basic_type::void_ || ir::IsConstant(i.op))
+        continue;
+      slots[v] = count++;
+      if (i.op == ir::Opcode::phi)
+        incoming[v] = count++;
+    }
+    return count;
+  }
+
+  void Function(size_t index) {
+    f = &m.functions[index];
+    as.Bind(entries[index]);
+    Line(f->line_pos);
+
+    const int count = AssignSlots();
+    as.Push(rbp);
+    as.Mov(rbp, rsp);
+    if (count)
+      as.SubImm(rsp, (8 * count + 15) / 16 * 16);
+
+    auto locations = Classify(f->arg_types, incoming_slots);
+    for (ir::Value v = 0 ; v < f->insts.size() ; ++v) {
+      const ir::Inst & i = f->insts[v];
+      if (i.op != ir::Opcode::arg || i.block == ir::kNoBlock)
+        continue;
+      const ArgLocation & l = locations[i.imm];
+      if (l.stack) {
+        as.Load(rax, rbp, 16 + 8 * l.index);
+        as.Store(rbp, Slot(slots[v]), rax);
+      } else if (i.type == basic_type::double_) {
+        as.StoreSd(rbp, Slot(slots[v]), Xmm(l.index));
+      } else {
+        as.Store(rbp, Slot(slots[v]), kIntArgs[l.index]);
+      }
+    }
+
+    uses = f->Uses();
+    const auto order = f->ReversePostOrder();
+    labels.clear();
+    for (size_t b = 0 ; b < f->blocks.size() ; ++b)
+      labels.push_back(as.NewLabel());
+    for (size_t k = 0 ; k < order.size() ; ++k)
+      Block(order[k], k + 1 < order.size() ? order[k + 1] : ir::kNoBlock);
+
+    // Within the function's range, for its debugging information.
+    EmitBoundsErrors();
+  }
+
+  void Block(ir::BlockId b, ir::BlockId next) {
+    as.Bind(labels[b]);
+    const auto & list = f->blocks[b].insts;
+    for (size_t k = 0 ; k < list.size() ; ++k) {
+      const ir::Value v = list[k];
+      const ir::Inst & i = Def(v);
+      if (ir::IsConstant(i.op) || i.op == ir::Opcode::arg)
+        continue;
+      Line(i.line_pos);
+      if (i.op == ir::Opcode::call && k + 1 < list.size() && TailCall(v, list[k + 1]))
+        return;
+      // A compare only the branch after it uses sets the flags for it.
+      if (k + 2 == list.size() && Def(list[k + 1]).op == ir::Opcode::cond_br &&
+          Def(list[k + 1]).operands[0] == v && uses[v].size() == 1 && HasCondition(i)) {
+        Copies(b);
+        Branch(Condition(i), Def(list[k + 1]), next);
+        return;
+      }
+      Instruction(b, v, next);
+    }
+  }
+
+  void Instruction(ir::BlockId b, ir::Value v, ir::BlockId next) {
+    const ir::Inst & i = Def(v);
+    switch (i.op) {
+      case ir::Opcode::phi:
+        as.Load(rax, rbp, Slot(incoming[v]));
+        as.Store(rbp, Slot(slots[v]), rax);
+        return;
+      case ir::Opcode::neg:
+        Load(rax, i.operands[0]);
+        if (i.type == basic_type::double_)
+          as.FlipSign(rax);
+        else
+          as.Neg32(rax);
+        break;
+      case ir::Opcode::not_:
+        Load(rax, i.operands[0]);
+        as.XorImm32(rax, 1);
+        break;
+      case ir::Opcode::add:
+      case ir::Opcode::sub:
+      case ir::Opcode::mul:
+      case ir::Opcode::div:
+      case ir::Opcode::mod:
+        if (i.type == basic_type::double_) {
+          LoadXmm(xmm0, i.operands[0]);
+          LoadXmm(xmm1, i.operands[1]);
+          DoubleOp(i.op);
+          as.StoreSd(rbp, Slot(slots[v]), xmm0);
+          return;
+        }
+        Load(rax, i.operands[0]);
+        if (i.op == ir::Opcode::add && IsImmediate(i.operands[1])) {
+          as.AddImm32(rax, Def(i.operands[1]).imm);
+        } else if (i.op == ir::Opcode::sub && IsImmediate(i.operands[1])) {
+          as.SubImm32(rax, Def(i.operands[1]).imm);
+        } else {
+          Load(rcx, i.operands[1]);
+          IntOp(i.op);
+        }
+        break;
+      case ir::Opcode::lt:
+      case ir::Opcode::le:
+      case ir::Opcode::gt:
+      case ir::Opcode::ge:
+      case ir::Opcode::eq:
+      case ir::Opcode::ne:
+        Compare(i);
+        break;
+      case ir::Opcode::length:
+        Load(rax, i.operands[0]);
+        as.Load32(rax, rax, 0);
+        break;
+      case ir::Opcode::new_array:
+        Load(rdi, i.operands[0]);
+        as.MovImm32(rsi, ElementSize(i.type));
+        as.MovImm32(rdx, i.line_pos);
+        CallExternal("jlc_new_array");
+        break;
+      case ir::Opcode::load:
+        Load(rax, i.operands[0]);
+        Load(rcx, i.operands[1]);
+        if (i.type == basic_type::double_) {
+          as.LoadSd(xmm0, rax, rcx, 8, kElementsOffset);
+          as.StoreSd(rbp, Slot(slots[v]), xmm0);
+          return;
+        }
+        as.Load32(rax, rax, rcx, 4, kElementsOffset);
+        break;
+      case ir::Opcode::store:
+        Load(rdx, i.operands[0]);
+        Load(rcx, i.operands[1]);
+        if (Def(i.operands[2]).type == basic_type::double_) {
+          LoadXmm(xmm0, i.operands[2]);
+          as.StoreSd(rdx, rcx, 8, kElementsOffset, xmm0);
+        } else {
+          Load(rax, i.operands[2]);
+          as.Store32(rdx, rcx, 4, kElementsOffset, rax);
+        }
+        return;
+      case ir::Opcode::check:
+        // ecx is taken as unsigned, so negative indices fail too.
+        Load(rax, i.operands[0]);
+        Load(rcx, i.operands[1]);
+        as.Cmp32(rcx, rax, 0);
+        as.JumpIf(above_equal, BoundsError(i.line_pos));
+        return;
+      case ir::Opcode::call:
+        Call(i);
+        if (i.type == basic_type::double_) {
+          as.StoreSd(rbp, Slot(slots[v]), xmm0);
+          return;
+        }
+        if (i.type == basic_type::void_)
+          return;
+        break;
+      case ir::Opcode::br:
+        Copies(b);
+        if (i.targets[0] != next)
+          as.Jump(labels[i.targets[0]]);
+        return;
+      case ir::Opcode::cond_br:
+        // Storing into the phis of both targets is harmless: each way into
+        // a block stores into its phis first.
+        Copies(b);
+        Load(rax, i.operands[0]);
+        as.Test32(rax, rax);
+        Branch(not_equal, i, next);
+        return;
+      case ir::Opcode::ret:
+        if (! i.operands.empty()) {
+          if (f->type == basic_type::double_)
+            LoadXmm(xmm0, i.operands[0]);
+          else
+            Load(rax, i.operands[0]);
+        }
+        as.Leave();
+        as.Ret();
+        return;
+      case ir::Opcode::unreachable:
+        as.Ud2();
+        return;
+      default:
+        throw CompilerError();
+    }
+    as.Store(rbp, Slot(slots[v]), rax);
+  }
+
+  // Jumps to the first target of cond_br if c holds, to the second
+  // otherwise.
+  void Branch(Cond c, const ir::Inst & cond_br, ir::BlockId next) {
+    if (cond_br.targets[0] == next) {
+      // Flipping the low bit negates a condition.
+      as.JumpIf(Cond(c ^ 1), labels[cond_br.targets[1]]);
+      return;
+    }
+    as.JumpIf(c, labels[cond_br.targets[0]]);
+    if (cond_br.targets[1] != next)
+      as.Jump(labels[cond_br.targets[1]]);
+  }
+
+  // Stores the operands of the phis of b's successors into their incoming
+  // slots.
+  void Copies(ir::BlockId b) {
+    for (auto s : f->Successors(b)) {
+      const auto & preds = f->blocks[s].preds;
+      const size_t k = std::find(preds.begin(), preds.end(), b) - preds.begin();
+      for (auto phi : f->blocks[s].insts) {
+        if (Def(phi).op != ir::Opcode::phi)
+          break;
+        Load(rax, Def(phi).operands[k]);
+        as.Store(rbp, Slot(incoming[phi]), rax);
+      }
+    }
+  }
+
+  // Loads v into r, see the class comment.
+  void Load(Reg r, ir::Value v) {
+    const ir::Inst & i = Def(v);
+    switch (i.op) {
+      case ir::Opcode::const_int:
+      case ir::Opcode::const_bool:
+        as.MovImm32(r, i.imm);
+        return;
+      case ir::Opcode::const_double: {
+        int64_t bits;
+        std::memcpy(&bits, &i.fimm, sizeof(bits));
+        as.MovImm64(r, bits);
+        return;
+      }
+      case ir::Opcode::const_string:
+        String(m.strings[i.imm], r);
+        return;
+      default:
+        if (i.type == basic_type::int_ || i.type == basic_type::boolean_)
+          as.Load32(r, rbp, Slot(slots[v]));
+        else
+          as.Load(r, rbp, Slot(slots[v]));
+    }
+  }
+
+  // Whether v is an int or boolean constant, which instructions can take
+  // as their immediate operand. The induction steps and bounds of
+  // unrolled loops are.
+  bool IsImmediate(ir::Value v) const {
+    return Def(v).op == ir::Opcode::const_int || Def(v).op == ir::Opcode::const_bool;
+  }
+
+  // Goes through r11 for constants.
+  void LoadXmm(Xmm x, ir::Value v) {
+    if (Def(v).op == ir::Opcode::const_double)
+      LoadDouble(x, Def(v).fimm, r11);
+    else
+      as.LoadSd(x, rbp, Slot(slots[v]));
+  }
+
+  // The stack is aligned in the body, so calls need no padding beyond
+  // that of their stack arguments.
+  void Call(const ir::Inst & call) {
+    std::vector<Type> types;
+    for (auto a : call.operands)
+      types.push_back(Def(a).type);
+    int stack_slots;
+    auto locations = Classify(types, stack_slots);
+    const int32_t area = (8 * stack_slots + 15) / 16 * 16;
+    if (area)
+      as.SubImm(rsp, area);
+    for (size_t k = 0 ; k < types.size() ; ++k) {
+      if (locations[k].stack) {
+        Load(rax, call.operands[k]);
+        as.Store(rsp, 8 * locations[k].index, rax);
+      } else if (types[k] == basic_type::double_) {
+        LoadXmm(Xmm(locations[k].index), call.operands[k]);
+      } else {
+        Load(kIntArgs[locations[k].index], call.operands[k]);
+      }
+    }
+
+    const std::string & name = m.strings[call.imm];
+    auto callee = functions.find(name);
+    if (callee != functions.end())
+      as.Call(entries[callee->second]);
+    else
+      CallExternal(name);
+    if (area)
+      as.AddImm(rsp, area);
+  }
+
+  // Compiles call v followed by `ret v` into a jump to a function of the
+  // module, passing the arguments in place of the caller's and with its
+  // frame popped, as CodeGen::TailCall does for sibling calls. Its stack
+  // arguments need to fit in the caller's incoming ones.
+  bool TailCall(ir::Value v, ir::Value ret) {
+    const ir::Inst & call = Def(v);
+    const ir::Inst & r = Def(ret);
+    if (r.op != ir::Opcode::ret ||
+        (r.operands.empty() ? call.type != basic_type::void_ : r.operands[0] != v))
+      return false;
+    auto callee = functions.find(m.strings[call.imm]);
+    if (callee == functions.end())
+      return false;
+    const auto & types = m.functions[callee->second].arg_types;
+    int stack_slots;
+    auto locations = Classify(types, stack_slots);
+    if (stack_slots > incoming_slots)
+      return false;
+
+    for (size_t k = 0 ; k < types.size() ; ++k) {
+      if (locations[k].stack) {
+        Load(rax, call.operands[k]);
+        as.Store(rbp, 16 + 8 * locations[k].index, rax);
+      } else if (types[k] == basic_type::double_) {
+        LoadXmm(Xmm(locations[k].index), call.operands[k]);
+      } else {
+        Load(kIntArgs[locations[k].index], call.operands[k]);
+      }
+    }
+    as.Leave();
+    as.Jump(entries[callee->second]);
+    ++tail_calls.sibling;
+    return true;
+  }
+
+  // eax = eax o ecx
+  void IntOp(ir::Opcode o) {
+    switch (o) {
+      case ir::Opcode::add: as.Add32(rax, rcx); break;
+      case ir::Opcode::sub: as.Sub32(rax, rcx); break;
+      case ir::Opcode::mul: as.Imul32(rax, rcx); break;
+      default:
+        as.Cdq();
+        as.Idiv32(rcx);
+        if (o == ir::Opcode::mod)
+          as.Mov32(rax, rdx);
+        break;
+    }
+  }
+
+  // xmm0 = xmm0 o xmm1
+  void DoubleOp(ir::Opcode o) {
+    switch (o) {
+      case ir::Opcode::add: as.Addsd(xmm0, xmm1); break;
+      case ir::Opcode::sub: as.Subsd(xmm0, xmm1); break;
+      case ir::Opcode::mul: as.Mulsd(xmm0, xmm1); break;
+      case ir::Opcode::div: as.Divsd(xmm0, xmm1); break;
+      default: CallExternal("jlc_fmod"); break;
+    }
+  }
+
+  // Whether comparison i holds under a single condition. Unordered doubles
+  // are unequal, so == and != on doubles need the parity flag as well.
+  bool HasCondition(const ir::Inst & i) const {
+    if (i.op < ir::Opcode::lt || i.op > ir::Opcode::ne)
+      return false;
+    return Def(i.operands[0]).type != basic_type::double_ || (i.op != ir::Opcode::eq && i.op != ir::Opcode::ne);
+  }
+
+  // Compares the operands of i, see HasCondition, and returns the
+  // condition under which i holds. Unordered doubles set the carry flag,
+  // so they are neither less nor greater.
+  Cond Condition(const ir::Inst & i) {
+    const Type t = Def(i.operands[0]).type;
+    if (t == basic_type::double_) {
+      LoadXmm(xmm0, i.operands[0]);
+      LoadXmm(xmm1, i.operands[1]);
+      switch (i.op) {
+        case ir::Opcode::lt: as.Ucomisd(xmm1, xmm0); return above;
+        case ir::Opcode::le: as.Ucomisd(xmm1, xmm0); return above_equal;
+        case ir::Opcode::gt: as.Ucomisd(xmm0, xmm1); return above;
+        default: as.Ucomisd(xmm0, xmm1); return above_equal;
+      }
+    }
+
+    Load(rax, i.operands[0]);
+    if (IsImmediate(i.operands[1])) {
+      as.CmpImm32(rax, Def(i.operands[1]).imm);
+    } else {
+      Load(rcx, i.operands[1]);
+      if (IsPointer(t))
+        as.Cmp(rax, rcx);
+      else
+        as.Cmp32(rax, rcx);
+    }
+    switch (i.op) {
+      case ir::Opcode::lt: return less;
+      case ir::Opcode::le: return less_equal;
+      case ir::Opcode::gt: return greater;
+      case ir::Opcode::ge: return greater_equal;
+      case ir::Opcode::eq: return equal;
+      default: return not_equal;
+    }
+  }
+
+  // eax = the comparison i, as CodeGen::Compare and CodeGen::DoubleOp
+  // compute it.
+  void Compare(const ir::Inst & i) {
+    if (HasCondition(i)) {
+      as.Set(Condition(i), rax);
+    } else {
+      LoadXmm(xmm0, i.operands[0]);
+      LoadXmm(xmm1, i.operands[1]);
+      as.Ucomisd(xmm0, xmm1);
+      if (i.op == ir::Opcode::eq) {
+        as.Set(equal, rax);
+        as.Set(not_parity, rcx);
+        as.And32(rax, rcx);
+      } else {
+        as.Set(not_equal, rax);
+        as.Set(parity, rcx);
+        as.Or32(rax, rcx);
+      }
+    }
+    as.Movzx8(rax, rax);
+  }
+
+  const ir::Module & m;
+  const EmitOptions & options;
+  TailCallStats & tail_calls;
+  // Function indices by name and the labels of their entries.
+  std::unordered_map<std::string, size_t> functions;
+  std::vector<Label> entries;
+  // The function being generated, its stack-passed argument count, the
+  // labels of its blocks and the slots of its values, -1 for none.
+  const ir::Function * f;
+  int incoming_slots;
+  std::vector<Label> labels;
+  std::vector<int> slots;
+  std::vector<int> incoming;
+  std::vector<std::vector<ir::Value>> uses;
+};
+
+}
+
+std::string EmitObject(const FlatAST & ast, TailCallStats * tail_calls, const EmitOptions & options) {
+  TailCallStats unused;
+  return CodeGen(ast, tail_calls ? *tail_calls : unused, options).Run();
+}
+
+std::string EmitObject(const ir::Module & module, TailCallStats * tail_calls, const EmitOptions & options) {
+  TailCallStats unused;
+  return SsaCodeGen(module, tail_calls ? *tail_calls : unused, options).Run();
+}
+
+}
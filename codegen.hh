@@ -0,0 +1,63 @@
+#ifndef JLC_CODEGEN_HH_
+#define JLC_CODEGEN_HH_
+
+#include <string>
+
+#include "flat_ast.hh"
+#include "ir.hh"
+#include "profile.hh"
+#include "trace.hh"
+
+namespace x86 {
+
+struct EmitOptions {
+  EmitOptions() : profile(0), trace(0) {}
+
+  // If not empty, count executions and write the profile to this path at
+  // exit, see profile.hh.
+  std::string profile_generate;
+  // Lay out code for this profile, if given; not owned.
+  const profile::Profile * profile;
+  // Name of the source file in the debugging information.
+  std::string source_file;
+  // Where each function's code generation is timed, if anywhere; not
+  // owned.
+  trace::Recorder * trace;
+};
+
+// Single-pass template code generator from the checked program straight to
+// an x86-64 ELF relocatable object. Every variable lives in a stack slot and
+// expression temporaries go through the machine stack, so code is emitted
+// in one walk without any analysis. Meant for fast unoptimized builds.
+//
+// Functions follow the System V calling convention. The built-ins,
+// jlc_fmod (double %), jlc_new_array and jlc_bounds_error are left
+// undefined for the runtime library. The object always carries DWARF line
+// tables and function entries, so debuggers and profilers can map its code
+// back to the source.
+//
+// Array accesses are bounds checked, except a[i] in for loops over i whose
+// header alone shows that i stays in bounds.
+//
+// Calls in tail position to functions of the program become jumps and are
+// counted in tail_calls, if given.
+//
+// With a profile, functions are placed hottest first and those that never
+// ran last, branches that were never taken move behind the hot functions,
+// the more frequent side of an if falls through, and loops that iterate
+// test at the bottom.
+std::string EmitObject(const FlatAST & ast, TailCallStats * tail_calls = 0, const EmitOptions & options = EmitOptions());
+
+// The same from the IR after the passes, so that their work reaches the
+// object. Values live in stack slots and phis become copies on the edges
+// into their blocks. Bounds checks are those bce left. Sibling tail calls
+// become jumps as above; self tail calls are already loops, see ir::Lower.
+//
+// With a profile, functions are placed hottest first. The code is not
+// instrumented: options.profile_generate must be empty.
+std::string EmitObject(const ir::Module & module, TailCallStats * tail_calls = 0,
+    const EmitOptions & options = EmitOptions());
+
+}
+
+#endif // JLC_CODEGEN_HH_
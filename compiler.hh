@@ -8,37 +8,53 @@
 #include "util.hh"
 
 #include "ast.hh"
+#include "cfg.hh"
+#include "diagnostics.hh"
+#include "interface.hh"
 #include "tags.hh"
 #include "operators.hh"
 #include "types.hh"
 #include "symbols.hh"
 #include "exception.hh"
 
-const bool kDebug = false;
-
 using boost::spirit::utree;
 using boost::spirit::utree_type;
 
+// Type checker. Errors go to diagnostics; an internal inconsistency
+// throws CompilerError.
 template <class Tags>
 struct Compiler {
   Symbols symbols;
+  TypeTable types;
+  diag::Sink diagnostics;
   Tags & tags;
   Symbol current_function;
-  bool has_return;
-
-  Compiler(Tags & t) : tags(t) {
-    symbols.Add(Symbol{basic_type::void_, "printInt", basic_type::int_});
-    symbols.Add(Symbol{basic_type::void_, "printString", basic_type::string_});
-    symbols.Add(Symbol{basic_type::void_, "printDouble", basic_type::double_});
-    symbols.Add(Symbol{basic_type::void_, "error"}.function());
-    symbols.Add(Symbol{basic_type::int_, "readInt"}.function());
-    symbols.Add(Symbol{basic_type::double_, "readDouble"}.function());
+  int vars;
+  // Line of the statement being checked, for errors in untagged nodes.
+  int statement_line;
+  // Functions called by the function definition checked last, in call
+  // order and repeated: its edges in the call graph.
+  std::vector<std::string> callees;
+
+  Compiler(Tags & t) : tags(t), statement_line(0) {
+    symbols.Add(Symbol{types.Function({basic_type::void_, {basic_type::int_}}), "printInt"});
+    symbols.Add(Symbol{types.Function({basic_type::void_, {basic_type::string_}}), "printString"});
+    symbols.Add(Symbol{types.Function({basic_type::void_, {basic_type::double_}}), "printDouble"});
+    symbols.Add(Symbol{types.Function({basic_type::void_, {}}), "error"});
+    symbols.Add(Symbol{types.Function({basic_type::int_, {}}), "readInt"});
+    symbols.Add(Symbol{types.Function({basic_type::double_, {}}), "readDouble"});
   }
 
+  // Records an error at u.
+  void Error(diag::Kind kind, utree & u, const std::string & subject = std::string()) {
+    diagnostics.Report(kind, tags.Tagged(u) ? Line(u) : statement_line, subject);
+  }
 
   std::string GetSymbol(utree & u) {
-    if (u.which() != utree_type::symbol_type)
-      throw ExpectedIdentifier(u, tags);
+    if (u.which() != utree_type::symbol_type) {
+      Error(diag::Kind::expected_identifier, u);
+      return std::string();
+    }
 
     using boost::spirit::utf8_symbol_range_type;
 
@@ -54,19 +70,48 @@ struct Compiler {
   }
 
   Type GetType(utree & u) {
-    if (u.which() != utree_type::int_type)
-      throw ExpectedType(u, tags);
+    if (u.which() != utree_type::int_type) {
+      Error(diag::Kind::expected_type, u);
+      return basic_type::error_;
+    }
 
     return u.get<int>();
   }
 
+  // A type that may be declared: arrays only hold int, double or boolean.
+  Type GetDeclaredType(utree & u) {
+    Type t = GetType(u);
+    if (IsArray(t) && ! IsElementType(ElementType(t))) {
+      Error(diag::Kind::bad_element_type, u);
+      return basic_type::error_;
+    }
+    return t;
+  }
+
   Op GetOp(utree & u) {
-    if (u.which() != utree_type::int_type)
-      throw ExpectedOp(u, tags);
+    if (u.which() != utree_type::int_type) {
+      Error(diag::Kind::expected_op, u);
+      return Op();
+    }
 
     return u.get<int>();
   }
 
+  int Line(utree & u) {
+    if (tags.Tagged(u))
+      return tags[u].line_pos;
+    else
+      return 0;
+  }
+
+  // Declares a variable of the current function.
+  int AddVariable(Type type, const std::string & name) {
+    Symbol var(type, name);
+    var.var = vars++;
+    symbols.Add(var);
+    return var.var;
+  }
+
   CodeTag Tag(utree & u) {
     if (tags.Tagged(u))
       return tags[u].code_tag;
@@ -102,14 +147,20 @@ struct Compiler {
     auto exp = new UnaryExp;
 
     Op o = GetOp(u[0]);
+    exp->op = o;
     exp->exp = Expression(u[1]);
     exp->type = exp->exp->GetType();
 
-    if (o == op::not_) {
-      if (exp->type != basic_type::boolean_)
-        throw IncompatibleUnaryExpArgument(u, tags);
-    } else if (exp->type != basic_type::double_ && exp->type != basic_type::int_) {
-      throw IncompatibleUnaryExpArgument(u, tags);
+    if (exp->type == basic_type::error_)
+      return make_unique_ptr(exp);
+    bool compatible;
+    if (o == op::not_)
+      compatible = exp->type == basic_type::boolean_;
+    else
+      compatible = exp->type == basic_type::double_ || exp->type == basic_type::int_;
+    if (! compatible) {
+      Error(diag::Kind::incompatible_unary_exp_argument, u);
+      exp->type = basic_type::error_;
     }
 
     return make_unique_ptr(exp);
@@ -119,23 +170,26 @@ struct Compiler {
     auto exp = new BinaryExp;
 
     Op o = GetOp(u[1]);
+    exp->op = o;
     exp->lhs = Expression(u[0]);
     exp->rhs = Expression(u[2]);
 
     Type t = exp->lhs->GetType();
+    exp->type = basic_type::error_;
+    if (t == basic_type::error_ || exp->rhs->GetType() == basic_type::error_)
+      return make_unique_ptr(exp);
 
-    if (t != exp->rhs->GetType())
-      throw IncompatibleBinaryExpArguments(u, tags);
-
+    bool compatible = t == exp->rhs->GetType();
     // == and != accept both
     if (! (op::NumericArgs(o) && op::BooleanArgs(o))) {
-      if (op::NumericArgs(o)) {
-        if (t != basic_type::double_ && t != basic_type::int_)
-          throw IncompatibleBinaryExpArguments(u, tags);
-      } else {
-        if (t != basic_type::boolean_)
-          throw IncompatibleBinaryExpArguments(u, tags);
-      }
+      if (op::NumericArgs(o))
+        compatible &= t == basic_type::double_ || t == basic_type::int_;
+      else
+        compatible &= t == basic_type::boolean_;
+    }
+    if (! compatible) {
+      Error(diag::Kind::incompatible_binary_exp_arguments, u);
+      return make_unique_ptr(exp);
     }
 
     if (op::NumericResult(o))
@@ -146,9 +200,68 @@ struct Compiler {
     return make_unique_ptr(exp);
   }
 
+  // The name of e for errors, if it is a variable.
+  static std::string Name(const Exp * e) {
+    auto var = dynamic_cast<const VarRef *>(e);
+    return var ? var->name : std::string();
+  }
+
+  std::unique_ptr<IndexExp> IndexExpression(utree & u) {
+    auto exp = new IndexExp;
+    exp->array = Expression(u[0]);
+    exp->index = Expression(u[2]);
+    exp->type = basic_type::error_;
+
+    Type t = exp->array->GetType();
+    Type i = exp->index->GetType();
+    if (t != basic_type::error_ && ! IsArray(t))
+      Error(diag::Kind::not_an_array, u, Name(exp->array.get()));
+    else if (i != basic_type::error_ && i != basic_type::int_)
+      Error(diag::Kind::bad_index_type, u);
+    else if (t != basic_type::error_)
+      exp->type = ElementType(t);
+
+    return make_unique_ptr(exp);
+  }
+
+  std::unique_ptr<LengthExp> LengthExpression(utree & u) {
+    auto exp = new LengthExp;
+    exp->array = Expression(u[0]);
+    exp->type = basic_type::error_;
+
+    Type t = exp->array->GetType();
+    if (t != basic_type::error_ && ! IsArray(t))
+      Error(diag::Kind::not_an_array, u, Name(exp->array.get()));
+    else if (t != basic_type::error_)
+      exp->type = basic_type::int_;
+
+    return make_unique_ptr(exp);
+  }
+
+  std::unique_ptr<NewArrayExp> NewArrayExpression(utree & u) {
+    auto exp = new NewArrayExp;
+    Type element = GetType(u[1]);
+    exp->length = Expression(u[2]);
+    exp->type = basic_type::error_;
+
+    Type n = exp->length->GetType();
+    if (! IsElementType(element))
+      Error(diag::Kind::bad_element_type, u);
+    else if (n != basic_type::error_ && n != basic_type::int_)
+      Error(diag::Kind::bad_array_length, u);
+    else
+      exp->type = ArrayOf(element);
+
+    return make_unique_ptr(exp);
+  }
+
   std::unique_ptr<Exp> Expression(utree & u) {
-    if (kDebug)
-      std::cerr << "exp:" << tags[u].line_pos << ": " << u << "\n";
+    std::unique_ptr<Exp> exp = ExpressionDispatch(u);
+    exp->line_pos = Line(u);
+    return exp;
+  }
+
+  std::unique_ptr<Exp> ExpressionDispatch(utree & u) {
     if (u[0].which() == utree_type::symbol_type) {
       // function call or variable reference
       switch (u.size()) {
@@ -158,13 +271,19 @@ struct Compiler {
           return FunctionCall(u);
       }
     } else {
-      // literal, unary or binary expression
+      // literal, unary, binary or array expression
       switch (u.size()) {
         case 1:
           return LitDispatch(u[0]);
         case 2:
+          if (u[1].which() == utree_type::int_type)
+            return LengthExpression(u);
           return UnaryExpression(u);
         case 3:
+          if (u[0].which() == utree_type::int_type)
+            return NewArrayExpression(u);
+          if (u[1].which() == utree_type::int_type && u[1].get<int>() == op::index_)
+            return IndexExpression(u);
           return BinaryExpression(u);
         default:
           throw CompilerError();
@@ -172,68 +291,121 @@ struct Compiler {
     }
   }
 
-  std::unique_ptr<VarRef> VariableRef(utree & u) {
+  std::unique_ptr<Exp> VariableRef(utree & u) {
     std::string name = GetSymbol(u[0]);
-    if (! symbols.Defined(name))
-      throw UndefinedVariable(u, tags);
+    if (! symbols.Defined(name)) {
+      Error(diag::Kind::undefined_variable, u, name);
+      return make_unique_ptr(new ErrorExp);
+    }
     auto var = new VarRef;
-    var->type = symbols[name].sig[0];
+    const Symbol & symbol = symbols[name];
+    var->name = name;
+    var->var = symbol.var;
+    var->type = symbol.type;
     return make_unique_ptr(var);
   }
 
-  std::unique_ptr<FunCall> FunctionCall(utree & u) {
+  std::unique_ptr<Exp> FunctionCall(utree & u) {
     std::string name = GetSymbol(u[0]);
-    if (kDebug)
-      std::cerr << "funcall? " << u << "\n";
+    const Symbol * fsymbol = 0;
+    const Signature * sig = 0;
     if (! symbols.Defined(name))
-      throw UndefinedFunction(u, tags);
-    Symbol fsymbol = symbols[name];
-    if (fsymbol.args == -1)
-      throw NotAFunction(u, tags);
-    if ((int)u[1].size() != fsymbol.args)
-      throw BadArgumentCount(u, tags);
+      Error(diag::Kind::undefined_function, u, name);
+    else if (! IsFunctionType((fsymbol = &symbols[name])->type))
+      Error(diag::Kind::not_a_function, u, name);
+    else if (u[1].size() != types[fsymbol->type].args.size())
+      Error(diag::Kind::bad_argument_count, u, name);
+    else
+      sig = &types[fsymbol->type];
+    // The arguments are checked either way.
     std::vector<std::unique_ptr<Exp>> args;
     for (auto i = u[1].begin() ; i != u[1].end() ; ++i) {
       args.push_back(Expression(*i));
     }
-    for (size_t i = 1 ; i < fsymbol.sig.size() ; ++i)
-      if (fsymbol.sig[i] != args[i-1]->GetType())
-        throw BadArgumentType(u, tags);
+    if (! sig)
+      return make_unique_ptr(new ErrorExp);
+    for (size_t i = 0 ; i < args.size() ; ++i) {
+      Type t = args[i]->GetType();
+      if (t != sig->args[i] && t != basic_type::error_) {
+        Error(diag::Kind::bad_argument_type, u, name);
+        break;
+      }
+    }
+    callees.push_back(name);
     auto fun = new FunCall;
-    fun->type = symbols[name].sig[0];
+    fun->name = name;
+    fun->args = std::move(args);
+    fun->type = sig->result;
     return make_unique_ptr(fun);
   }
 
-  void FunctionDeclaration(utree & u) {
-    Symbol fun(GetType(u[0]), GetSymbol(u[1]));
-    if (symbols.InContext(fun.name))
-      throw AlreadyDeclared(u, tags);
-    fun.args = u[2].size();
+  // Declares a function of another module. Must come before the program's
+  // own functions, which may then redefine it.
+  void Import(const interface::Function & f) {
+    Symbol fun(types.Function({f.type, f.args}), f.name);
+    if (symbols.InContext(f.name)) {
+      if (symbols[f.name].type != fun.type)
+        throw ConflictingImport(f.name);
+      return;
+    }
+    symbols.Add(fun);
+  }
 
+  void FunctionDeclaration(utree & u) {
+    std::string name = GetSymbol(u[1]);
+    if (symbols.InContext(name)) {
+      Error(diag::Kind::already_declared, u, name);
+      return;
+    }
+    Signature sig{GetType(u[0]), {}};
     for (auto i = u[2].begin() ; i != u[2].end() ; ++i) {
       auto arg = *i;
-      fun.sig.push_back(GetType(arg[0]));
+      sig.args.push_back(GetType(arg[0]));
     }
-    symbols.Add(fun);
+    symbols.Add(Symbol(types.Function(sig), name));
   }
 
   std::unique_ptr<FunDef> FunctionDefinition(utree & u) {
     auto fundef = new FunDef;
+    fundef->line_pos = Line(u);
+    if (tags.Tagged(u))
+      statement_line = fundef->line_pos;
     symbols.BeginContext();
+    vars = 0;
+    callees.clear();
     for (auto i = u[2].begin() ; i != u[2].end() ; ++i) {
       auto arg = *i;
-      symbols.Add(Symbol(GetType(arg[0]), GetSymbol(arg[1])));
+      fundef->arg_types.push_back(GetDeclaredType(arg[0]));
+      AddVariable(fundef->arg_types.back(), GetSymbol(arg[1]));
     }
-    current_function = symbols[GetSymbol(u[1])];
-    has_return = false;
+    fundef->name = GetSymbol(u[1]);
+    fundef->type = GetDeclaredType(u[0]);
+    // From the definition itself, in case another one took the name.
+    current_function = Symbol(types.Function({fundef->type, fundef->arg_types}), fundef->name);
     fundef->body = InstructionBlock(u[3]);
+    fundef->vars = vars;
     symbols.EndContext();
-    if (! has_return)
-      throw NoReturn(u, tags);
+
+    // Every path has to return a value; code no path reaches is dropped.
+    // Bodies with errors may have holes, so they are left alone.
+    cfg::Graph graph(*fundef->body);
+    if (fundef->type != basic_type::void_ && fundef->type != basic_type::error_ && graph.FallsOffEnd())
+      Error(diag::Kind::no_return, u, fundef->name);
+    if (diagnostics.Empty())
+      cfg::RemoveUnreachable(*fundef->body, graph);
     return make_unique_ptr(fundef);
   }
 
   std::unique_ptr<Inst> Instruction(utree & u) {
+    if (tags.Tagged(u))
+      statement_line = Line(u);
+    std::unique_ptr<Inst> inst = InstructionDispatch(u);
+    if (inst)
+      inst->line_pos = Line(u);
+    return inst;
+  }
+
+  std::unique_ptr<Inst> InstructionDispatch(utree & u) {
     switch (Tag(u)) {
       case CodeTag::inst_block:
         return InstructionBlock(u);
@@ -275,8 +447,6 @@ struct Compiler {
   }
 
   std::unique_ptr<InstIf> InstructionIf(utree & u) {
-    if (kDebug)
-      std::cerr << "if:" << tags[u].line_pos << ": " << u << "\n";
     auto inst = new InstIf;
     inst->test = Expression(u[1]);
     inst->if_inst = Instruction(u[2]);
@@ -286,8 +456,6 @@ struct Compiler {
   }
 
   std::unique_ptr<InstFor> InstructionFor(utree & u) {
-    if (kDebug)
-      std::cerr << "for:" << tags[u].line_pos << ": " << u << "\n";
     auto inst = new InstFor;
     inst->test = Expression(u[2]);
     inst->pre_inst = InstructionAssign(u[1]);
@@ -297,8 +465,6 @@ struct Compiler {
   }
 
   std::unique_ptr<InstWhile> InstructionWhile(utree & u) {
-    if (kDebug)
-      std::cerr << "while:" << tags[u].line_pos << ": " << u << "\n";
     auto inst = new InstWhile;
     inst->test = Expression(u[1]);
     inst->body = Instruction(u[2]);
@@ -306,8 +472,6 @@ struct Compiler {
   }
 
   std::unique_ptr<InstReturn> InstructionReturn(utree & u) {
-    if (kDebug)
-      std::cerr << "return:" << tags[u].line_pos << ": " << u << "\n";
     auto inst = new InstReturn;
 
     Type ret_type = basic_type::void_;
@@ -316,36 +480,71 @@ struct Compiler {
       ret_type = inst->exp->GetType();
     }
 
-    if (current_function.sig[0] != ret_type)
-      throw BadReturnType(u, tags);
-
-    has_return = true;
+    if (types[current_function.type].result != ret_type && ret_type != basic_type::error_)
+      Error(diag::Kind::bad_return_type, u, current_function.name);
 
     return make_unique_ptr(inst);
   }
 
   std::unique_ptr<InstAssign> InstructionAssign(utree & u) {
-    if (kDebug)
-      std::cerr << "assign:" << tags[u].line_pos << ": " << u << "\n";
-
     std::string name = GetSymbol(u[0]);
-    if (! symbols.Defined(name))
-      throw UndefinedVariable(u, tags);
+    if (! symbols.Defined(name)) {
+      Error(diag::Kind::undefined_variable, u, name);
+      if (u.size() == 3) {
+        Expression(u[2]);
+      } else if (u.size() == 4) {
+        Expression(u[1]);
+        Expression(u[3]);
+      }
+      return std::unique_ptr<InstAssign>();
+    }
 
-    if (u.size() == 3)
-      return InstructionAssignExp(u);
+    std::unique_ptr<InstAssign> inst;
+    if (u.size() == 4)
+      inst = InstructionAssignIndex(u);
+    else if (u.size() == 3)
+      inst = InstructionAssignExp(u);
     else
-      return InstructionAssignIncDec(u);
+      inst = InstructionAssignIncDec(u);
+    inst->line_pos = Line(u);
+    return inst;
   }
 
   std::unique_ptr<InstAssignExp> InstructionAssignExp(utree & u) {
     auto inst = new InstAssignExp;
 
-    Symbol var = symbols[GetSymbol(u[0])];
+    const Symbol & var = symbols[GetSymbol(u[0])];
+    inst->name = var.name;
+    inst->var = var.var;
+    inst->type = var.type;
     inst->exp = Expression(u[2]);
 
-    if (var.sig[0] != inst->exp->GetType())
-      throw BadAssignExpType(u, tags);
+    Type t = inst->exp->GetType();
+    if (var.type != t && t != basic_type::error_)
+      Error(diag::Kind::bad_assign_exp_type, u, var.name);
+
+    return make_unique_ptr(inst);
+  }
+
+  // u is [a, i, "=", e].
+  std::unique_ptr<InstAssignIndex> InstructionAssignIndex(utree & u) {
+    auto inst = new InstAssignIndex;
+
+    const Symbol & var = symbols[GetSymbol(u[0])];
+    inst->name = var.name;
+    inst->var = var.var;
+    inst->type = var.type;
+    inst->index = Expression(u[1]);
+    inst->exp = Expression(u[3]);
+
+    Type i = inst->index->GetType();
+    Type t = inst->exp->GetType();
+    if (var.type != basic_type::error_ && ! IsArray(var.type))
+      Error(diag::Kind::not_an_array, u, var.name);
+    else if (i != basic_type::int_ && i != basic_type::error_)
+      Error(diag::Kind::bad_index_type, u);
+    else if (var.type != basic_type::error_ && ElementType(var.type) != t && t != basic_type::error_)
+      Error(diag::Kind::bad_assign_exp_type, u, var.name);
 
     return make_unique_ptr(inst);
   }
@@ -353,31 +552,39 @@ struct Compiler {
   std::unique_ptr<InstAssignIncDec> InstructionAssignIncDec(utree & u) {
     auto inst = new InstAssignIncDec;
 
-    Symbol var = symbols[GetSymbol(u[0])];
+    const Symbol & var = symbols[GetSymbol(u[0])];
+    inst->name = var.name;
+    inst->var = var.var;
+    inst->type = var.type;
     inst->op = GetOp(u[1]);
 
-    if (var.sig[0] != basic_type::int_ && var.sig[0] != basic_type::double_)
-      throw BadAssignIncDecType(u, tags);
+    if (var.type != basic_type::int_ && var.type != basic_type::double_ && var.type != basic_type::error_)
+      Error(diag::Kind::bad_assign_inc_dec_type, u, var.name);
 
     return make_unique_ptr(inst);
   }
 
-  std::unique_ptr<Inst> InstructionDecl(utree & u) {
-    if (kDebug)
-      std::cerr << "decl:" << tags[u].line_pos << ": " << u << "\n";
-
-    Type type = GetType(u[0]);
+  std::unique_ptr<InstDecl> InstructionDecl(utree & u) {
+    auto inst = new InstDecl;
+    inst->type = GetDeclaredType(u[0]);
 
     for (size_t i = 1 ; i < u.size() ; ++i) {
-      Symbol var(type, GetSymbol(u[i][0]));
-      if (symbols.InContext(var.name))
-        throw AlreadyDeclared(u, tags);
-      symbols.Add(var);
+      std::string name = GetSymbol(u[i][0]);
+      if (symbols.InContext(name)) {
+        Error(diag::Kind::already_declared, u, name);
+        if (u[i].size() == 3)
+          Expression(u[i][2]);
+        continue;
+      }
+      inst->names.push_back(name);
+      inst->vars.push_back(AddVariable(inst->type, name));
       if (u[i].size() == 3)
-        InstructionAssignExp(u[i]);
+        inst->inits.push_back(std::move(InstructionAssignExp(u[i])->exp));
+      else
+        inst->inits.push_back(std::unique_ptr<Exp>());
     }
 
-    return std::unique_ptr<Inst>(0);
+    return make_unique_ptr(inst);
   }
 };
 
@@ -0,0 +1,136 @@
+#include "passes.hh"
+
+#include <algorithm>
+
+namespace ir {
+
+namespace {
+
+// Unused calls to speculatable functions may go too, and so may unused
+// arrays whose length is known not to trap.
+bool HasSideEffects(const Function & f, const Inst & inst, const std::vector<const Effects *> & callees) {
+  if (inst.op == Opcode::call)
+    return ! callees[inst.imm] || ! callees[inst.imm]->speculatable;
+  if (inst.op == Opcode::new_array) {
+    const Inst & length = f.insts[inst.operands[0]];
+    return length.op != Opcode::const_int || length.imm < 0;
+  }
+  return IsTerminator(inst.op) || inst.op == Opcode::store || inst.op == Opcode::check;
+}
+
+// Appends blocks to their predecessor when each is the other's only
+// neighbour, so that chains of jumps become one block.
+bool MergeBlocks(Function & f) {
+  bool changed = false;
+  std::vector<Value> map(f.insts.size(), kNoValue);
+
+  for (auto b : f.ReversePostOrder()) {
+    if (f.blocks[b].removed)
+      continue;
+    for (;;) {
+      Value t = f.Terminator(b);
+      if (t == kNoValue || f.insts[t].op != Opcode::br)
+        break;
+      BlockId s = f.insts[t].targets[0];
+      if (s == b || s == 0 || f.blocks[s].preds.size() != 1)
+        break;
+
+      f.Remove(t);
+      for (auto v : f.blocks[s].insts) {
+        Inst & inst = f.insts[v];
+        if (inst.op == Opcode::phi) {
+          map[v] = inst.operands[0];
+          inst.block = kNoBlock;
+          inst.operands.clear();
+        } else {
+          inst.block = b;
+          f.blocks[b].insts.push_back(v);
+        }
+      }
+      for (auto x : f.Successors(b))
+        std::replace(f.blocks[x].preds.begin(), f.blocks[x].preds.end(), s, b);
+      f.blocks[s].insts.clear();
+      f.blocks[s].preds.clear();
+      f.blocks[s].removed = true;
+      changed = true;
+    }
+  }
+
+  f.Rewrite(map);
+  return changed;
+}
+
+class DCEPass : public FunctionPass {
+ public:
+  const char * Name() const {
+    return "dce";
+  }
+
+  bool Run(Module & m) {
+    callees = m.CalleeEffects();
+    return FunctionPass::Run(m);
+  }
+
+  bool RunOnFunction(Module &, Function & f) {
+    if (f.blocks.empty())
+      return false;
+
+    bool changed = f.RemoveUnreachableBlocks();
+
+    // Branches whose targets are equal are plain jumps.
+    for (BlockId b = 0 ; b < f.blocks.size() ; ++b) {
+      Value t = f.Terminator(b);
+      if (t == kNoValue || f.insts[t].op != Opcode::cond_br || f.insts[t].targets[0] != f.insts[t].targets[1])
+        continue;
+      f.RemoveEdge(b, f.insts[t].targets[1]);
+      f.insts[t].op = Opcode::br;
+      f.insts[t].operands.clear();
+      f.insts[t].targets.pop_back();
+      changed = true;
+    }
+    changed |= MergeBlocks(f);
+
+    std::vector<bool> live(f.insts.size(), false);
+    std::vector<Value> work;
+    for (Value v = 0 ; v < f.insts.size() ; ++v) {
+      if (f.insts[v].block != kNoBlock && HasSideEffects(f, f.insts[v], callees)) {
+        live[v] = true;
+        work.push_back(v);
+      }
+    }
+    while (! work.empty()) {
+      Value v = work.back();
+      work.pop_back();
+      for (auto o : f.insts[v].operands) {
+        if (! live[o]) {
+          live[o] = true;
+          work.push_back(o);
+        }
+      }
+    }
+
+    for (auto & block : f.blocks) {
+      auto & list = block.insts;
+      for (auto v : list) {
+        if (! live[v]) {
+          f.insts[v].block = kNoBlock;
+          f.insts[v].operands.clear();
+          changed = true;
+        }
+      }
+      list.erase(std::remove_if(list.begin(), list.end(), [&](Value v) { return ! live[v]; }), list.end());
+    }
+    return changed;
+  }
+
+ private:
+  std::vector<const Effects *> callees;
+};
+
+}
+
+std::unique_ptr<Pass> CreateDCEPass() {
+  return std::unique_ptr<Pass>(new DCEPass);
+}
+
+}
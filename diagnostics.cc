@@ -0,0 +1,48 @@
+#include "diagnostics.hh"
+
+namespace diag {
+
+namespace {
+
+struct Description {
+  const char * name;
+  const char * text;
+};
+
+// In the order of Kind.
+const Description kDescriptions[] = {
+  {"AlreadyDeclared", "already declared"},
+  {"ExpectedIdentifier", "expected an identifier"},
+  {"ExpectedType", "expected a type"},
+  {"ExpectedOp", "expected an operator"},
+  {"UndefinedVariable", "undefined variable"},
+  {"UndefinedFunction", "undefined function"},
+  {"NotAFunction", "not a function"},
+  {"BadArgumentCount", "wrong number of arguments to"},
+  {"BadArgumentType", "wrong argument type in call to"},
+  {"BadReturnType", "wrong return type in"},
+  {"BadAssignExpType", "wrong type assigned to"},
+  {"BadAssignIncDecType", "increment or decrement of non-numeric"},
+  {"IncompatibleBinaryExpArguments", "incompatible operands"},
+  {"IncompatibleUnaryExpArgument", "incompatible operand"},
+  {"NoReturn", "missing return in"},
+  {"NotAnArray", "not an array"},
+  {"BadIndexType", "array index is not an int"},
+  {"BadArrayLength", "array length is not an int"},
+  {"BadElementType", "arrays only hold int, double or boolean"},
+};
+
+}
+
+const char * Name(Kind kind) {
+  return kDescriptions[static_cast<int>(kind)].name;
+}
+
+std::string Format(const Record & record) {
+  std::string s = " at line " + std::to_string(record.line) + ": " + kDescriptions[static_cast<int>(record.kind)].text;
+  if (! record.subject.empty())
+    s += " " + record.subject;
+  return s;
+}
+
+}
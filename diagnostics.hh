@@ -0,0 +1,74 @@
+#ifndef JLC_DIAGNOSTICS_HH_
+#define JLC_DIAGNOSTICS_HH_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Errors found by the checker. They are recorded as a kind, a line and the
+// name concerned, and only turned into text when reported. The checker
+// carries on after an error, so one run finds all of them; expressions in
+// error get basic_type::error_, which later checks let through so that one
+// mistake is reported once.
+namespace diag {
+
+enum class Kind : uint8_t {
+  already_declared,
+  expected_identifier,
+  expected_type,
+  expected_op,
+  undefined_variable,
+  undefined_function,
+  not_a_function,
+  bad_argument_count,
+  bad_argument_type,
+  bad_return_type,
+  bad_assign_exp_type,
+  bad_assign_inc_dec_type,
+  incompatible_binary_exp_arguments,
+  incompatible_unary_exp_argument,
+  no_return,
+  not_an_array,
+  bad_index_type,
+  bad_array_length,
+  bad_element_type,
+};
+
+struct Record {
+  Kind kind;
+  int line;
+  // The variable or function concerned, if any.
+  std::string subject;
+};
+
+// Name of the kind of error, e.g. "UndefinedVariable".
+const char * Name(Kind kind);
+
+// Description of the error, e.g. " at line 3: undefined variable x".
+std::string Format(const Record & record);
+
+class Sink {
+ public:
+  void Report(Kind kind, int line, const std::string & subject = std::string()) {
+    records.push_back(Record{kind, line, subject});
+  }
+
+  bool Empty() const {
+    return records.empty();
+  }
+
+  size_t Count() const {
+    return records.size();
+  }
+
+  const std::vector<Record> & Records() const {
+    return records;
+  }
+
+ private:
+  std::vector<Record> records;
+};
+
+}
+
+#endif // JLC_DIAGNOSTICS_HH_
@@ -0,0 +1,265 @@
+#include "dwarf.hh"
+
+namespace dwarf {
+
+namespace {
+
+// Constants from the DWARF 4 standard.
+const uint8_t DW_TAG_compile_unit = 0x11;
+const uint8_t DW_TAG_subprogram = 0x2e;
+const uint8_t DW_CHILDREN_no = 0;
+const uint8_t DW_CHILDREN_yes = 1;
+const uint8_t DW_AT_name = 0x03;
+const uint8_t DW_AT_stmt_list = 0x10;
+const uint8_t DW_AT_low_pc = 0x11;
+const uint8_t DW_AT_high_pc = 0x12;
+const uint8_t DW_AT_language = 0x13;
+const uint8_t DW_AT_producer = 0x25;
+const uint8_t DW_AT_decl_file = 0x3a;
+const uint8_t DW_AT_decl_line = 0x3b;
+const uint8_t DW_AT_external = 0x3f;
+const uint8_t DW_FORM_addr = 0x01;
+const uint8_t DW_FORM_data2 = 0x05;
+const uint8_t DW_FORM_data8 = 0x07;
+const uint8_t DW_FORM_string = 0x08;
+const uint8_t DW_FORM_data1 = 0x0b;
+const uint8_t DW_FORM_udata = 0x0f;
+const uint8_t DW_FORM_sec_offset = 0x17;
+const uint8_t DW_FORM_flag_present = 0x19;
+// There is no code for Javalette; C is the closest.
+const uint16_t DW_LANG_C99 = 0x0c;
+const uint8_t DW_LNS_copy = 0x01;
+const uint8_t DW_LNS_advance_pc = 0x02;
+const uint8_t DW_LNS_advance_line = 0x03;
+const uint8_t DW_LNE_end_sequence = 0x01;
+const uint8_t DW_LNE_set_address = 0x02;
+
+const uint16_t kVersion = 4;
+
+// Line program parameters, as chosen by most compilers.
+const int kLineBase = -5;
+const int kLineRange = 14;
+const int kOpcodeBase = 13;
+const uint8_t kStandardOpcodeLengths[kOpcodeBase - 1] = {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+
+enum Abbrev : uint8_t {
+  kCompileUnit = 1,
+  kSubprogram = 2,
+  // A subprogram without DW_AT_external.
+  kLocalSubprogram = 3,
+};
+
+class Writer {
+ public:
+  explicit Writer(std::vector<uint8_t> & o) : out(o) {}
+
+  void U8(uint8_t v) {
+    out.push_back(v);
+  }
+
+  void U16(uint16_t v) {
+    Bytes(&v, 2);
+  }
+
+  void U32(uint32_t v) {
+    Bytes(&v, 4);
+  }
+
+  void U64(uint64_t v) {
+    Bytes(&v, 8);
+  }
+
+  void Uleb(uint64_t v) {
+    do {
+      uint8_t b = v & 0x7F;
+      v >>= 7;
+      U8(v ? b | 0x80 : b);
+    } while (v);
+  }
+
+  void Sleb(int64_t v) {
+    for (;;) {
+      uint8_t b = v & 0x7F;
+      v >>= 7;
+      if ((v == 0 && ! (b & 0x40)) || (v == -1 && (b & 0x40))) {
+        U8(b);
+        return;
+      }
+      U8(b | 0x80);
+    }
+  }
+
+  void String(const std::string & s) {
+    out.insert(out.end(), s.begin(), s.end());
+    U8(0);
+  }
+
+  // Starts a length-prefixed unit; returns what Finish needs.
+  size_t Begin() {
+    U32(0);
+    return out.size();
+  }
+
+  void Finish(size_t begin) {
+    uint32_t length = out.size() - begin;
+    for (int i = 0 ; i < 4 ; ++i)
+      out[begin - 4 + i] = length >> (8 * i);
+  }
+
+ private:
+  void Bytes(const void * p, size_t n) {
+    auto b = static_cast<const uint8_t *>(p);
+    out.insert(out.end(), b, b + n);
+  }
+
+  std::vector<uint8_t> & out;
+};
+
+void Abbreviations(std::vector<uint8_t> & out) {
+  Writer w(out);
+  w.Uleb(kCompileUnit);
+  w.Uleb(DW_TAG_compile_unit);
+  w.U8(DW_CHILDREN_yes);
+  for (auto a : {DW_AT_producer, DW_FORM_string, DW_AT_language, DW_FORM_data2, DW_AT_name, DW_FORM_string,
+                 DW_AT_stmt_list, DW_FORM_sec_offset, DW_AT_low_pc, DW_FORM_addr, DW_AT_high_pc, DW_FORM_data8})
+    w.Uleb(a);
+  w.Uleb(0);
+  w.Uleb(0);
+
+  w.Uleb(kSubprogram);
+  w.Uleb(DW_TAG_subprogram);
+  w.U8(DW_CHILDREN_no);
+  for (auto a : {DW_AT_name, DW_FORM_string, DW_AT_decl_file, DW_FORM_data1, DW_AT_decl_line, DW_FORM_udata,
+                 DW_AT_external, DW_FORM_flag_present, DW_AT_low_pc, DW_FORM_addr, DW_AT_high_pc, DW_FORM_data8})
+    w.Uleb(a);
+  w.Uleb(0);
+  w.Uleb(0);
+
+  w.Uleb(kLocalSubprogram);
+  w.Uleb(DW_TAG_subprogram);
+  w.U8(DW_CHILDREN_no);
+  for (auto a : {DW_AT_name, DW_FORM_string, DW_AT_decl_file, DW_FORM_data1, DW_AT_decl_line, DW_FORM_udata,
+                 DW_AT_low_pc, DW_FORM_addr, DW_AT_high_pc, DW_FORM_data8})
+    w.Uleb(a);
+  w.Uleb(0);
+  w.Uleb(0);
+
+  w.Uleb(0);
+}
+
+// Address of offset in .text, relocated.
+void Address(elf::ObjectWriter & object, std::vector<uint8_t> & out, elf::Section s, uint64_t offset) {
+  object.AddRelocation(out.size(), object.SectionSymbol(elf::text), elf::R_X86_64_64, offset, s);
+  Writer(out).U64(0);
+}
+
+// Offset 0 of section target, relocated.
+void SectionOffset(elf::ObjectWriter & object, std::vector<uint8_t> & out, elf::Section s, elf::Section target) {
+  object.AddRelocation(out.size(), object.SectionSymbol(target), elf::R_X86_64_32, 0, s);
+  Writer(out).U32(0);
+}
+
+void Info(elf::ObjectWriter & object, const std::string & file, const std::vector<Subprogram> & functions,
+    uint64_t text_size) {
+  auto & out = object.debug_info;
+  Writer w(out);
+  const size_t unit = w.Begin();
+  w.U16(kVersion);
+  SectionOffset(object, out, elf::debug_info, elf::debug_abbrev);
+  w.U8(8);
+
+  w.Uleb(kCompileUnit);
+  w.String("jlc");
+  w.U16(DW_LANG_C99);
+  w.String(file);
+  SectionOffset(object, out, elf::debug_info, elf::debug_line);
+  Address(object, out, elf::debug_info, 0);
+  w.U64(text_size);
+
+  for (auto & f : functions) {
+    w.Uleb(f.local ? kLocalSubprogram : kSubprogram);
+    w.String(f.name);
+    w.U8(1);
+    w.Uleb(f.line);
+    Address(object, out, elf::debug_info, f.begin);
+    w.U64(f.end - f.begin);
+  }
+  w.U8(0);
+  w.Finish(unit);
+}
+
+void Lines(elf::ObjectWriter & object, const std::string & file, const std::vector<Row> & rows, uint64_t text_size) {
+  auto & out = object.debug_line;
+  Writer w(out);
+  const size_t unit = w.Begin();
+  w.U16(kVersion);
+  const size_t header = w.Begin();
+  w.U8(1); // minimum_instruction_length
+  w.U8(1); // maximum_operations_per_instruction
+  w.U8(1); // default_is_stmt
+  w.U8(static_cast<uint8_t>(kLineBase));
+  w.U8(kLineRange);
+  w.U8(kOpcodeBase);
+  for (auto l : kStandardOpcodeLengths)
+    w.U8(l);
+  w.U8(0); // no include_directories
+  w.String(file);
+  w.Uleb(0); // directory
+  w.Uleb(0); // modification time
+  w.Uleb(0); // length
+  w.U8(0);
+  w.Finish(header);
+
+  w.U8(0);
+  w.Uleb(9);
+  w.U8(DW_LNE_set_address);
+  Address(object, out, elf::debug_line, 0);
+
+  uint64_t address = 0;
+  int64_t line = 1;
+  for (auto & r : rows) {
+    const uint64_t address_delta = r.address - address;
+    const int64_t line_delta = r.line - line;
+    if (line_delta < kLineBase || line_delta >= kLineBase + kLineRange) {
+      w.U8(DW_LNS_advance_line);
+      w.Sleb(line_delta);
+      line = r.line;
+    }
+    const uint64_t special = (r.line - line - kLineBase) + kLineRange * address_delta + kOpcodeBase;
+    if (special <= 255) {
+      w.U8(special);
+    } else {
+      if (address_delta) {
+        w.U8(DW_LNS_advance_pc);
+        w.Uleb(address_delta);
+      }
+      if (r.line != line) {
+        w.U8(DW_LNS_advance_line);
+        w.Sleb(r.line - line);
+      }
+      w.U8(DW_LNS_copy);
+    }
+    address = r.address;
+    line = r.line;
+  }
+
+  if (text_size > address) {
+    w.U8(DW_LNS_advance_pc);
+    w.Uleb(text_size - address);
+  }
+  w.U8(0);
+  w.Uleb(1);
+  w.U8(DW_LNE_end_sequence);
+  w.Finish(unit);
+}
+
+}
+
+void Emit(elf::ObjectWriter & object, const std::string & file, const std::vector<Subprogram> & functions,
+    const std::vector<Row> & rows, uint64_t text_size) {
+  Abbreviations(object.debug_abbrev);
+  Info(object, file, functions, text_size);
+  Lines(object, file, rows, text_size);
+}
+
+}
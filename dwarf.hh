@@ -0,0 +1,37 @@
+#ifndef JLC_DWARF_HH_
+#define JLC_DWARF_HH_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "elf.hh"
+
+// DWARF 4 debugging information for generated code: a compile unit with
+// one subprogram per function and a line table, enough for debuggers and
+// sampling profilers to map addresses to functions and source lines.
+namespace dwarf {
+
+// Code from address on, up to the next row, comes from line.
+struct Row {
+  uint64_t address;
+  int line;
+};
+
+struct Subprogram {
+  std::string name;
+  int line;
+  uint64_t begin;
+  uint64_t end;
+  // Not visible outside the object, like the cold part of a function.
+  bool local;
+};
+
+// Fills the debug sections of object. Addresses are offsets into .text,
+// rows are in increasing address order and text_size ends the last one.
+void Emit(elf::ObjectWriter & object, const std::string & file, const std::vector<Subprogram> & functions,
+    const std::vector<Row> & rows, uint64_t text_size);
+
+}
+
+#endif // JLC_DWARF_HH_
@@ -0,0 +1,125 @@
+#include "passes.hh"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace ir {
+
+namespace {
+
+bool MayTrap(const Function & f, const Inst & inst) {
+  if (inst.op == Opcode::unreachable || inst.op == Opcode::check)
+    return true;
+  if ((inst.op != Opcode::div && inst.op != Opcode::mod) || inst.type == basic_type::double_)
+    return false;
+  const Inst & d = f.insts[inst.operands[1]];
+  return d.op != Opcode::const_int || d.imm == 0 || d.imm == -1;
+}
+
+// Effects of f's own instructions, taking calls into its component as
+// readnone; the recursion itself is dealt with by the caller.
+// callees[s] is the index of the function string s names, or -1.
+Effects Summarize(const Module & m, const Function & f, const std::vector<int> & callees,
+    const std::vector<bool> & in_component) {
+  Effects effects;
+  effects.readnone = effects.speculatable = true;
+  for (auto b : f.ReversePostOrder()) {
+    for (auto v : f.blocks[b].insts) {
+      const Inst & inst = f.insts[v];
+      if (inst.op == Opcode::call) {
+        const std::string & name = m.strings[inst.imm];
+        const int callee = callees[inst.imm];
+        const Effects * e = callee < 0 ? 0 : &m.functions[callee].effects;
+        if (e && in_component[callee]) {
+          continue;
+        } else if (! e || ! e->readnone) {
+          effects.readnone = effects.speculatable = false;
+          effects.reason = "calls " + name;
+          return effects;
+        } else if (! e->speculatable && effects.speculatable) {
+          effects.speculatable = false;
+          effects.reason = "calls " + name + ", which may not return";
+        }
+      } else if (inst.op == Opcode::new_array || inst.op == Opcode::load || inst.op == Opcode::store) {
+        // Each new array is another one, and elements change.
+        effects.readnone = effects.speculatable = false;
+        effects.reason = inst.op == Opcode::new_array ? "allocates an array" :
+          inst.op == Opcode::load ? "reads an array" : "writes an array";
+        return effects;
+      } else if (MayTrap(f, inst) && effects.speculatable) {
+        effects.speculatable = false;
+        effects.reason = "may trap";
+      }
+    }
+  }
+  if (effects.speculatable && ! FindLoops(f, f.Dominators()).empty()) {
+    effects.speculatable = false;
+    effects.reason = "has a loop";
+  }
+  return effects;
+}
+
+class EffectsPass : public Pass {
+ public:
+  const char * Name() const {
+    return "effects";
+  }
+
+  // Bottom-up over the call graph, so callees outside a function's own
+  // component are done first. The functions of a component reach each
+  // other, so they share side effects, and they may recurse forever.
+  bool Run(Module & m) {
+    if (m.functions.empty())
+      return false;
+    CallGraph graph(m);
+    std::unordered_map<std::string, int> index;
+    for (size_t i = 0 ; i < m.functions.size() ; ++i)
+      index[m.functions[i].name] = i;
+    std::vector<int> callees(m.strings.size(), -1);
+    for (size_t s = 0 ; s < m.strings.size() ; ++s) {
+      auto i = index.find(m.strings[s]);
+      if (i != index.end())
+        callees[s] = i->second;
+    }
+    std::vector<bool> in_component(m.functions.size(), false);
+    for (auto & component : graph.components) {
+      for (auto i : component)
+        in_component[i] = true;
+      const int first = component[0];
+      const bool recursive = component.size() > 1 ||
+        std::binary_search(graph.callees[first].begin(), graph.callees[first].end(), first);
+
+      std::vector<Effects> effects;
+      const Function * impure = 0;
+      for (auto i : component) {
+        effects.push_back(Summarize(m, m.functions[i], callees, in_component));
+        if (! effects.back().readnone && ! impure)
+          impure = &m.functions[i];
+      }
+      for (size_t j = 0 ; j < component.size() ; ++j) {
+        Effects & e = effects[j];
+        if (impure && e.readnone) {
+          e.readnone = e.speculatable = false;
+          e.reason = "calls " + impure->name;
+        } else if (recursive && e.speculatable) {
+          e.speculatable = false;
+          e.reason = "is recursive";
+        }
+        m.functions[component[j]].effects = e;
+      }
+
+      for (auto i : component)
+        in_component[i] = false;
+    }
+    // Only annotations changed, not the code.
+    return false;
+  }
+};
+
+}
+
+std::unique_ptr<Pass> CreateEffectsPass() {
+  return std::unique_ptr<Pass>(new EffectsPass);
+}
+
+}
@@ -0,0 +1,218 @@
+#include "elf.hh"
+
+#include <elf.h>
+
+#include <cstring>
+
+namespace elf {
+
+namespace {
+
+// Symbols 1 to 6 are the section symbols of the sections in Section; the
+// symbols added to the writer follow.
+const uint32_t kFirstSymbol = 7;
+
+enum SectionIndex {
+  kNull,
+  kText,
+  kRodata,
+  kData,
+  kDebugAbbrev,
+  kDebugInfo,
+  kDebugLine,
+  kRelaText,
+  kRelaDebugInfo,
+  kRelaDebugLine,
+  kSymtab,
+  kStrtab,
+  kShstrtab,
+  kNoteStack,
+  kSections,
+};
+
+class StringTable {
+ public:
+  StringTable() : data(1, '\0') {}
+
+  uint32_t Add(const std::string & s) {
+    uint32_t offset = data.size();
+    data.append(s);
+    data.push_back('\0');
+    return offset;
+  }
+
+  std::string data;
+};
+
+void Align(std::string & out, size_t alignment) {
+  out.resize((out.size() + alignment - 1) / alignment * alignment, '\0');
+}
+
+template <class T>
+void Append(std::string & out, const T & v) {
+  out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+}
+
+uint32_t ObjectWriter::AddSymbol(const std::string & name, Section section, uint64_t value, uint64_t size, bool function,
+    bool local) {
+  symbols.push_back(Symbol{name, section, value, size, function, local});
+  const uint32_t i = kFirstSymbol + symbols.size() - 1;
+  if (! local)
+    index[name] = i;
+  return i;
+}
+
+uint32_t ObjectWriter::External(const std::string & name) {
+  auto i = index.find(name);
+  if (i != index.end())
+    return i->second;
+  return AddSymbol(name, undefined, 0, 0, false);
+}
+
+void ObjectWriter::AddRelocation(uint64_t offset, uint32_t symbol, uint32_t type, int64_t addend, Section s) {
+  relocations.push_back(Relocation{s, offset, symbol, type, addend});
+}
+
+std::string ObjectWriter::Write() const {
+  std::string out(sizeof(Elf64_Ehdr), '\0');
+  Elf64_Shdr sections[kSections];
+  std::memset(sections, 0, sizeof(sections));
+
+  StringTable shstrtab;
+  StringTable strtab;
+
+  // ELF wants the local symbols before the global ones, so symbols are
+  // written in that order and relocations renumbered to match.
+  std::vector<uint32_t> order;
+  for (uint32_t i = 0 ; i < symbols.size() ; ++i)
+    if (symbols[i].local)
+      order.push_back(i);
+  const uint32_t first_global = kFirstSymbol + order.size();
+  for (uint32_t i = 0 ; i < symbols.size() ; ++i)
+    if (! symbols[i].local)
+      order.push_back(i);
+  std::vector<uint32_t> renumbered(kFirstSymbol + symbols.size());
+  for (uint32_t i = 0 ; i < kFirstSymbol ; ++i)
+    renumbered[i] = i;
+  for (uint32_t i = 0 ; i < order.size() ; ++i)
+    renumbered[kFirstSymbol + order[i]] = kFirstSymbol + i;
+
+  auto section = [&](SectionIndex i, const char * name, uint32_t type, uint64_t flags, size_t alignment) {
+    Align(out, alignment);
+    sections[i].sh_name = shstrtab.Add(name);
+    sections[i].sh_type = type;
+    sections[i].sh_flags = flags;
+    sections[i].sh_offset = out.size();
+    sections[i].sh_addralign = alignment;
+  };
+  auto end = [&](SectionIndex i) {
+    sections[i].sh_size = out.size() - sections[i].sh_offset;
+  };
+
+  section(kText, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 16);
+  out.append(text.begin(), text.end());
+  end(kText);
+
+  section(kRodata, ".rodata", SHT_PROGBITS, SHF_ALLOC, 16);
+  out.append(rodata.begin(), rodata.end());
+  end(kRodata);
+
+  section(kData, ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 16);
+  out.append(data.begin(), data.end());
+  end(kData);
+
+  section(kDebugAbbrev, ".debug_abbrev", SHT_PROGBITS, 0, 1);
+  out.append(debug_abbrev.begin(), debug_abbrev.end());
+  end(kDebugAbbrev);
+
+  section(kDebugInfo, ".debug_info", SHT_PROGBITS, 0, 1);
+  out.append(debug_info.begin(), debug_info.end());
+  end(kDebugInfo);
+
+  section(kDebugLine, ".debug_line", SHT_PROGBITS, 0, 1);
+  out.append(debug_line.begin(), debug_line.end());
+  end(kDebugLine);
+
+  auto rela = [&](SectionIndex i, const char * name, Section target) {
+    section(i, name, SHT_RELA, SHF_INFO_LINK, 8);
+    for (auto & r : relocations) {
+      if (r.section != target)
+        continue;
+      Elf64_Rela rela;
+      rela.r_offset = r.offset;
+      rela.r_info = ELF64_R_INFO(renumbered[r.symbol], r.type);
+      rela.r_addend = r.addend;
+      Append(out, rela);
+    }
+    end(i);
+    sections[i].sh_link = kSymtab;
+    sections[i].sh_info = target;
+    sections[i].sh_entsize = sizeof(Elf64_Rela);
+  };
+  rela(kRelaText, ".rela.text", Section::text);
+  rela(kRelaDebugInfo, ".rela.debug_info", Section::debug_info);
+  rela(kRelaDebugLine, ".rela.debug_line", Section::debug_line);
+
+  section(kSymtab, ".symtab", SHT_SYMTAB, 0, 8);
+  Elf64_Sym sym;
+  std::memset(&sym, 0, sizeof(sym));
+  Append(out, sym);
+  for (uint16_t s : {kText, kRodata, kData, kDebugAbbrev, kDebugInfo, kDebugLine}) {
+    sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    sym.st_shndx = s;
+    Append(out, sym);
+  }
+  for (auto i : order) {
+    const Symbol & s = symbols[i];
+    std::memset(&sym, 0, sizeof(sym));
+    sym.st_name = strtab.Add(s.name);
+    sym.st_info = ELF64_ST_INFO(s.local ? STB_LOCAL : STB_GLOBAL, s.function ? STT_FUNC : STT_NOTYPE);
+    sym.st_shndx = s.section;
+    sym.st_value = s.value;
+    sym.st_size = s.size;
+    Append(out, sym);
+  }
+  end(kSymtab);
+  sections[kSymtab].sh_link = kStrtab;
+  sections[kSymtab].sh_info = first_global;
+  sections[kSymtab].sh_entsize = sizeof(Elf64_Sym);
+
+  section(kStrtab, ".strtab", SHT_STRTAB, 0, 1);
+  out.append(strtab.data);
+  end(kStrtab);
+
+  // The stack does not need to be executable.
+  section(kNoteStack, ".note.GNU-stack", SHT_PROGBITS, 0, 1);
+  end(kNoteStack);
+
+  section(kShstrtab, ".shstrtab", SHT_STRTAB, 0, 1);
+  out.append(shstrtab.data);
+  end(kShstrtab);
+
+  Align(out, 8);
+  const size_t shoff = out.size();
+  out.append(reinterpret_cast<const char *>(sections), sizeof(sections));
+
+  Elf64_Ehdr header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = ELFCLASS64;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  header.e_type = ET_REL;
+  header.e_machine = EM_X86_64;
+  header.e_version = EV_CURRENT;
+  header.e_shoff = shoff;
+  header.e_ehsize = sizeof(Elf64_Ehdr);
+  header.e_shentsize = sizeof(Elf64_Shdr);
+  header.e_shnum = kSections;
+  header.e_shstrndx = kShstrtab;
+  std::memcpy(&out[0], &header, sizeof(header));
+
+  return out;
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef JLC_ELF_HH_
+#define JLC_ELF_HH_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Writer for x86-64 ELF relocatable objects with a .text, a .rodata and a
+// .data section, and DWARF debugging information.
+namespace elf {
+
+// Also the indices of the section headers.
+enum Section : uint16_t {
+  undefined = 0,
+  text = 1,
+  rodata = 2,
+  data = 3,
+  debug_abbrev = 4,
+  debug_info = 5,
+  debug_line = 6,
+};
+
+// Relocation types, see the System V x86-64 psABI.
+const uint32_t R_X86_64_64 = 1;
+const uint32_t R_X86_64_PC32 = 2;
+const uint32_t R_X86_64_PLT32 = 4;
+const uint32_t R_X86_64_32 = 10;
+
+class ObjectWriter {
+ public:
+  std::vector<uint8_t> text;
+  std::vector<uint8_t> rodata;
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> debug_abbrev;
+  std::vector<uint8_t> debug_info;
+  std::vector<uint8_t> debug_line;
+
+  // Returns the symbol index. Undefined symbols use Section::undefined.
+  // Local symbols are only seen by the object itself; External does not
+  // find them.
+  uint32_t AddSymbol(const std::string & name, Section section, uint64_t value, uint64_t size, bool function,
+      bool local = false);
+  // Symbol index of an undefined symbol, added on first use.
+  uint32_t External(const std::string & name);
+  // Local symbol standing for the start of section s.
+  uint32_t SectionSymbol(Section s) const {
+    return s;
+  }
+
+  // Relocates the field at offset in section s.
+  void AddRelocation(uint64_t offset, uint32_t symbol, uint32_t type, int64_t addend, Section s = Section::text);
+
+  // The complete object file.
+  std::string Write() const;
+
+ private:
+  struct Symbol {
+    std::string name;
+    Section section;
+    uint64_t value;
+    uint64_t size;
+    bool function;
+    bool local;
+  };
+
+  struct Relocation {
+    Section section;
+    uint64_t offset;
+    uint32_t symbol;
+    uint32_t type;
+    int64_t addend;
+  };
+
+  std::vector<Symbol> symbols; // after the null and section symbols
+  std::vector<Relocation> relocations;
+  std::map<std::string, uint32_t> index;
+};
+
+}
+
+#endif // JLC_ELF_HH_
@@ -3,11 +3,6 @@
 
 #include <string>
 #include <exception>
-#include <sstream>
-
-#include <boost/spirit/include/support_utree.hpp>
-
-using boost::spirit::utree;
 
 class Exception : public std::exception {
  private:
@@ -31,94 +26,22 @@ struct CompilerError : Exception {
   CompilerError() : Exception(" Internal error") {}
 };
 
-struct CompilationError : Exception {
-  template <class Tags>
-  CompilationError(utree & u, Tags & t);
-};
-
-template <class Tags>
-CompilationError::CompilationError(utree & u, Tags & t) :
-  Exception("")
-{
-  std::ostringstream ss;
-  ss << " at line " << t[u].line_pos << ": " << u << "\n";
-  _msg = ss.str();
-}
-
-struct AlreadyDeclared : CompilationError {
-  template <class Tags>
-  AlreadyDeclared(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct ExpectedIdentifier : CompilationError {
-  template <class Tags>
-  ExpectedIdentifier(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct ExpectedType : CompilationError {
-  template <class Tags>
-  ExpectedType(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct ExpectedOp : CompilationError {
-  template <class Tags>
-  ExpectedOp(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct UndefinedVariable : CompilationError {
-  template <class Tags>
-  UndefinedVariable(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct UndefinedFunction : CompilationError {
-  template <class Tags>
-  UndefinedFunction(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct NotAFunction : CompilationError {
-  template <class Tags>
-  NotAFunction(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct BadArgumentCount : CompilationError {
-  template <class Tags>
-  BadArgumentCount(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct BadArgumentType : CompilationError {
-  template <class Tags>
-  BadArgumentType(utree & u, Tags & t) : CompilationError(u, t) { }
+struct UnknownPass : Exception {
+  UnknownPass(const std::string & name) : Exception(": " + name) {}
 };
 
-struct BadReturnType : CompilationError {
-  template <class Tags>
-  BadReturnType(utree & u, Tags & t) : CompilationError(u, t) { }
+struct BadProfile : Exception {
+  BadProfile(const std::string & path) : Exception(": " + path) {}
 };
 
-struct BadAssignExpType : CompilationError {
-  template <class Tags>
-  BadAssignExpType(utree & u, Tags & t) : CompilationError(u, t) { }
+struct BadInterface : Exception {
+  BadInterface(const std::string & path) : Exception(": " + path) {}
 };
 
-struct BadAssignIncDecType : CompilationError {
-  template <class Tags>
-  BadAssignIncDecType(utree & u, Tags & t) : CompilationError(u, t) { }
+// Two imported interfaces, or an interface and a built-in, declare the
+// same function with different signatures.
+struct ConflictingImport : Exception {
+  ConflictingImport(const std::string & name) : Exception(": " + name) {}
 };
 
-struct IncompatibleBinaryExpArguments : CompilationError {
-  template <class Tags>
-  IncompatibleBinaryExpArguments(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct IncompatibleUnaryExpArgument : CompilationError {
-  template <class Tags>
-  IncompatibleUnaryExpArgument(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-struct NoReturn : CompilationError {
-  template <class Tags>
-  NoReturn(utree & u, Tags & t) : CompilationError(u, t) { }
-};
-
-
 #endif // JLC_EXCEPTION_HH_
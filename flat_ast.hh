@@ -0,0 +1,415 @@
+#ifndef JLC_FLAT_AST_HH_
+#define JLC_FLAT_AST_HH_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hh"
+#include "exception.hh"
+#include "operators.hh"
+#include "types.hh"
+
+typedef uint32_t NodeId;
+
+const NodeId kNoNode = ~NodeId(0);
+
+enum class NodeKind : uint8_t {
+  fun_def,            // children: body
+  inst_block,         // children: instructions
+  inst_if,            // children: test, if, else or kNoNode
+  inst_while,         // children: test, body
+  inst_for,           // children: pre, test, post, body
+  inst_return,        // children: exp or kNoNode
+  inst_assign_exp,    // data: variable; children: exp
+  inst_assign_incdec, // data: variable; op: inc_ or dec_
+  inst_assign_index,  // data: variable (the array); children: index, exp
+  inst_decl,          // children: decl_var nodes
+  decl_var,           // data: variable; children: init or kNoNode
+  inst_exp,           // children: exp
+  lit_int,            // data: index into ints
+  lit_double,         // data: index into doubles
+  lit_bool,           // data: value
+  lit_string,         // data: index into strings
+  var_ref,            // data: variable
+  fun_call,           // data: index into strings (name); children: arguments
+  unary,              // op; children: exp
+  binary,             // op; children: lhs, rhs
+  array_index,        // children: array, index
+  array_length,       // children: array
+  new_array,          // children: length
+};
+
+// Structure-of-arrays form of the checked AST. Per-node fields live in
+// parallel arrays indexed by NodeId and each node's children are a
+// contiguous range of the children array. Nodes are appended in post-order,
+// so children always have smaller ids than their parent and a bottom-up
+// pass is a single forward sweep.
+//
+// Variables are the per-function indices assigned by the Compiler.
+class FlatAST {
+ public:
+  std::vector<NodeKind> kind;
+  std::vector<Type> type;
+  std::vector<Op> op;
+  // Source lines rather than byte offsets: the tags of the parser only
+  // record lines, and diagnostics, the line table, the IR and profile
+  // keys all want them.
+  std::vector<int> line_pos;
+  std::vector<uint32_t> data;
+  std::vector<uint32_t> child_begin;
+  std::vector<uint32_t> child_count;
+
+  std::vector<NodeId> children;
+  std::vector<int> ints;
+  std::vector<double> doubles;
+  std::vector<std::string> strings;
+
+  // Function definitions in the order they were added, with their argument
+  // types (arguments are variables 0..n-1) and variable counts.
+  std::vector<NodeId> functions;
+  std::vector<std::vector<Type>> function_args;
+  std::vector<int> function_vars;
+
+  size_t size() const {
+    return kind.size();
+  }
+
+  NodeId Child(NodeId n, uint32_t i) const {
+    return children[child_begin[n] + i];
+  }
+
+  const NodeId * ChildrenBegin(NodeId n) const {
+    return children.data() + child_begin[n];
+  }
+
+  const NodeId * ChildrenEnd(NodeId n) const {
+    return children.data() + child_begin[n] + child_count[n];
+  }
+
+  // The call of a `return f(...)` statement n, which is in tail position,
+  // or kNoNode.
+  NodeId TailCall(NodeId n) const {
+    NodeId e = Child(n, 0);
+    return e != kNoNode && kind[e] == NodeKind::fun_call ? e : kNoNode;
+  }
+
+  // First node of the i-th function; its nodes end with functions[i].
+  NodeId FunctionBegin(size_t i) const {
+    return i == 0 ? 0 : functions[i - 1] + 1;
+  }
+
+  NodeId Add(NodeKind k, Type t, Op o, int line, uint32_t d, const std::vector<NodeId> & c);
+
+  // Appends a checked function and everything under it.
+  NodeId AddFunction(const FunDef & f);
+
+  // Which functions the one called root reaches through calls, itself
+  // included. All of them if there is no root.
+  std::vector<bool> Reachable(const std::string & root) const;
+  // Drops the functions that keep is false for, renumbering the nodes of
+  // the others, which stay in order.
+  void KeepFunctions(const std::vector<bool> & keep);
+
+  void Clear();
+
+ private:
+  NodeId Add(const Inst * i);
+  NodeId Add(const Exp * e);
+  uint32_t AddString(const std::string & s);
+};
+
+inline NodeId FlatAST::Add(NodeKind k, Type t, Op o, int line, uint32_t d, const std::vector<NodeId> & c) {
+  NodeId n = kind.size();
+  kind.push_back(k);
+  type.push_back(t);
+  op.push_back(o);
+  line_pos.push_back(line);
+  data.push_back(d);
+  child_begin.push_back(children.size());
+  child_count.push_back(c.size());
+  children.insert(children.end(), c.begin(), c.end());
+  return n;
+}
+
+inline uint32_t FlatAST::AddString(const std::string & s) {
+  strings.push_back(s);
+  return strings.size() - 1;
+}
+
+inline NodeId FlatAST::AddFunction(const FunDef & f) {
+  NodeId body = Add(f.body.get());
+  NodeId n = Add(NodeKind::fun_def, f.type, 0, f.line_pos, AddString(f.name), {body});
+  functions.push_back(n);
+  function_args.push_back(f.arg_types);
+  function_vars.push_back(f.vars);
+  return n;
+}
+
+inline NodeId FlatAST::Add(const Inst * i) {
+  if (! i)
+    return kNoNode;
+
+  const int line = i->line_pos;
+
+  if (auto block = dynamic_cast<const InstBlock *>(i)) {
+    std::vector<NodeId> c;
+    for (auto j = block->instructions.begin() ; j != block->instructions.end() ; ++j)
+      c.push_back(Add(j->get()));
+    return Add(NodeKind::inst_block, basic_type::void_, 0, line, 0, c);
+  }
+  if (auto inst = dynamic_cast<const InstIf *>(i)) {
+    std::vector<NodeId> c = {Add(inst->test.get()), Add(inst->if_inst.get()), Add(inst->else_inst.get())};
+    return Add(NodeKind::inst_if, basic_type::void_, 0, line, 0, c);
+  }
+  if (auto inst = dynamic_cast<const InstWhile *>(i)) {
+    std::vector<NodeId> c = {Add(inst->test.get()), Add(inst->body.get())};
+    return Add(NodeKind::inst_while, basic_type::void_, 0, line, 0, c);
+  }
+  if (auto inst = dynamic_cast<const InstFor *>(i)) {
+    std::vector<NodeId> c = {Add(inst->pre_inst.get()), Add(inst->test.get()),
+      Add(inst->post_inst.get()), Add(inst->body.get())};
+    return Add(NodeKind::inst_for, basic_type::void_, 0, line, 0, c);
+  }
+  if (auto inst = dynamic_cast<const InstReturn *>(i)) {
+    Type t = inst->exp ? inst->exp->GetType() : basic_type::void_;
+    return Add(NodeKind::inst_return, t, 0, line, 0, {Add(inst->exp.get())});
+  }
+  if (auto inst = dynamic_cast<const InstAssignExp *>(i))
+    return Add(NodeKind::inst_assign_exp, inst->type, 0, line, inst->var, {Add(inst->exp.get())});
+  if (auto inst = dynamic_cast<const InstAssignIncDec *>(i))
+    return Add(NodeKind::inst_assign_incdec, inst->type, inst->op, line, inst->var, {});
+  if (auto inst = dynamic_cast<const InstAssignIndex *>(i)) {
+    std::vector<NodeId> c = {Add(inst->index.get()), Add(inst->exp.get())};
+    return Add(NodeKind::inst_assign_index, inst->type, 0, line, inst->var, c);
+  }
+  if (auto inst = dynamic_cast<const InstDecl *>(i)) {
+    std::vector<NodeId> c;
+    for (size_t j = 0 ; j < inst->vars.size() ; ++j)
+      c.push_back(Add(NodeKind::decl_var, inst->type, 0, line, inst->vars[j], {Add(inst->inits[j].get())}));
+    return Add(NodeKind::inst_decl, inst->type, 0, line, 0, c);
+  }
+  if (auto inst = dynamic_cast<const InstExp *>(i))
+    return Add(NodeKind::inst_exp, basic_type::void_, 0, line, 0, {Add(inst->exp.get())});
+
+  throw CompilerError();
+}
+
+inline NodeId FlatAST::Add(const Exp * e) {
+  if (! e)
+    return kNoNode;
+
+  const int line = e->line_pos;
+  const Type t = e->GetType();
+
+  if (auto lit = dynamic_cast<const Literal<int> *>(e)) {
+    ints.push_back(lit->Value());
+    return Add(NodeKind::lit_int, t, 0, line, ints.size() - 1, {});
+  }
+  if (auto lit = dynamic_cast<const Literal<double> *>(e)) {
+    doubles.push_back(lit->Value());
+    return Add(NodeKind::lit_double, t, 0, line, doubles.size() - 1, {});
+  }
+  if (auto lit = dynamic_cast<const Literal<bool> *>(e))
+    return Add(NodeKind::lit_bool, t, 0, line, lit->Value(), {});
+  if (auto lit = dynamic_cast<const Literal<std::string> *>(e))
+    return Add(NodeKind::lit_string, t, 0, line, AddString(lit->Value()), {});
+  if (auto var = dynamic_cast<const VarRef *>(e))
+    return Add(NodeKind::var_ref, t, 0, line, var->var, {});
+  if (auto call = dynamic_cast<const FunCall *>(e)) {
+    std::vector<NodeId> c;
+    for (auto j = call->args.begin() ; j != call->args.end() ; ++j)
+      c.push_back(Add(j->get()));
+    return Add(NodeKind::fun_call, t, 0, line, AddString(call->name), c);
+  }
+  if (auto exp = dynamic_cast<const UnaryExp *>(e))
+    return Add(NodeKind::unary, t, exp->op, line, 0, {Add(exp->exp.get())});
+  if (auto exp = dynamic_cast<const BinaryExp *>(e))
+    return Add(NodeKind::binary, t, exp->op, line, 0, {Add(exp->lhs.get()), Add(exp->rhs.get())});
+  if (auto exp = dynamic_cast<const IndexExp *>(e))
+    return Add(NodeKind::array_index, t, 0, line, 0, {Add(exp->array.get()), Add(exp->index.get())});
+  if (auto exp = dynamic_cast<const LengthExp *>(e))
+    return Add(NodeKind::array_length, t, 0, line, 0, {Add(exp->array.get())});
+  if (auto exp = dynamic_cast<const NewArrayExp *>(e))
+    return Add(NodeKind::new_array, t, 0, line, 0, {Add(exp->length.get())});
+
+  throw CompilerError();
+}
+
+inline std::vector<bool> FlatAST::Reachable(const std::string & root) const {
+  std::unordered_map<std::string, size_t> index;
+  for (size_t i = 0 ; i < functions.size() ; ++i)
+    index.insert(std::make_pair(strings[data[functions[i]]], i));
+  auto r = index.find(root);
+  if (r == index.end())
+    return std::vector<bool>(functions.size(), true);
+
+  std::vector<bool> reached(functions.size(), false);
+  std::vector<size_t> work(1, r->second);
+  reached[r->second] = true;
+  while (! work.empty()) {
+    const size_t i = work.back();
+    work.pop_back();
+    for (NodeId n = FunctionBegin(i) ; n < functions[i] ; ++n) {
+      if (kind[n] != NodeKind::fun_call)
+        continue;
+      auto callee = index.find(strings[data[n]]);
+      if (callee != index.end() && ! reached[callee->second]) {
+        reached[callee->second] = true;
+        work.push_back(callee->second);
+      }
+    }
+  }
+  return reached;
+}
+
+inline void FlatAST::KeepFunctions(const std::vector<bool> & keep) {
+  // Nodes and children only move down, so this works in place.
+  NodeId from = 0, to = 0;
+  uint32_t children_to = 0;
+  size_t kept = 0;
+  for (size_t i = 0 ; i < functions.size() ; ++i) {
+    const NodeId begin = from;
+    from = functions[i] + 1;
+    if (! keep[i])
+      continue;
+    const NodeId shift = begin - to;
+    for (NodeId n = begin ; n < from ; ++n, ++to) {
+      kind[to] = kind[n];
+      type[to] = type[n];
+      op[to] = op[n];
+      line_pos[to] = line_pos[n];
+      data[to] = data[n];
+      const uint32_t first = child_begin[n];
+      child_begin[to] = children_to;
+      child_count[to] = child_count[n];
+      for (uint32_t c = 0 ; c < child_count[n] ; ++c) {
+        const NodeId child = children[first + c];
+        children[children_to++] = child == kNoNode ? kNoNode : child - shift;
+      }
+    }
+    functions[kept] = to - 1;
+    function_args[kept].swap(function_args[i]);
+    function_vars[kept] = function_vars[i];
+    ++kept;
+  }
+
+  kind.resize(to);
+  type.resize(to);
+  op.resize(to);
+  line_pos.resize(to);
+  data.resize(to);
+  child_begin.resize(to);
+  child_count.resize(to);
+  children.resize(children_to);
+  functions.resize(kept);
+  function_args.resize(kept);
+  function_vars.resize(kept);
+}
+
+inline void FlatAST::Clear() {
+  kind.clear();
+  type.clear();
+  op.clear();
+  line_pos.clear();
+  data.clear();
+  child_begin.clear();
+  child_count.clear();
+  children.clear();
+  ints.clear();
+  doubles.clear();
+  strings.clear();
+  functions.clear();
+  function_args.clear();
+  function_vars.clear();
+}
+
+// Tail calls a backend compiled into jumps.
+struct TailCallStats {
+  TailCallStats() : self(0), sibling(0) {}
+
+  // Calls of the enclosing function, turned into loops.
+  int self;
+  // Calls of other functions, reusing the caller's frame.
+  int sibling;
+};
+
+// Statically dispatched visitor over a FlatAST. Derived classes override
+// the Visit* members they care about; the defaults visit the children.
+//
+//   struct CountCalls : FlatVisitor<CountCalls> {
+//     int calls = 0;
+//     CountCalls(const FlatAST & a) : FlatVisitor(a) {}
+//     void VisitFunCall(NodeId n) { ++calls; VisitChildren(n); }
+//   };
+template <class Derived>
+class FlatVisitor {
+ public:
+  explicit FlatVisitor(const FlatAST & a) : ast(a)
+  {
+  }
+
+  void Visit(NodeId n) {
+    if (n == kNoNode)
+      return;
+
+    Derived & d = static_cast<Derived &>(*this);
+    switch (ast.kind[n]) {
+      case NodeKind::fun_def: d.VisitFunDef(n); break;
+      case NodeKind::inst_block: d.VisitBlock(n); break;
+      case NodeKind::inst_if: d.VisitIf(n); break;
+      case NodeKind::inst_while: d.VisitWhile(n); break;
+      case NodeKind::inst_for: d.VisitFor(n); break;
+      case NodeKind::inst_return: d.VisitReturn(n); break;
+      case NodeKind::inst_assign_exp: d.VisitAssignExp(n); break;
+      case NodeKind::inst_assign_incdec: d.VisitAssignIncDec(n); break;
+      case NodeKind::inst_assign_index: d.VisitAssignIndex(n); break;
+      case NodeKind::inst_decl: d.VisitDecl(n); break;
+      case NodeKind::decl_var: d.VisitDeclVar(n); break;
+      case NodeKind::inst_exp: d.VisitInstExp(n); break;
+      case NodeKind::lit_int:
+      case NodeKind::lit_double:
+      case NodeKind::lit_bool:
+      case NodeKind::lit_string: d.VisitLiteral(n); break;
+      case NodeKind::var_ref: d.VisitVarRef(n); break;
+      case NodeKind::fun_call: d.VisitFunCall(n); break;
+      case NodeKind::unary: d.VisitUnary(n); break;
+      case NodeKind::binary: d.VisitBinary(n); break;
+      case NodeKind::array_index: d.VisitIndex(n); break;
+      case NodeKind::array_length: d.VisitLength(n); break;
+      case NodeKind::new_array: d.VisitNewArray(n); break;
+    }
+  }
+
+  void VisitChildren(NodeId n) {
+    for (const NodeId * c = ast.ChildrenBegin(n) ; c != ast.ChildrenEnd(n) ; ++c)
+      static_cast<Derived &>(*this).Visit(*c);
+  }
+
+  void VisitFunDef(NodeId n) { VisitChildren(n); }
+  void VisitBlock(NodeId n) { VisitChildren(n); }
+  void VisitIf(NodeId n) { VisitChildren(n); }
+  void VisitWhile(NodeId n) { VisitChildren(n); }
+  void VisitFor(NodeId n) { VisitChildren(n); }
+  void VisitReturn(NodeId n) { VisitChildren(n); }
+  void VisitAssignExp(NodeId n) { VisitChildren(n); }
+  void VisitAssignIncDec(NodeId n) { VisitChildren(n); }
+  void VisitAssignIndex(NodeId n) { VisitChildren(n); }
+  void VisitDecl(NodeId n) { VisitChildren(n); }
+  void VisitDeclVar(NodeId n) { VisitChildren(n); }
+  void VisitInstExp(NodeId n) { VisitChildren(n); }
+  void VisitLiteral(NodeId n) { VisitChildren(n); }
+  void VisitVarRef(NodeId n) { VisitChildren(n); }
+  void VisitFunCall(NodeId n) { VisitChildren(n); }
+  void VisitUnary(NodeId n) { VisitChildren(n); }
+  void VisitBinary(NodeId n) { VisitChildren(n); }
+  void VisitIndex(NodeId n) { VisitChildren(n); }
+  void VisitLength(NodeId n) { VisitChildren(n); }
+  void VisitNewArray(NodeId n) { VisitChildren(n); }
+
+ protected:
+  const FlatAST & ast;
+};
+
+#endif // JLC_FLAT_AST_HH_
@@ -0,0 +1,415 @@
+// Performance fuzzing of the parser and the checker.
+//
+// Inputs go through jlc::Compile with the default options, which parse and
+// check them. Each one is timed and its peak heap use recorded, both per
+// input byte, and compared with a generated program of ordinary shape
+// measured at startup on the same machine. Inputs that cost more per byte
+// than --slowdown times the baseline are saved to a corpus directory, so
+// that grammar backtracking or checking that grows super-linearly with
+// nesting or length turns into a file to debug.
+//
+//   jlc-fuzz [options] [seed files]    mutates the seeds, or a generated
+//                                      program, for --runs inputs, favoring
+//                                      the slowest ones found
+//   jlc-fuzz --replay [options] paths  measures each file, or each file in
+//                                      the directories, against its budget;
+//                                      fails if any goes over
+//
+// Built with -DJLC_LIBFUZZER and -fsanitize=fuzzer, libFuzzer drives the
+// inputs instead, and the environment variables JLC_FUZZ_CORPUS and
+// JLC_FUZZ_SLOWDOWN set the directory and the factor.
+
+#include "jlc.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <malloc.h>
+#include <sys/stat.h>
+
+// Heap in use and its peak since the last Measure, counted by the
+// replaced operator new and delete.
+static std::atomic<size_t> heap_live(0);
+static std::atomic<size_t> heap_peak(0);
+
+void * operator new(size_t size) {
+  void * p = std::malloc(size ? size : 1);
+  if (! p)
+    throw std::bad_alloc();
+  const size_t live = heap_live += malloc_usable_size(p);
+  size_t peak = heap_peak;
+  while (live > peak && ! heap_peak.compare_exchange_weak(peak, live))
+    ;
+  return p;
+}
+
+void operator delete(void * p) noexcept {
+  if (p) {
+    heap_live -= malloc_usable_size(p);
+    std::free(p);
+  }
+}
+
+void operator delete(void * p, size_t) noexcept {
+  operator delete(p);
+}
+
+namespace {
+
+// Shorter inputs count as this long, so that their noise does not.
+const size_t kMinBytes = 256;
+// Measurements of an input, of which the fastest counts, once it looks
+// slow.
+const int kRepeats = 3;
+const int kCalibrationRepeats = 5;
+// Inputs kept for mutation.
+const size_t kPoolSize = 64;
+
+struct Cost {
+  double seconds;
+  // Peak heap bytes above those in use before.
+  size_t heap;
+};
+
+Cost Measure(const std::string & source) {
+  typedef std::chrono::steady_clock clock;
+
+  const size_t base = heap_live;
+  heap_peak = base;
+  auto start = clock::now();
+  jlc::Compile(source);
+  std::chrono::duration<double> elapsed = clock::now() - start;
+  return Cost{elapsed.count(), heap_peak - base};
+}
+
+Cost MeasureBest(const std::string & source, int repeats) {
+  Cost best = Measure(source);
+  for (int i = 1 ; i < repeats ; ++i)
+    best.seconds = std::min(best.seconds, Measure(source).seconds);
+  return best;
+}
+
+// Functions of ordinary shape: declarations, assignments, calls, nested
+// control flow.
+std::string GenerateProgram(int functions) {
+  std::ostringstream s;
+  for (int i = 0 ; i < functions ; ++i) {
+    s << "int f" << i << "(int a, double b) {\n"
+      << "  int x = a + " << i << ", y;\n"
+      << "  double d = b * 2.5;\n"
+      << "  y = x * 2 - a / 3;\n"
+      << "  if (x < y && d > 0.0) {\n"
+      << "    printString(\"f" << i << "\");\n"
+      << "    x++;\n"
+      << "  } else\n"
+      << "    y--;\n"
+      << "  while (x > 0) {\n"
+      << "    x = x - 1;\n"
+      << "    if (x == 3 || ! (y != 2)) printInt(x % 7);\n"
+      << "  }\n"
+      << "  return " << (i ? "f" + std::to_string(i - 1) + "(x + y, d)" : "x + y") << ";\n"
+      << "}\n";
+  }
+  s << "int main() {\n"
+    << "  printInt(f" << functions - 1 << "(readInt(), readDouble()));\n"
+    << "  return 0;\n"
+    << "}\n";
+  return s.str();
+}
+
+// Costs of an input beyond those of a minimal program, per byte, as
+// factors of the costs of a generated one.
+class Baseline {
+ public:
+  Baseline() {
+    fixed = MeasureBest("int main() { return 0; }", kCalibrationRepeats);
+    const std::string program = GenerateProgram(64);
+    const Cost cost = MeasureBest(program, kCalibrationRepeats);
+    seconds_per_byte = std::max(cost.seconds - fixed.seconds, 1e-9) / program.size();
+    heap_per_byte = std::max<double>(cost.heap - fixed.heap, 1) / program.size();
+  }
+
+  double TimeFactor(const Cost & c, size_t size) const {
+    return (c.seconds - fixed.seconds) / (std::max(size, kMinBytes) * seconds_per_byte);
+  }
+
+  double HeapFactor(const Cost & c, size_t size) const {
+    return (static_cast<double>(c.heap) - fixed.heap) / (std::max(size, kMinBytes) * heap_per_byte);
+  }
+
+  // Most seconds an input may take, slowdown times as much per byte.
+  double Budget(size_t size, double slowdown) const {
+    return fixed.seconds + slowdown * std::max(size, kMinBytes) * seconds_per_byte;
+  }
+
+  Cost fixed;
+  double seconds_per_byte;
+  double heap_per_byte;
+};
+
+std::string ReadFile(const std::string & path) {
+  std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// FNV-1a, for naming saved inputs by their contents.
+uint64_t Hash(const std::string & s) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : s)
+    h = (h ^ c) * 1099511628211ull;
+  return h;
+}
+
+bool Save(const std::string & corpus, const std::string & input) {
+  mkdir(corpus.c_str(), 0755);
+  char name[32];
+  std::snprintf(name, sizeof(name), "/slow-%016llx.jl", static_cast<unsigned long long>(Hash(input)));
+  std::ofstream out(corpus + name, std::ios_base::out | std::ios_base::binary);
+  out.write(input.data(), input.size());
+  return static_cast<bool>(out);
+}
+
+// Measures input and saves it to corpus if it is slowdown times slower or
+// hungrier per byte than the baseline, after measuring it again to rule
+// out noise. Returns the larger factor.
+double Check(const Baseline & baseline, const std::string & input, double slowdown, const std::string & corpus,
+    bool & saved) {
+  Cost cost = Measure(input);
+  double time = baseline.TimeFactor(cost, input.size());
+  if (time > slowdown) {
+    cost = MeasureBest(input, kRepeats);
+    time = baseline.TimeFactor(cost, input.size());
+  }
+  const double heap = baseline.HeapFactor(cost, input.size());
+  saved = (time > slowdown || heap > slowdown) && Save(corpus, input);
+  return std::max(time, heap);
+}
+
+// Tokens of the language and pieces that nest.
+const char * const kDictionary[] = {
+  "int ", "double ", "boolean ", "void ", "string ", "if ", "else ", "while ", "for ", "return ",
+  "true", "false", "x", "f", "main", "printInt", "0", "1.5", "\"s\"", "(", ")", "{", "}", ";", ",",
+  "=", "==", "!=", "<", "<=", "+", "-", "*", "/", "%", "!", "&&", "||", "++", "--",
+  "// c\n", "/* c */", "# c\n", "f(", "x = ", "int x;", "{ ", "(x", "((", "{{", "if (x) ", "x + ",
+};
+
+class Mutator {
+ public:
+  Mutator(unsigned seed, size_t max_len) : rng(seed), max_len(max_len) {}
+
+  std::string Mutate(const std::string & input, const std::string & other) {
+    std::string s = input;
+    const int count = 1 + Below(4);
+    for (int i = 0 ; i < count ; ++i)
+      MutateOnce(s, other);
+    if (s.size() > max_len)
+      s.resize(max_len);
+    return s;
+  }
+
+  size_t Below(size_t n) {
+    return n ? std::uniform_int_distribution<size_t>(0, n - 1)(rng) : 0;
+  }
+
+ private:
+  void MutateOnce(std::string & s, const std::string & other) {
+    const size_t at = Below(s.size() + 1);
+    const size_t length = std::min(s.size() - at, 1 + Below(32));
+    switch (Below(6)) {
+      case 0:
+        s.insert(at, kDictionary[Below(sizeof(kDictionary) / sizeof(kDictionary[0]))]);
+        break;
+      case 1:
+        s.erase(at, length);
+        break;
+      case 2:
+        s.insert(Below(s.size() + 1), s.substr(at, length));
+        break;
+      case 3: {
+        // Repeats a piece, which nests it if it opens something.
+        const std::string piece = s.substr(at, length);
+        for (size_t k = Below(64) ; k > 0 && s.size() + piece.size() <= max_len ; --k)
+          s.insert(at, piece);
+        break;
+      }
+      case 4:
+        s = s.substr(0, at) + other.substr(Below(other.size() + 1));
+        break;
+      case 5:
+        if (at < s.size())
+          s[at] = static_cast<char>(' ' + Below(95));
+        break;
+    }
+  }
+
+  std::mt19937 rng;
+  const size_t max_len;
+};
+
+struct Entry {
+  std::string input;
+  double score;
+};
+
+int Fuzz(const std::vector<std::string> & seeds, long runs, unsigned seed, size_t max_len, double slowdown,
+    const std::string & corpus) {
+  const Baseline baseline;
+  std::cerr << "baseline: " << baseline.fixed.seconds * 1e3 << " ms + " << baseline.seconds_per_byte * 1e9
+    << " ns and " << baseline.heap_per_byte << " heap bytes per byte\n";
+
+  std::vector<Entry> pool;
+  for (auto & s : seeds)
+    pool.push_back(Entry{s.substr(0, max_len), 0});
+  if (pool.empty())
+    pool.push_back(Entry{GenerateProgram(8).substr(0, max_len), 0});
+
+  // The slowest inputs replace the fastest in the pool.
+  Mutator mutator(seed, max_len);
+  long saved_count = 0;
+  for (long run = 1 ; run <= runs ; ++run) {
+    const Entry & parent = pool[mutator.Below(pool.size())];
+    const std::string input = mutator.Mutate(parent.input, pool[mutator.Below(pool.size())].input);
+    bool saved;
+    const double score = Check(baseline, input, slowdown, corpus, saved);
+    if (saved) {
+      ++saved_count;
+      std::cerr << "run " << run << ": " << input.size() << " bytes, " << score << "x, saved to " << corpus << "\n";
+    }
+    if (pool.size() < kPoolSize) {
+      pool.push_back(Entry{input, score});
+    } else {
+      auto fastest = std::min_element(pool.begin(), pool.end(),
+        [](const Entry & a, const Entry & b) { return a.score < b.score; });
+      if (score > fastest->score)
+        *fastest = Entry{input, score};
+    }
+    if (run % 1000 == 0) {
+      auto slowest = std::max_element(pool.begin(), pool.end(),
+        [](const Entry & a, const Entry & b) { return a.score < b.score; });
+      std::cerr << "run " << run << ": slowest " << slowest->score << "x (" << slowest->input.size()
+        << " bytes), " << saved_count << " saved\n";
+    }
+  }
+  return 0;
+}
+
+void ListFiles(const std::string & path, std::vector<std::string> & files) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return;
+  if (! S_ISDIR(st.st_mode)) {
+    files.push_back(path);
+    return;
+  }
+  std::vector<std::string> entries;
+  if (DIR * dir = opendir(path.c_str())) {
+    while (dirent * e = readdir(dir))
+      if (e->d_name[0] != '.')
+        entries.push_back(path + "/" + e->d_name);
+    closedir(dir);
+  }
+  std::sort(entries.begin(), entries.end());
+  for (auto & e : entries)
+    ListFiles(e, files);
+}
+
+int Replay(const std::vector<std::string> & paths, double slowdown) {
+  std::vector<std::string> files;
+  for (auto & p : paths)
+    ListFiles(p, files);
+  const Baseline baseline;
+
+  int over = 0;
+  for (auto & path : files) {
+    const std::string input = ReadFile(path);
+    const Cost cost = MeasureBest(input, kRepeats);
+    const double time = baseline.TimeFactor(cost, input.size());
+    const double heap = baseline.HeapFactor(cost, input.size());
+    const double budget = baseline.Budget(input.size(), slowdown);
+    const bool ok = time <= slowdown && heap <= slowdown;
+    over += ! ok;
+    std::printf("%s: %zu bytes, %.3f ms of %.3f, %.1fx time, %.1fx heap%s\n", path.c_str(), input.size(),
+      cost.seconds * 1e3, budget * 1e3, time, heap, ok ? "" : "  OVER BUDGET");
+  }
+  std::printf("%zu inputs, %d over budget\n", files.size(), over);
+  return over ? 1 : 0;
+}
+
+}
+
+#ifdef JLC_LIBFUZZER
+
+namespace {
+
+const Baseline * baseline;
+std::string corpus = "fuzz_corpus";
+double slowdown = 10;
+
+}
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***) {
+  if (const char * s = std::getenv("JLC_FUZZ_CORPUS"))
+    corpus = s;
+  if (const char * s = std::getenv("JLC_FUZZ_SLOWDOWN"))
+    slowdown = std::atof(s);
+  baseline = new Baseline;
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+  bool saved;
+  Check(*baseline, std::string(reinterpret_cast<const char *>(data), size), slowdown, corpus, saved);
+  return 0;
+}
+
+#else
+
+int main(int argc, char * argv[]) {
+  bool replay = false;
+  long runs = 10000;
+  unsigned seed = 1;
+  size_t max_len = 4096;
+  double slowdown = 10;
+  std::string corpus = "fuzz_corpus";
+  std::vector<std::string> paths;
+
+  for (int i = 1 ; i < argc ; ++i) {
+    if (std::strcmp(argv[i], "--replay") == 0)
+      replay = true;
+    else if (std::strncmp(argv[i], "--runs=", 7) == 0)
+      runs = std::atol(argv[i] + 7);
+    else if (std::strncmp(argv[i], "--seed=", 7) == 0)
+      seed = std::atoi(argv[i] + 7);
+    else if (std::strncmp(argv[i], "--max-len=", 10) == 0)
+      max_len = std::atol(argv[i] + 10);
+    else if (std::strncmp(argv[i], "--slowdown=", 11) == 0)
+      slowdown = std::atof(argv[i] + 11);
+    else if (std::strncmp(argv[i], "--corpus=", 9) == 0)
+      corpus = argv[i] + 9;
+    else
+      paths.push_back(argv[i]);
+  }
+
+  if (replay)
+    return Replay(paths, slowdown);
+  std::vector<std::string> seeds;
+  for (auto & path : paths)
+    seeds.push_back(ReadFile(path));
+  return Fuzz(seeds, runs, seed, max_len, slowdown, corpus);
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include "passes.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace ir {
+
+namespace {
+
+struct Key {
+  Opcode op;
+  Type type;
+  int64_t imm;
+  uint64_t fimm; // bit pattern, so that NaNs and -0.0 are kept apart
+  std::vector<Value> operands;
+
+  bool operator==(const Key & o) const {
+    return op == o.op && type == o.type && imm == o.imm && fimm == o.fimm && operands == o.operands;
+  }
+};
+
+struct KeyHash {
+  size_t operator()(const Key & k) const {
+    size_t h = static_cast<size_t>(k.op) * 31 + k.type;
+    h = h * 1000003 ^ std::hash<int64_t>()(k.imm);
+    h = h * 1000003 ^ std::hash<uint64_t>()(k.fimm);
+    for (auto o : k.operands)
+      h = h * 1000003 ^ o;
+    return h;
+  }
+};
+
+class GVN {
+ public:
+  GVN(Function & function, const std::vector<const Effects *> & callee_effects) :
+    f(function),
+    callees(callee_effects),
+    map(f.insts.size(), kNoValue)
+  {
+  }
+
+  bool Run() {
+    auto idom = f.Dominators();
+    std::vector<std::vector<BlockId>> children(f.blocks.size());
+    for (auto b : f.ReversePostOrder())
+      if (idom[b] != kNoBlock)
+        children[idom[b]].push_back(b);
+
+    // Preorder walk of the dominator tree. Entries added in a block are
+    // dropped again when its subtree is done.
+    std::vector<std::pair<BlockId, size_t>> stack;
+    std::vector<size_t> scope;
+    stack.push_back(std::make_pair(0, 0));
+    scope.push_back(undo.size());
+    Number(0);
+    while (! stack.empty()) {
+      BlockId b = stack.back().first;
+      if (stack.back().second < children[b].size()) {
+        BlockId c = children[b][stack.back().second++];
+        stack.push_back(std::make_pair(c, 0));
+        scope.push_back(undo.size());
+        Number(c);
+      } else {
+        for (size_t i = scope.back() ; i < undo.size() ; ++i)
+          table.erase(undo[i]);
+        undo.resize(scope.back());
+        scope.pop_back();
+        stack.pop_back();
+      }
+    }
+
+    if (redundant.empty())
+      return RemoveTrivialPhis(f);
+
+    f.Rewrite(map);
+    f.Remove(redundant);
+    RemoveTrivialPhis(f);
+    return true;
+  }
+
+ private:
+  Value Resolve(Value v) const {
+    while (map[v] != kNoValue)
+      v = map[v];
+    return v;
+  }
+
+  // Equal calls to a readnone function compute equal values; the imm of
+  // the key is the callee.
+  bool ReadNoneCall(const Inst & inst) const {
+    return inst.op == Opcode::call && callees[inst.imm] && callees[inst.imm]->readnone;
+  }
+
+  void Number(BlockId b) {
+    for (auto v : f.blocks[b].insts) {
+      const Inst & inst = f.insts[v];
+      if (! IsPure(inst.op) && inst.op != Opcode::phi && ! ReadNoneCall(inst))
+        continue;
+
+      Key key;
+      key.op = inst.op;
+      key.type = inst.type;
+      key.imm = inst.op == Opcode::phi ? b : inst.imm;
+      std::memcpy(&key.fimm, &inst.fimm, sizeof(key.fimm));
+      for (auto o : inst.operands)
+        key.operands.push_back(Resolve(o));
+      if (IsCommutative(inst.op))
+        std::sort(key.operands.begin(), key.operands.end());
+
+      auto i = table.find(key);
+      if (i != table.end()) {
+        map[v] = i->second;
+        redundant.push_back(v);
+      } else {
+        table.insert(std::make_pair(key, v));
+        undo.push_back(key);
+      }
+    }
+  }
+
+  Function & f;
+  const std::vector<const Effects *> & callees;
+  std::vector<Value> map;
+  std::vector<Value> redundant;
+  std::unordered_map<Key, Value, KeyHash> table;
+  std::vector<Key> undo;
+};
+
+class GVNPass : public FunctionPass {
+ public:
+  const char * Name() const {
+    return "gvn";
+  }
+
+  bool Run(Module & m) {
+    callees = m.CalleeEffects();
+    return FunctionPass::Run(m);
+  }
+
+  bool RunOnFunction(Module &, Function & f) {
+    if (f.blocks.empty())
+      return false;
+    return GVN(f, callees).Run();
+  }
+
+ private:
+  std::vector<const Effects *> callees;
+};
+
+}
+
+std::unique_ptr<Pass> CreateGVNPass() {
+  return std::unique_ptr<Pass>(new GVNPass);
+}
+
+}
@@ -0,0 +1,257 @@
+#include "passes.hh"
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
+#include "profile.hh"
+
+namespace ir {
+
+namespace {
+
+// Cost model, in instructions: what a call costs beyond the callee's body,
+// and the bonuses for call sites that specialize well or run often.
+const int kCallCost = 5;
+const int kConstantArgBonus = 5;
+const int kLoopBonus = 10;
+const int kHotBonus = 20;
+// Callees entered at least this fraction of the hottest function's entries
+// are hot.
+const double kHotFraction = 0.01;
+// Callers stop growing at this size.
+const int kMaxCallerSize = 5000;
+// How often a function may appear along one chain of inlined calls.
+const int kMaxRecursiveInlining = 1;
+
+bool Returns(const Function & f) {
+  for (BlockId b = 0 ; b < f.blocks.size() ; ++b)
+    if (! f.blocks[b].removed && f.Terminated(b) && f.insts[f.Terminator(b)].op == Opcode::ret)
+      return true;
+  return false;
+}
+
+class Inliner {
+ public:
+  Inliner(Module & module, int t, const profile::Profile * p) : m(module), threshold(t), profile(p) {}
+
+  bool Run() {
+    for (size_t i = 0 ; i < m.functions.size() ; ++i)
+      index[m.functions[i].name] = i;
+    for (auto & f : m.functions)
+      sizes.push_back(CodeSize(f));
+
+    bool changed = false;
+    for (auto & component : CallGraph(m).components)
+      for (auto f : component)
+        changed |= InlineCalls(f);
+    return changed;
+  }
+
+ private:
+  struct Site {
+    Value call;
+    bool in_loop;
+    // Entry in history for the inlined call this one came from, or -1.
+    int history;
+  };
+
+  struct History {
+    int function;
+    int parent;
+  };
+
+  int Callee(const Function & f, Value call) const {
+    auto i = index.find(m.strings[f.insts[call].imm]);
+    return i == index.end() ? -1 : i->second;
+  }
+
+  bool InHistory(int history, int function) const {
+    int seen = 0;
+    for (; history >= 0 ; history = histories[history].parent)
+      if (histories[history].function == function)
+        ++seen;
+    return seen >= kMaxRecursiveInlining;
+  }
+
+  int Cost(const Function & f, const Site & site, int callee) const {
+    int cost = sizes[callee] - kCallCost - static_cast<int>(f.insts[site.call].operands.size());
+    for (auto a : f.insts[site.call].operands)
+      if (IsConstant(f.insts[a].op))
+        cost -= kConstantArgBonus;
+    if (site.in_loop)
+      cost -= kLoopBonus;
+    if (profile && profile->Entries(m.functions[callee].name) >= kHotFraction * profile->MaxEntries())
+      cost -= kHotBonus;
+    return cost;
+  }
+
+  bool InlineCalls(int caller) {
+    Function & f = m.functions[caller];
+    if (f.blocks.empty())
+      return false;
+
+    std::deque<Site> sites;
+    auto in_loop = InLoop(f);
+    for (auto b : f.ReversePostOrder())
+      for (auto v : f.blocks[b].insts)
+        if (f.insts[v].op == Opcode::call)
+          sites.push_back(Site{v, in_loop[b], -1});
+
+    bool changed = false;
+    while (! sites.empty()) {
+      Site site = sites.front();
+      sites.pop_front();
+
+      int callee = Callee(f, site.call);
+      if (callee < 0 || callee == caller || InHistory(site.history, callee))
+        continue;
+      const Function & g = m.functions[callee];
+      if (g.blocks.empty() || ! g.blocks[0].preds.empty() || ! Returns(g))
+        continue;
+      if (profile && profile->Entries(g.name) == 0)
+        continue;
+      if (Cost(f, site, callee) > threshold || sizes[caller] + sizes[callee] > kMaxCallerSize)
+        continue;
+
+      histories.push_back(History{callee, site.history});
+      const int history = histories.size() - 1;
+      for (auto & call : Inline(f, site.call, g))
+        sites.push_back(Site{call.first, site.in_loop || call.second, history});
+      sizes[caller] += sizes[callee];
+      changed = true;
+    }
+
+    if (changed) {
+      RemoveTrivialPhis(f);
+      sizes[caller] = CodeSize(f);
+    }
+    return changed;
+  }
+
+  // Replaces call in f by a copy of g's body. Returns the calls in the copy,
+  // each with whether it is in one of g's loops.
+  std::vector<std::pair<Value, bool>> Inline(Function & f, Value call, const Function & g) {
+    const BlockId b = f.insts[call].block;
+    const int line = f.insts[call].line_pos;
+    const std::vector<Value> args = f.insts[call].operands;
+
+    // Split b after the call; the continuation takes over b's successors.
+    const BlockId cont = f.AddBlock();
+    auto & list = f.blocks[b].insts;
+    auto split = std::find(list.begin(), list.end(), call) + 1;
+    f.blocks[cont].insts.assign(split, list.end());
+    list.erase(split, list.end());
+    for (auto v : f.blocks[cont].insts)
+      f.insts[v].block = cont;
+    for (auto s : f.Successors(cont))
+      std::replace(f.blocks[s].preds.begin(), f.blocks[s].preds.end(), b, cont);
+
+    // Copy g's blocks, turning returns into branches to the continuation.
+    std::vector<BlockId> block_map(g.blocks.size(), kNoBlock);
+    for (BlockId gb = 0 ; gb < g.blocks.size() ; ++gb)
+      if (! g.blocks[gb].removed)
+        block_map[gb] = f.AddBlock();
+
+    const auto g_in_loop = InLoop(g);
+    std::vector<Value> value_map(g.insts.size(), kNoValue);
+    std::vector<Value> copies;
+    std::vector<Value> results;
+    std::vector<std::pair<Value, bool>> calls;
+    for (BlockId gb = 0 ; gb < g.blocks.size() ; ++gb) {
+      if (g.blocks[gb].removed)
+        continue;
+      const BlockId nb = block_map[gb];
+      for (auto p : g.blocks[gb].preds)
+        f.blocks[nb].preds.push_back(block_map[p]);
+      for (auto v : g.blocks[gb].insts) {
+        const Inst & inst = g.insts[v];
+        if (inst.op == Opcode::arg) {
+          value_map[v] = args[inst.imm];
+          continue;
+        }
+        if (inst.op == Opcode::ret) {
+          Value br = f.Append(nb, Opcode::br, basic_type::void_, inst.line_pos);
+          f.insts[br].targets.push_back(cont);
+          f.blocks[cont].preds.push_back(nb);
+          if (! inst.operands.empty())
+            results.push_back(inst.operands[0]);
+          continue;
+        }
+        Value nv = f.Append(nb, inst.op, inst.type, inst.line_pos);
+        f.insts[nv].operands = inst.operands;
+        f.insts[nv].targets = inst.targets;
+        f.insts[nv].imm = inst.imm;
+        f.insts[nv].fimm = inst.fimm;
+        value_map[v] = nv;
+        copies.push_back(nv);
+        if (inst.op == Opcode::call)
+          calls.push_back(std::make_pair(nv, g_in_loop[gb]));
+      }
+    }
+    for (auto v : copies) {
+      for (auto & o : f.insts[v].operands)
+        o = value_map[o];
+      for (auto & t : f.insts[v].targets)
+        t = block_map[t];
+    }
+
+    // The call's value is the returned one, merged by a phi if g has
+    // several returns.
+    std::vector<Value> map(f.insts.size(), kNoValue);
+    if (g.type != basic_type::void_) {
+      Value result;
+      if (results.size() == 1) {
+        result = value_map[results[0]];
+      } else {
+        result = f.Append(cont, Opcode::phi, g.type, line);
+        auto & cont_insts = f.blocks[cont].insts;
+        cont_insts.pop_back();
+        cont_insts.insert(cont_insts.begin(), result);
+        for (auto r : results)
+          f.insts[result].operands.push_back(value_map[r]);
+      }
+      map.resize(f.insts.size(), kNoValue);
+      map[call] = result;
+      f.Rewrite(map);
+    }
+
+    f.Remove(call);
+    Value br = f.Append(b, Opcode::br, basic_type::void_, line);
+    f.insts[br].targets.push_back(block_map[0]);
+    f.blocks[block_map[0]].preds.push_back(b);
+    return calls;
+  }
+
+  Module & m;
+  const int threshold;
+  const profile::Profile * profile;
+  std::unordered_map<std::string, int> index;
+  std::vector<int> sizes;
+  std::vector<History> histories;
+};
+
+class InlinePass : public Pass {
+ public:
+  InlinePass(int t, const profile::Profile * p) : threshold(t), profile(p) {}
+
+  const char * Name() const {
+    return "inline";
+  }
+
+  bool Run(Module & m) {
+    return Inliner(m, threshold, profile).Run();
+  }
+
+ private:
+  int threshold;
+  const profile::Profile * profile;
+};
+
+}
+
+std::unique_ptr<Pass> CreateInlinePass(int threshold, const profile::Profile * profile) {
+  return std::unique_ptr<Pass>(new InlinePass(threshold, profile));
+}
+
+}
@@ -0,0 +1,125 @@
+#include "interface.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "exception.hh"
+
+namespace interface {
+
+namespace {
+
+void PutUleb(std::string & out, uint64_t v) {
+  do {
+    uint8_t b = v & 0x7F;
+    v >>= 7;
+    out.push_back(static_cast<char>(v ? b | 0x80 : b));
+  } while (v);
+}
+
+bool IsType(uint64_t t) {
+  if (t > uint64_t(ArrayOf(basic_type::string_)))
+    return false;
+  if (IsArray(t))
+    return IsElementType(ElementType(t));
+  return t >= uint64_t(basic_type::void_) && t <= uint64_t(basic_type::string_);
+}
+
+class Reader {
+ public:
+  Reader(const std::string & d, const std::string & p) : data(d), path(p), pos(sizeof(kMagic) - 1) {}
+
+  uint64_t Uleb() {
+    uint64_t v = 0;
+    for (int shift = 0 ; shift < 64 && pos < data.size() ; shift += 7) {
+      uint8_t b = data[pos++];
+      v |= uint64_t(b & 0x7F) << shift;
+      if (! (b & 0x80))
+        return v;
+    }
+    throw BadInterface(path);
+  }
+
+  // A number of items that each take at least a byte.
+  uint64_t Count() {
+    uint64_t n = Uleb();
+    if (n > data.size() - pos)
+      throw BadInterface(path);
+    return n;
+  }
+
+  Type ReadType() {
+    uint64_t t = Uleb();
+    if (! IsType(t))
+      throw BadInterface(path);
+    return t;
+  }
+
+  std::string Bytes(uint64_t n) {
+    if (data.size() - pos < n)
+      throw BadInterface(path);
+    pos += n;
+    return data.substr(pos - n, n);
+  }
+
+  bool AtEnd() const {
+    return pos == data.size();
+  }
+
+ private:
+  const std::string & data;
+  const std::string & path;
+  size_t pos;
+};
+
+}
+
+std::vector<Function> Exports(const FlatAST & ast) {
+  std::vector<Function> functions;
+  for (size_t i = 0 ; i < ast.functions.size() ; ++i) {
+    const NodeId fun = ast.functions[i];
+    functions.push_back(Function{ast.strings[ast.data[fun]], ast.type[fun], ast.function_args[i]});
+  }
+  return functions;
+}
+
+std::string Encode(std::vector<Function> functions) {
+  std::sort(functions.begin(), functions.end(),
+      [](const Function & a, const Function & b) { return a.name < b.name; });
+  std::string out(kMagic);
+  PutUleb(out, functions.size());
+  for (auto & f : functions) {
+    PutUleb(out, f.name.size());
+    out += f.name;
+    PutUleb(out, f.type);
+    PutUleb(out, f.args.size());
+    for (auto t : f.args)
+      PutUleb(out, t);
+  }
+  return out;
+}
+
+std::vector<Function> Read(const std::string & path) {
+  std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+  if (! in)
+    throw BadInterface(path);
+  const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (data.compare(0, sizeof(kMagic) - 1, kMagic) != 0)
+    throw BadInterface(path);
+
+  Reader r(data, path);
+  std::vector<Function> functions(r.Count());
+  for (auto & f : functions) {
+    f.name = r.Bytes(r.Uleb());
+    f.type = r.ReadType();
+    f.args.resize(r.Count());
+    for (auto & t : f.args)
+      t = r.ReadType();
+  }
+  if (! r.AtEnd())
+    throw BadInterface(path);
+  return functions;
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef JLC_INTERFACE_HH_
+#define JLC_INTERFACE_HH_
+
+#include <string>
+#include <vector>
+
+#include "flat_ast.hh"
+#include "types.hh"
+
+// Module interfaces for separate compilation. A module's interface file
+// lists the signatures of the functions it defines; other modules import
+// it to call them, and the objects are linked together. The file is
+//
+//   "JLCIFAC2" uleb count, count * (uleb name size, name, uleb type,
+//   uleb argument count, uleb argument types)
+//
+// with the functions sorted by name, so it only changes when a signature
+// does. Types are written as their ids in types.hh; the magic changes
+// with the numbering, so files from an older numbering are rejected.
+namespace interface {
+
+struct Function {
+  std::string name;
+  Type type;
+  std::vector<Type> args;
+
+  bool operator==(const Function & other) const {
+    return name == other.name && type == other.type && args == other.args;
+  }
+};
+
+const char kMagic[] = "JLCIFAC2";
+
+// The functions ast defines.
+std::vector<Function> Exports(const FlatAST & ast);
+
+std::string Encode(std::vector<Function> functions);
+
+// Reads an interface file. Throws BadInterface.
+std::vector<Function> Read(const std::string & path);
+
+}
+
+#endif // JLC_INTERFACE_HH_
@@ -0,0 +1,657 @@
+#include "ir.hh"
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+namespace ir {
+
+namespace {
+
+const char * TypeName(Type t) {
+  switch (t) {
+    case basic_type::void_: return "void";
+    case basic_type::int_: return "int";
+    case basic_type::double_: return "double";
+    case basic_type::boolean_: return "boolean";
+    case basic_type::string_: return "string";
+    case ArrayOf(basic_type::int_): return "int[]";
+    case ArrayOf(basic_type::double_): return "double[]";
+    case ArrayOf(basic_type::boolean_): return "boolean[]";
+  }
+  return "?";
+}
+
+void PrintString(std::ostream & os, const std::string & s) {
+  os << '"';
+  for (auto c : s) {
+    if (c == '"' || c == '\\')
+      os << '\\' << c;
+    else if (c == '\n')
+      os << "\\n";
+    else
+      os << c;
+  }
+  os << '"';
+}
+
+// Counting further than this is not worth it.
+const int64_t kMaxTripCount = 1 << 20;
+
+int64_t Wrap(int64_t v) {
+  return static_cast<int32_t>(static_cast<uint32_t>(v));
+}
+
+bool Compare(Opcode op, int64_t a, int64_t b) {
+  switch (op) {
+    case Opcode::lt: return a < b;
+    case Opcode::le: return a <= b;
+    case Opcode::gt: return a > b;
+    case Opcode::ge: return a >= b;
+    case Opcode::eq: return a == b;
+    default: return a != b;
+  }
+}
+
+// Runs the loop's test on the induction variable's values, as the program
+// would, with ints wrapping around at 32 bits.
+int64_t TripCount(const Function & f, const CountedLoop & c) {
+  const Inst & start = f.insts[c.start];
+  const Inst & bound = f.insts[c.bound];
+  if (start.op != Opcode::const_int || bound.op != Opcode::const_int)
+    return -1;
+  const Inst & test = f.insts[c.test];
+  const bool iv_first = test.operands[0] == c.iv;
+  const bool continue_if = f.insts[f.Terminator(f.insts[c.test].block)].targets[0] == c.body;
+  int64_t i = start.imm;
+  for (int64_t n = 0 ; n <= kMaxTripCount ; ++n) {
+    const bool result = iv_first ? Compare(test.op, i, bound.imm) : Compare(test.op, bound.imm, i);
+    if (result != continue_if)
+      return n;
+    i = Wrap(i + c.step);
+  }
+  return -1;
+}
+
+}
+
+BlockId Function::AddBlock() {
+  blocks.resize(blocks.size() + 1);
+  return blocks.size() - 1;
+}
+
+Value Function::Append(BlockId b, Opcode op, Type type, int line_pos) {
+  Inst inst;
+  inst.op = op;
+  inst.type = type;
+  inst.line_pos = line_pos;
+  inst.block = b;
+  insts.push_back(inst);
+  blocks[b].insts.push_back(insts.size() - 1);
+  return insts.size() - 1;
+}
+
+Value Function::InsertBeforeTerminator(BlockId b, Opcode op, Type type, int line_pos) {
+  Value v = Append(b, op, type, line_pos);
+  auto & list = blocks[b].insts;
+  if (list.size() >= 2 && IsTerminator(insts[list[list.size() - 2]].op))
+    std::swap(list[list.size() - 1], list[list.size() - 2]);
+  return v;
+}
+
+bool Function::Terminated(BlockId b) const {
+  return ! blocks[b].insts.empty() && IsTerminator(insts[blocks[b].insts.back()].op);
+}
+
+Value Function::Terminator(BlockId b) const {
+  return Terminated(b) ? blocks[b].insts.back() : kNoValue;
+}
+
+std::vector<BlockId> Function::Successors(BlockId b) const {
+  Value t = Terminator(b);
+  if (t == kNoValue)
+    return std::vector<BlockId>();
+  return insts[t].targets;
+}
+
+void Function::RemoveEdge(BlockId from, BlockId to) {
+  auto & preds = blocks[to].preds;
+  auto i = std::find(preds.begin(), preds.end(), from);
+  if (i == preds.end())
+    return;
+  const size_t index = i - preds.begin();
+  preds.erase(i);
+  for (auto v : blocks[to].insts) {
+    if (insts[v].op != Opcode::phi)
+      break;
+    insts[v].operands.erase(insts[v].operands.begin() + index);
+  }
+}
+
+void Function::Remove(Value v) {
+  auto & list = blocks[insts[v].block].insts;
+  list.erase(std::find(list.begin(), list.end(), v));
+  insts[v].block = kNoBlock;
+  insts[v].operands.clear();
+}
+
+void Function::Remove(const std::vector<Value> & values) {
+  std::vector<bool> removed(insts.size(), false);
+  std::vector<BlockId> touched;
+  for (auto v : values) {
+    removed[v] = true;
+    touched.push_back(insts[v].block);
+    insts[v].block = kNoBlock;
+    insts[v].operands.clear();
+  }
+  std::sort(touched.begin(), touched.end());
+  touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+  for (auto b : touched) {
+    auto & list = blocks[b].insts;
+    list.erase(std::remove_if(list.begin(), list.end(), [&](Value v) { return removed[v]; }), list.end());
+  }
+}
+
+void Function::MoveBeforeTerminator(Value v, BlockId b) {
+  auto & from = blocks[insts[v].block].insts;
+  from.erase(std::find(from.begin(), from.end(), v));
+  auto & to = blocks[b].insts;
+  to.insert(Terminated(b) ? to.end() - 1 : to.end(), v);
+  insts[v].block = b;
+}
+
+void Function::Rewrite(std::vector<Value> & map) {
+  auto resolve = [&map](Value v) {
+    Value r = v;
+    while (map[r] != kNoValue)
+      r = map[r];
+    while (map[v] != kNoValue && map[v] != r) {
+      Value next = map[v];
+      map[v] = r;
+      v = next;
+    }
+    return r;
+  };
+
+  for (auto & inst : insts) {
+    if (inst.block == kNoBlock)
+      continue;
+    for (auto & o : inst.operands)
+      o = resolve(o);
+  }
+}
+
+bool Function::RemoveUnreachableBlocks() {
+  std::vector<bool> reachable(blocks.size(), false);
+  for (auto b : ReversePostOrder())
+    reachable[b] = true;
+
+  bool changed = false;
+  for (BlockId b = 0 ; b < blocks.size() ; ++b) {
+    if (reachable[b] || blocks[b].removed)
+      continue;
+    for (auto s : Successors(b))
+      RemoveEdge(b, s);
+    for (auto v : blocks[b].insts) {
+      insts[v].block = kNoBlock;
+      insts[v].operands.clear();
+    }
+    blocks[b].insts.clear();
+    blocks[b].preds.clear();
+    blocks[b].removed = true;
+    changed = true;
+  }
+  return changed;
+}
+
+std::vector<BlockId> Function::ReversePostOrder() const {
+  std::vector<BlockId> order;
+  if (blocks.empty())
+    return order;
+
+  std::vector<bool> visited(blocks.size(), false);
+  std::vector<std::pair<BlockId, size_t>> stack;
+  stack.push_back(std::make_pair(0, 0));
+  visited[0] = true;
+  while (! stack.empty()) {
+    BlockId b = stack.back().first;
+    auto succs = Successors(b);
+    if (stack.back().second < succs.size()) {
+      BlockId s = succs[stack.back().second++];
+      if (! visited[s]) {
+        visited[s] = true;
+        stack.push_back(std::make_pair(s, 0));
+      }
+    } else {
+      order.push_back(b);
+      stack.pop_back();
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+std::vector<BlockId> Function::Dominators() const {
+  std::vector<BlockId> idom(blocks.size(), kNoBlock);
+  auto order = ReversePostOrder();
+  if (order.empty())
+    return idom;
+
+  std::vector<size_t> number(blocks.size(), 0);
+  for (size_t i = 0 ; i < order.size() ; ++i)
+    number[order[i]] = i;
+
+  auto intersect = [&](BlockId a, BlockId b) {
+    while (a != b) {
+      while (number[a] > number[b])
+        a = idom[a];
+      while (number[b] > number[a])
+        b = idom[b];
+    }
+    return a;
+  };
+
+  idom[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1 ; i < order.size() ; ++i) {
+      BlockId b = order[i];
+      BlockId new_idom = kNoBlock;
+      for (auto p : blocks[b].preds) {
+        if (idom[p] == kNoBlock)
+          continue;
+        new_idom = new_idom == kNoBlock ? p : intersect(p, new_idom);
+      }
+      if (idom[b] != new_idom) {
+        idom[b] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  idom[0] = kNoBlock;
+  return idom;
+}
+
+std::vector<std::vector<Value>> Function::Uses() const {
+  std::vector<std::vector<Value>> uses(insts.size());
+  for (Value v = 0 ; v < insts.size() ; ++v) {
+    if (insts[v].block == kNoBlock)
+      continue;
+    for (auto o : insts[v].operands)
+      uses[o].push_back(v);
+  }
+  return uses;
+}
+
+int CodeSize(const Function & f) {
+  int size = 0;
+  for (auto & b : f.blocks) {
+    if (b.removed)
+      continue;
+    for (auto v : b.insts) {
+      Opcode op = f.insts[v].op;
+      if (! IsConstant(op) && op != Opcode::arg && op != Opcode::br)
+        ++size;
+    }
+  }
+  return size;
+}
+
+CallGraph::CallGraph(const Module & m) {
+  const int n = m.functions.size();
+  std::unordered_map<std::string, int> index;
+  for (int i = 0 ; i < n ; ++i)
+    index[m.functions[i].name] = i;
+  callees.resize(n);
+  for (int i = 0 ; i < n ; ++i) {
+    const Function & f = m.functions[i];
+    for (Value v = 0 ; v < f.insts.size() ; ++v) {
+      if (f.insts[v].block == kNoBlock || f.insts[v].op != Opcode::call)
+        continue;
+      auto callee = index.find(m.strings[f.insts[v].imm]);
+      if (callee != index.end())
+        callees[i].push_back(callee->second);
+    }
+    std::sort(callees[i].begin(), callees[i].end());
+    callees[i].erase(std::unique(callees[i].begin(), callees[i].end()), callees[i].end());
+  }
+
+  // Tarjan's algorithm, iterative. It completes callees' components first.
+  std::vector<int> number(n, -1), low(n, 0);
+  std::vector<bool> on_stack(n, false);
+  std::vector<int> stack;
+  int counter = 0;
+
+  for (int root = 0 ; root < n ; ++root) {
+    if (number[root] >= 0)
+      continue;
+    std::vector<std::pair<int, size_t>> work = {{root, 0}};
+    number[root] = low[root] = counter++;
+    stack.push_back(root);
+    on_stack[root] = true;
+    while (! work.empty()) {
+      int v = work.back().first;
+      size_t & next = work.back().second;
+      if (next < callees[v].size()) {
+        int w = callees[v][next++];
+        if (number[w] < 0) {
+          number[w] = low[w] = counter++;
+          stack.push_back(w);
+          on_stack[w] = true;
+          work.push_back(std::make_pair(w, 0));
+        } else if (on_stack[w]) {
+          low[v] = std::min(low[v], number[w]);
+        }
+        continue;
+      }
+      work.pop_back();
+      if (! work.empty())
+        low[work.back().first] = std::min(low[work.back().first], low[v]);
+      if (low[v] == number[v]) {
+        components.resize(components.size() + 1);
+        int w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          on_stack[w] = false;
+          components.back().push_back(w);
+        } while (w != v);
+      }
+    }
+  }
+}
+
+std::vector<Loop> FindLoops(const Function & f, const std::vector<BlockId> & idom) {
+  auto dominates = [&](BlockId a, BlockId b) {
+    for (; b != kNoBlock ; b = idom[b])
+      if (a == b)
+        return true;
+    return false;
+  };
+
+  std::vector<Loop> loops;
+  std::vector<int> loop_of(f.blocks.size(), -1);
+  for (auto b : f.ReversePostOrder()) {
+    for (auto h : f.Successors(b)) {
+      if (! dominates(h, b))
+        continue;
+      if (loop_of[h] < 0) {
+        loop_of[h] = loops.size();
+        loops.push_back(Loop{h, std::vector<bool>(f.blocks.size(), false), 1});
+        loops.back().body[h] = true;
+      }
+      Loop & loop = loops[loop_of[h]];
+      std::vector<BlockId> work;
+      if (! loop.body[b]) {
+        loop.body[b] = true;
+        ++loop.size;
+        work.push_back(b);
+      }
+      while (! work.empty()) {
+        BlockId x = work.back();
+        work.pop_back();
+        for (auto p : f.blocks[x].preds) {
+          if (! loop.body[p]) {
+            loop.body[p] = true;
+            ++loop.size;
+            work.push_back(p);
+          }
+        }
+      }
+    }
+  }
+
+  std::stable_sort(loops.begin(), loops.end(), [](const Loop & a, const Loop & b) { return a.size < b.size; });
+  return loops;
+}
+
+std::vector<bool> InLoop(const Function & f) {
+  std::vector<bool> in_loop(f.blocks.size(), false);
+  for (auto & loop : FindLoops(f, f.Dominators()))
+    for (BlockId b = 0 ; b < f.blocks.size() ; ++b)
+      if (loop.body[b])
+        in_loop[b] = true;
+  return in_loop;
+}
+
+bool FindCountedLoop(const Function & f, const Loop & loop, CountedLoop & counted) {
+  const BlockId header = loop.header;
+  const auto & preds = f.blocks[header].preds;
+  if (preds.size() != 2 || loop.body[preds[0]] == loop.body[preds[1]])
+    return false;
+  const size_t latch_index = loop.body[preds[0]] ? 0 : 1;
+  CountedLoop c;
+  c.preheader = preds[1 - latch_index];
+  c.latch = preds[latch_index];
+  if (f.Successors(c.preheader).size() != 1)
+    return false;
+
+  const Value t = f.Terminator(header);
+  if (t == kNoValue || f.insts[t].op != Opcode::cond_br)
+    return false;
+  const Inst & branch = f.insts[t];
+  if (loop.body[branch.targets[0]] == loop.body[branch.targets[1]])
+    return false;
+  c.body = loop.body[branch.targets[0]] ? branch.targets[0] : branch.targets[1];
+  c.exit = loop.body[branch.targets[0]] ? branch.targets[1] : branch.targets[0];
+
+  c.test = branch.operands[0];
+  const Inst & test = f.insts[c.test];
+  if (test.block != header || test.op < Opcode::lt || test.op > Opcode::ne)
+    return false;
+  for (size_t i = 0 ; i < 2 ; ++i) {
+    const Inst & iv = f.insts[test.operands[i]];
+    const Inst & bound = f.insts[test.operands[1 - i]];
+    if (iv.op != Opcode::phi || iv.block != header || iv.type != basic_type::int_ || loop.body[bound.block])
+      continue;
+    const Inst & next = f.insts[iv.operands[latch_index]];
+    if ((next.op != Opcode::add && next.op != Opcode::sub) || ! loop.body[next.block])
+      continue;
+    for (size_t j = 0 ; j < 2 ; ++j) {
+      const Inst & step = f.insts[next.operands[1 - j]];
+      if (next.operands[j] != test.operands[i] || step.op != Opcode::const_int || (j == 1 && next.op == Opcode::sub))
+        continue;
+      c.iv = test.operands[i];
+      c.start = iv.operands[1 - latch_index];
+      c.step = next.op == Opcode::add ? step.imm : -step.imm;
+      c.bound = test.operands[1 - i];
+      c.trip_count = TripCount(f, c);
+      counted = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RemoveTrivialPhis(Function & f) {
+  bool changed = false;
+  bool again = true;
+  while (again) {
+    again = false;
+    std::vector<Value> map(f.insts.size(), kNoValue);
+    std::vector<Value> trivial;
+    for (Value v = 0 ; v < f.insts.size() ; ++v) {
+      const Inst & inst = f.insts[v];
+      if (inst.block == kNoBlock || inst.op != Opcode::phi)
+        continue;
+      Value same = kNoValue;
+      bool unique = true;
+      for (auto o : inst.operands) {
+        if (o == v || o == same)
+          continue;
+        if (same != kNoValue)
+          unique = false;
+        same = o;
+      }
+      if (unique && same != kNoValue) {
+        map[v] = same;
+        trivial.push_back(v);
+      }
+    }
+    if (trivial.empty())
+      break;
+    f.Rewrite(map);
+    f.Remove(trivial);
+    changed = again = true;
+  }
+  return changed;
+}
+
+uint32_t Module::AddString(const std::string & s) {
+  auto i = string_index.insert(std::make_pair(s, uint32_t(strings.size())));
+  if (i.second)
+    strings.push_back(s);
+  return i.first->second;
+}
+
+int Module::Find(const std::string & name) const {
+  for (size_t i = 0 ; i < functions.size() ; ++i)
+    if (functions[i].name == name)
+      return i;
+  return -1;
+}
+
+std::vector<bool> Module::Reachable(const std::string & root) const {
+  const int r = Find(root);
+  if (r < 0)
+    return std::vector<bool>(functions.size(), true);
+
+  const CallGraph graph(*this);
+  std::vector<bool> reached(functions.size(), false);
+  std::vector<int> work(1, r);
+  reached[r] = true;
+  while (! work.empty()) {
+    const int i = work.back();
+    work.pop_back();
+    for (int callee : graph.callees[i]) {
+      if (! reached[callee]) {
+        reached[callee] = true;
+        work.push_back(callee);
+      }
+    }
+  }
+  return reached;
+}
+
+void Module::KeepFunctions(const std::vector<bool> & keep) {
+  size_t to = 0;
+  for (size_t i = 0 ; i < functions.size() ; ++i) {
+    if (keep[i]) {
+      if (to != i)
+        functions[to] = std::move(functions[i]);
+      ++to;
+    }
+  }
+  functions.resize(to);
+}
+
+std::vector<const Effects *> Module::CalleeEffects() const {
+  std::unordered_map<std::string, const Effects *> by_name;
+  for (auto & f : functions)
+    by_name[f.name] = &f.effects;
+  std::vector<const Effects *> effects(strings.size(), 0);
+  for (size_t i = 0 ; i < strings.size() ; ++i) {
+    auto e = by_name.find(strings[i]);
+    if (e != by_name.end())
+      effects[i] = e->second;
+  }
+  return effects;
+}
+
+const char * OpcodeName(Opcode op) {
+  static const char * names[] = {
+    "const_int", "const_double", "const_bool", "const_string", "arg", "phi",
+    "neg", "not", "add", "sub", "mul", "div", "mod",
+    "lt", "le", "gt", "ge", "eq", "ne",
+    "length", "new_array", "load", "store", "check", "call", "br", "cond_br", "ret", "unreachable",
+  };
+  return names[static_cast<int>(op)];
+}
+
+void Print(std::ostream & os, const Module & m) {
+  for (auto & f : m.functions)
+    Print(os, m, f);
+}
+
+void Print(std::ostream & os, const Module & m, const Function & f) {
+  os << "function " << TypeName(f.type) << " " << f.name << "(";
+  for (size_t i = 0 ; i < f.arg_types.size() ; ++i)
+    os << (i ? ", " : "") << TypeName(f.arg_types[i]);
+  os << ")";
+  if (f.effects.readnone)
+    os << " readnone";
+  if (f.effects.speculatable)
+    os << " speculatable";
+  os << "\n";
+
+  for (BlockId b = 0 ; b < f.blocks.size() ; ++b) {
+    const Block & block = f.blocks[b];
+    if (block.removed)
+      continue;
+    os << "b" << b << ":";
+    if (! block.preds.empty()) {
+      os << " ; preds";
+      for (auto p : block.preds)
+        os << " b" << p;
+    }
+    os << "\n";
+
+    for (auto v : block.insts) {
+      const Inst & inst = f.insts[v];
+      os << "  ";
+      if (inst.type != basic_type::void_)
+        os << "%" << v << " = ";
+      os << OpcodeName(inst.op);
+      if (inst.type != basic_type::void_)
+        os << " " << TypeName(inst.type);
+
+      switch (inst.op) {
+        case Opcode::const_int:
+        case Opcode::arg:
+          os << " " << inst.imm;
+          break;
+        case Opcode::const_double:
+          os << " " << inst.fimm;
+          break;
+        case Opcode::const_bool:
+          os << (inst.imm ? " true" : " false");
+          break;
+        case Opcode::const_string:
+          os << " ";
+          PrintString(os, m.strings[inst.imm]);
+          break;
+        case Opcode::call:
+          os << " " << m.strings[inst.imm];
+          break;
+        default:
+          break;
+      }
+
+      for (size_t i = 0 ; i < inst.operands.size() ; ++i) {
+        os << (i ? ", " : " ") << "%" << inst.operands[i];
+        if (inst.op == Opcode::phi)
+          os << " b" << block.preds[i];
+      }
+      for (size_t i = 0 ; i < inst.targets.size() ; ++i)
+        os << (i || ! inst.operands.empty() ? ", " : " ") << "b" << inst.targets[i];
+      os << "\n";
+    }
+  }
+}
+
+void PrintEffects(std::ostream & os, const Module & m) {
+  for (auto & f : m.functions) {
+    os << f.name << ":";
+    if (f.effects.readnone)
+      os << " readnone";
+    if (f.effects.speculatable)
+      os << " speculatable";
+    if (! f.effects.reason.empty())
+      os << (f.effects.readnone ? "; not speculatable: " : " side effects: ") << f.effects.reason;
+    os << "\n";
+  }
+}
+
+}
@@ -0,0 +1,244 @@
+#ifndef JLC_IR_HH_
+#define JLC_IR_HH_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hh"
+
+// Typed SSA intermediate representation shared by the optimizer and the
+// backends. A function owns its instructions and basic blocks; a Value is
+// the index of the instruction computing it. Blocks list their
+// instructions in order, phis first and one terminator last.
+namespace ir {
+
+typedef uint32_t Value;
+typedef uint32_t BlockId;
+
+const Value kNoValue = ~Value(0);
+const BlockId kNoBlock = ~BlockId(0);
+
+enum class Opcode : uint8_t {
+  const_int,    // imm
+  const_double, // fimm
+  const_bool,   // imm
+  const_string, // imm: index into Module::strings
+  arg,          // imm: argument index
+  phi,          // one operand per predecessor, in Block::preds order
+  neg,
+  not_,
+  add,
+  sub,
+  mul,
+  div,
+  mod,
+  lt,
+  le,
+  gt,
+  ge,
+  eq,
+  ne,
+  length,       // operands: array
+  new_array,    // operands: length; all elements zero
+  load,         // operands: array, index
+  store,        // operands: array, index, value
+  check,        // operands: array, index; traps unless the index is in bounds
+  call,         // imm: index into Module::strings of the callee name
+  br,           // targets[0]
+  cond_br,      // operands[0] ? targets[0] : targets[1]
+  ret,          // optional operands[0]
+  unreachable,
+};
+
+struct Inst {
+  Inst() : op(Opcode::unreachable), type(basic_type::void_), line_pos(0),
+    block(kNoBlock), imm(0), fimm(0)
+  {
+  }
+
+  Opcode op;
+  Type type; // result type, void_ if there is none
+  int line_pos;
+  BlockId block; // kNoBlock once removed
+  std::vector<Value> operands;
+  std::vector<BlockId> targets;
+  int64_t imm;
+  double fimm;
+};
+
+struct Block {
+  Block() : removed(false) {}
+
+  std::vector<Value> insts;
+  std::vector<BlockId> preds;
+  bool removed;
+};
+
+// What calling a function may do besides computing its result. Unknown
+// until the effects pass has run, and then kept up to date by the passes,
+// which never add effects.
+struct Effects {
+  Effects() : readnone(false), speculatable(false) {}
+
+  // No side effects: the result only depends on the arguments, so equal
+  // calls compute equal values.
+  bool readnone;
+  // Also returns for all arguments, so a call may be made where the
+  // program would not have made it.
+  bool speculatable;
+  // Why the function is not readnone or not speculatable.
+  std::string reason;
+};
+
+struct Function {
+  Function() : type(basic_type::void_), line_pos(0), local(false) {}
+
+  std::string name;
+  Type type;
+  std::vector<Type> arg_types;
+  int line_pos;
+  // Only called from this module, like the clones of specialize; its
+  // symbol is local to the object.
+  bool local;
+  Effects effects;
+
+  std::vector<Inst> insts;
+  std::vector<Block> blocks; // blocks[0] is the entry
+
+  BlockId AddBlock();
+  // Appends a new instruction to block b.
+  Value Append(BlockId b, Opcode op, Type type, int line_pos);
+  // Inserts a new instruction into block b before its terminator.
+  Value InsertBeforeTerminator(BlockId b, Opcode op, Type type, int line_pos);
+
+  bool Terminated(BlockId b) const;
+  Value Terminator(BlockId b) const;
+  std::vector<BlockId> Successors(BlockId b) const;
+
+  // Drops the pred edge from `from` to `to`, with the matching phi operands.
+  void RemoveEdge(BlockId from, BlockId to);
+  // Removes instruction v from its block. Its uses must be gone.
+  void Remove(Value v);
+  void Remove(const std::vector<Value> & values);
+  // Moves instruction v to the end of block b, before its terminator.
+  void MoveBeforeTerminator(Value v, BlockId b);
+  // Replaces operands according to map, where map[v] is v's replacement or
+  // kNoValue. Chains of replacements are followed.
+  void Rewrite(std::vector<Value> & map);
+  // Removes blocks not reachable from the entry. Returns true on change.
+  bool RemoveUnreachableBlocks();
+
+  // Blocks reachable from the entry in reverse post-order.
+  std::vector<BlockId> ReversePostOrder() const;
+  // Immediate dominator of each block; kNoBlock for the entry and for
+  // unreachable blocks.
+  std::vector<BlockId> Dominators() const;
+  // Instruction uses: for each value, the instructions using it.
+  std::vector<std::vector<Value>> Uses() const;
+};
+
+struct Module {
+  std::vector<Function> functions;
+  // Only grown through AddString, which keeps string_index.
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint32_t> string_index;
+
+  uint32_t AddString(const std::string & s);
+  // Index of the function called name, or -1.
+  int Find(const std::string & name) const;
+  // Which functions the one called root reaches through calls, itself
+  // included. All of them if there is no root.
+  std::vector<bool> Reachable(const std::string & root) const;
+  // Drops the functions that keep is false for; the others stay in order.
+  void KeepFunctions(const std::vector<bool> & keep);
+  // For each string, the effects of the function it names, or null if
+  // the module does not define one: the effects of a call's callee are
+  // CalleeEffects()[call.imm].
+  std::vector<const Effects *> CalleeEffects() const;
+};
+
+// Calls between the functions of a module, by index into
+// Module::functions. Calls to functions the module does not define are
+// left out.
+struct CallGraph {
+  explicit CallGraph(const Module & m);
+
+  // The functions each function calls, once each.
+  std::vector<std::vector<int>> callees;
+  // Strongly connected components, each after the components it calls
+  // into.
+  std::vector<std::vector<int>> components;
+};
+
+// A natural loop: its header and the blocks of its body, header included.
+struct Loop {
+  BlockId header;
+  std::vector<bool> body; // indexed by BlockId
+  size_t size;
+};
+
+// Natural loops of f given its dominators, innermost first. Loops sharing
+// a header are merged.
+std::vector<Loop> FindLoops(const Function & f, const std::vector<BlockId> & idom);
+// Blocks of f inside some loop.
+std::vector<bool> InLoop(const Function & f);
+
+// A loop whose header tests an int induction variable against a bound
+// defined outside the loop, the way for and while loops over a counter
+// updated with ++ or -- are lowered. The variable is a header phi that
+// starts at a value from the preheader and is stepped by a constant once
+// per iteration.
+struct CountedLoop {
+  BlockId preheader, latch, body, exit;
+  Value iv;
+  Value start;
+  int64_t step;
+  Value bound;
+  // The compare the header branches on.
+  Value test;
+  // Iterations of the body, -1 unless start and bound are constants.
+  int64_t trip_count;
+};
+
+// Returns true if loop is a counted loop, described in counted.
+bool FindCountedLoop(const Function & f, const Loop & loop, CountedLoop & counted);
+
+// Instructions of f that survive to the generated code, roughly.
+int CodeSize(const Function & f);
+
+// Replaces phis whose operands are all the same value, or the phi itself,
+// by that value. Returns true on change.
+bool RemoveTrivialPhis(Function & f);
+
+const char * OpcodeName(Opcode op);
+
+inline bool IsTerminator(Opcode op) {
+  return op >= Opcode::br;
+}
+
+inline bool IsConstant(Opcode op) {
+  return op <= Opcode::const_string;
+}
+
+// Operations without side effects whose result only depends on their
+// operands. Integer division may still trap on a zero divisor. Arrays
+// never change length.
+inline bool IsPure(Opcode op) {
+  return op <= Opcode::length && op != Opcode::phi && op != Opcode::arg;
+}
+
+inline bool IsCommutative(Opcode op) {
+  return op == Opcode::add || op == Opcode::mul || op == Opcode::eq || op == Opcode::ne;
+}
+
+void Print(std::ostream & os, const Module & m);
+// One line per function with its Effects.
+void PrintEffects(std::ostream & os, const Module & m);
+void Print(std::ostream & os, const Module & m, const Function & f);
+
+}
+
+#endif // JLC_IR_HH_
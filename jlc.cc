@@ -1,24 +1,151 @@
-#include "parser.hh"
-#include "ast.hh"
-#include "compiler.hh"
-#include "tags.hh"
+#include "jlc.hh"
 
-#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <regex>
 
-using namespace boost::spirit;
+#include <sys/stat.h>
+
+#include "trace.hh"
 
 void GetSource(std::istream & is, std::string & source) {
   is.unsetf(std::ios::skipws);
   std::copy(std::istream_iterator<char>(is), std::istream_iterator<char>(), std::back_inserter(source));
 }
 
+// foo.jl -> foo.<extension>, a.<extension> for standard input.
+std::string OutputPath(const char * filename, const char * extension) {
+  std::string path = "a";
+  if (filename[0] != '<') {
+    path = filename;
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+      path.erase(dot);
+  }
+  return path + "." + extension;
+}
+
+// Leaves the file alone if it already has these contents, so that its
+// modification time only changes with them.
+bool WriteIfChanged(const std::string & path, const std::string & contents) {
+  std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+  if (in && std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()) == contents)
+    return true;
+  std::ofstream out(path, std::ios_base::out | std::ios_base::binary);
+  out.write(contents.data(), contents.size());
+  return static_cast<bool>(out);
+}
+
 int main(int argc, char * argv[]) {
   std::string source_code;
 
-  const char * filename;
+  const char * filename = 0;
+  const char * output = 0;
+  const char * interface_output = 0;
+  const char * trace_output = 0;
+  jlc::Options options;
+  bool emit_ir = false;
+  bool print_effects = false;
+  bool time_passes = false;
+  // Patterns of pass names to print remarks of, by ir::Remark::Kind.
+  std::string remarks[3];
+
+  for (int i = 1 ; i < argc ; ++i) {
+    if (std::strcmp(argv[i], "--stream") == 0)
+      options.stream = true;
+    else if (std::strncmp(argv[i], "--parse-threads=", 16) == 0)
+      options.parse_threads = std::atoi(argv[i] + 16);
+    else if (std::strcmp(argv[i], "--keep-unreachable") == 0)
+      options.keep_unreachable = true;
+    else if (std::strcmp(argv[i], "--lazy-check") == 0)
+      options.lazy_check = true;
+    else if (std::strcmp(argv[i], "-O") == 0)
+      options.passes = ir::kDefaultPipeline;
+    else if (std::strncmp(argv[i], "--passes=", 9) == 0)
+      options.passes = argv[i] + 9;
+    else if (std::strncmp(argv[i], "--inline-threshold=", 19) == 0)
+      options.pass_options.inline_threshold = std::atoi(argv[i] + 19);
+    else if (std::strcmp(argv[i], "--emit-ir") == 0)
+      emit_ir = true;
+    else if (std::strcmp(argv[i], "--print-effects") == 0)
+      print_effects = true;
+    else if (std::strcmp(argv[i], "--time-passes") == 0)
+      time_passes = true;
+    else if (std::strncmp(argv[i], "--trace-out=", 12) == 0)
+      trace_output = argv[i] + 12;
+    else if (std::strncmp(argv[i], "-Rpass=", 7) == 0)
+      remarks[0] = argv[i] + 7;
+    else if (std::strncmp(argv[i], "-Rpass-missed=", 14) == 0)
+      remarks[1] = argv[i] + 14;
+    else if (std::strncmp(argv[i], "-Rpass-analysis=", 16) == 0)
+      remarks[2] = argv[i] + 16;
+    else if (std::strcmp(argv[i], "-c") == 0)
+      options.object = true;
+    else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else if (std::strcmp(argv[i], "--profile-generate") == 0)
+      options.profile_generate = "jlc.profile";
+    else if (std::strncmp(argv[i], "--profile-generate=", 19) == 0)
+      options.profile_generate = argv[i] + 19;
+    else if (std::strncmp(argv[i], "--profile-use=", 14) == 0)
+      options.profile_use = argv[i] + 14;
+    else if (std::strncmp(argv[i], "--import=", 9) == 0)
+      options.imports.push_back(argv[i] + 9);
+    else if (std::strcmp(argv[i], "--emit-interface") == 0)
+      options.interface = true;
+    else if (std::strncmp(argv[i], "--emit-interface=", 17) == 0) {
+      options.interface = true;
+      interface_output = argv[i] + 17;
+    }
+    else if (std::strlen(argv[i]) > 2 && std::strcmp(argv[i] + std::strlen(argv[i]) - 2, ".o") == 0)
+      options.link_objects.push_back(argv[i]);
+    else
+      filename = argv[i];
+  }
+  // Without -c, -o names an executable.
+  options.link = output && ! options.object;
+  if (options.object && ! options.link_objects.empty()) {
+    std::cerr << "Error: Object files are only linked, not with -c: " << options.link_objects[0] << std::endl;
+    return 1;
+  }
+  // With -c or -o, native code is generated from the IR after the passes.
+  options.lower = emit_ir || print_effects || ! options.passes.empty();
+  // Instrumented code is generated from the checked program, which the
+  // passes do not change.
+  if (! options.profile_generate.empty() && ! options.passes.empty()) {
+    std::cerr << "Error: --profile-generate instruments unoptimized code, not with -O or --passes" << std::endl;
+    return 1;
+  }
+
+  // Each instrumented object defines jlc_profile, so two of them cannot
+  // be linked together.
+  if (! options.profile_generate.empty() && (options.object || ! options.link_objects.empty())) {
+    std::cerr << "Error: --profile-generate needs the whole program in one module, not -c or .o inputs" << std::endl;
+    return 1;
+  }
+
+  // The effects are only known once the pass has run.
+  if (print_effects && ("," + options.passes + ",").find(",effects,") == std::string::npos)
+    options.passes += options.passes.empty() ? "effects" : ",effects";
+
+  std::regex remark_patterns[3];
+  for (int i = 0 ; i < 3 ; ++i) {
+    try {
+      remark_patterns[i].assign(remarks[i]);
+    } catch (std::regex_error &) {
+      std::cerr << "Error: Bad remark pattern: " << remarks[i] << std::endl;
+      return 1;
+    }
+  }
 
-  if (argc > 1) {
-    filename = argv[1];
+  if (filename) {
     std::ifstream in(filename, std::ios_base::in);
     if (! in) {
       std::cerr << "Error: Could not open input file: " << filename << std::endl;
@@ -29,52 +156,97 @@ int main(int argc, char * argv[]) {
     filename = "<stdin>";
     GetSource(std::cin, source_code);
   }
+  options.source_file = filename;
 
-  std::istringstream scs(source_code);
+  std::unique_ptr<trace::Recorder> recorder;
+  if (trace_output) {
+    recorder.reset(new trace::Recorder);
+    options.trace = recorder.get();
+  }
 
-  //typedef std::string::const_iterator stream_iterator_type;
-#if 0
-  typedef boost::spirit::basic_istream_iterator<char> stream_iterator_type;
-  typedef boost::spirit::line_pos_iterator<stream_iterator_type> iterator_type;
+  jlc::Result result = jlc::Compile(source_code, options);
 
-  stream_iterator_type sfirst(scs);
-  stream_iterator_type slast;
-  iterator_type iter(sfirst);
-  iterator_type end(slast);
-#else
-  //typedef boost::spirit::basic_istream_iterator<char> iterator_type;
-  typedef std::string::const_iterator string_iterator_type;
-  typedef boost::spirit::line_pos_iterator<string_iterator_type> iterator_type;
+  // Also when compilation failed, which may have taken long.
+  if (recorder) {
+    std::ofstream out(trace_output, std::ios_base::out);
+    recorder->Write(out);
+    if (! out) {
+      std::cerr << "Error: Could not write output file: " << trace_output << std::endl;
+      return 1;
+    }
+  }
 
-  iterator_type iter(source_code.begin());
-  iterator_type end(source_code.end());
-#endif
-  typedef parser::JavaletteParser<iterator_type, Tags<Tag>> Parser;
+  for (auto i = result.diagnostics.begin() ; i != result.diagnostics.end() ; ++i) {
+    switch (i->kind) {
+      case jlc::Diagnostic::Kind::parse_error:
+        std::cerr << "Error! " << i->message << "\n";
+        std::cerr << "Parsing failed\n";
+        break;
+      case jlc::Diagnostic::Kind::compile_error:
+      case jlc::Diagnostic::Kind::internal_error:
+        std::cerr << "Compilation failed: " << i->name << i->message << "\n";
+        break;
+    }
+  }
 
-  Tags<Tag> tags;
-  Parser p(tags);
+  if (result.ok && options.object) {
+    std::string path = output ? output : OutputPath(filename, "o");
+    std::ofstream out(path, std::ios_base::out | std::ios_base::binary);
+    out.write(result.object.data(), result.object.size());
+    if (! out) {
+      std::cerr << "Error: Could not write output file: " << path << std::endl;
+      return 1;
+    }
+  }
 
-  typedef parser::JavaletteSkipper<iterator_type> Skipper;
-  Skipper s;
+  if (result.ok && options.link) {
+    std::ofstream out(output, std::ios_base::out | std::ios_base::binary);
+    out.write(result.executable.data(), result.executable.size());
+    out.close();
+    if (! out || chmod(output, 0755) != 0) {
+      std::cerr << "Error: Could not write output file: " << output << std::endl;
+      return 1;
+    }
+  }
 
-  utree u;
+  // Modules importing this one only need rebuilding when the interface
+  // changes.
+  if (result.ok && options.interface) {
+    std::string path = interface_output ? interface_output : OutputPath(filename, "jli");
+    if (! WriteIfChanged(path, result.interface)) {
+      std::cerr << "Error: Could not write output file: " << path << std::endl;
+      return 1;
+    }
+  }
 
-  bool r = boost::spirit::qi::phrase_parse(iter, end, p, s, u);
+  static const char * const kRemarkFlags[] = {"-Rpass", "-Rpass-missed", "-Rpass-analysis"};
+  for (auto & r : result.remarks) {
+    const int kind = static_cast<int>(r.kind);
+    if (! remarks[kind].empty() && std::regex_match(r.pass, remark_patterns[kind]))
+      std::cerr << filename << ":" << r.line << ": remark: " << r.message
+        << " [" << kRemarkFlags[kind] << "=" << r.pass << "]\n";
+  }
 
-  //std::cout << u << "\n";
+  if (emit_ir)
+    ir::Print(std::cout, result.module);
+  if (print_effects)
+    ir::PrintEffects(std::cout, result.module);
 
-  if (!r || iter != end) {
-    std::cerr << "Parsing failed\n";
-    return 1;
+  if (result.ok && (options.lower || options.object || options.link)) {
+    const TailCallStats & t = result.tail_calls;
+    std::cerr << "Tail calls eliminated: " << t.self + t.sibling
+      << " (" << t.self << " self, " << t.sibling << " sibling)\n";
   }
 
-  try {
-    Compiler<Tags<Tag>> compiler(tags);
-    compiler.InstructionBlock(u);
-  } catch (Exception & e) {
-    std::cerr << "Compilation failed: " << e.what() << e.message() << "\n";
-    return 1;
+  if (time_passes) {
+    double total = 0;
+    for (auto i = result.timings.begin() ; i != result.timings.end() ; ++i) {
+      std::cerr << std::setw(8) << i->name << std::fixed << std::setprecision(6)
+        << std::setw(12) << i->seconds << "s" << (i->changed ? "  changed" : "") << "\n";
+      total += i->seconds;
+    }
+    std::cerr << std::setw(8) << "total" << std::setw(12) << total << "s\n";
   }
 
-  return 0;
+  return result.ok ? 0 : 1;
 }
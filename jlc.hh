@@ -0,0 +1,111 @@
+#ifndef JLC_JLC_HH_
+#define JLC_JLC_HH_
+
+#include <string>
+#include <vector>
+
+#include "flat_ast.hh"
+#include "ir.hh"
+#include "pass_manager.hh"
+
+namespace trace {
+class Recorder;
+}
+
+// Library interface of the compiler. Compile keeps all of its state in the
+// call, so any number of compilations may run concurrently in one process.
+namespace jlc {
+
+struct Options {
+  Options() :
+    stream(false), parse_threads(1), keep_unreachable(false), lazy_check(false), lower(false), object(false),
+    link(false), interface(false), trace(0)
+  {
+  }
+
+  // Check one function at a time, see StreamingCompiler.
+  bool stream;
+  // Threads parsing the program, 0 for one per core, see chunk::Parse.
+  // Does not apply to streaming.
+  size_t parse_threads;
+  // Keep the functions main does not reach through calls. They are
+  // dropped otherwise, before lowering and code generation, unless there
+  // is no main or the program's interface is produced.
+  bool keep_unreachable;
+  // Only check the bodies of the functions that are kept, see
+  // keep_unreachable; errors in the others go unreported. Does not apply
+  // to streaming, which checks functions in source order.
+  bool lazy_check;
+  // Translate the checked program to SSA IR and run passes on it. object
+  // and link then emit code from the IR, unless profile_generate asks
+  // for instrumented code, which is generated from the checked program.
+  bool lower;
+  // Comma-separated pass names, e.g. ir::kDefaultPipeline.
+  std::string passes;
+  ir::PassOptions pass_options;
+  // Generate an x86-64 object file, see x86::EmitObject.
+  bool object;
+  // Link the object, the runtime and link_objects into a static
+  // executable, see elf::Link.
+  bool link;
+  // Paths of the objects of other modules, for link.
+  std::vector<std::string> link_objects;
+  // Name of the source file in the object's debugging information.
+  std::string source_file;
+  // Instrument the object file to write its profile to this path. For
+  // whole programs only: every instrumented object defines jlc_profile,
+  // so two of them do not link.
+  std::string profile_generate;
+  // Optimize for the profile read from this path.
+  std::string profile_use;
+  // Interface files of the modules the program calls into, see
+  // interface.hh.
+  std::vector<std::string> imports;
+  // Produce the program's own interface.
+  bool interface;
+  // Where the phases and the functions they work on are timed, if
+  // anywhere, see trace.hh; not owned.
+  trace::Recorder * trace;
+};
+
+struct Diagnostic {
+  enum class Kind {
+    parse_error,
+    compile_error,
+    internal_error,
+  };
+
+  Kind kind;
+  // Kind of compile error, e.g. "UndefinedVariable", see diag::Name.
+  std::string name;
+  int line;
+  std::string message;
+};
+
+struct Result {
+  Result() : ok(false) {}
+
+  bool ok;
+  std::vector<Diagnostic> diagnostics;
+  // The checked program.
+  FlatAST ast;
+  // The optimized IR, if Options::lower was set.
+  ir::Module module;
+  std::vector<ir::PassTiming> timings;
+  // What the passes did to each loop and function, see ir::Remark.
+  std::vector<ir::Remark> remarks;
+  // ELF relocatable object, if Options::object or Options::link was set.
+  std::string object;
+  // The executable, if Options::link was set.
+  std::string executable;
+  // Interface file contents, if Options::interface was set.
+  std::string interface;
+  // Tail calls eliminated by the last backend that ran.
+  TailCallStats tail_calls;
+};
+
+Result Compile(const std::string & source, const Options & options = Options());
+
+}
+
+#endif // JLC_JLC_HH_
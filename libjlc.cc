@@ -0,0 +1,236 @@
+#include "jlc.hh"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+
+#include "parser.hh"
+#include "ast.hh"
+#include "chunk.hh"
+#include "codegen.hh"
+#include "compiler.hh"
+#include "diagnostics.hh"
+#include "interface.hh"
+#include "linker.hh"
+#include "lower.hh"
+#include "pass_manager.hh"
+#include "profile.hh"
+#include "tags.hh"
+#include "stream.hh"
+#include "source_iterator.hh"
+#include "trace.hh"
+
+namespace jlc {
+
+namespace {
+
+typedef SourceIterator iterator_type;
+
+void AddParseError(Result & result, const parser::ParseError & error) {
+  result.diagnostics.push_back(Diagnostic{Diagnostic::Kind::parse_error, "", error.line, error.message});
+}
+
+// Returns true if the checker found no errors.
+bool AddCompileErrors(Result & result, const diag::Sink & sink) {
+  for (auto & r : sink.Records())
+    result.diagnostics.push_back(Diagnostic{Diagnostic::Kind::compile_error, diag::Name(r.kind), r.line, diag::Format(r)});
+  return sink.Empty();
+}
+
+// Checks the functions main reaches through calls, with check(i) for the
+// i-th one, and leaves the others null: main first, then the functions
+// the bodies checked so far call. Unless lazy, or without a main, all of
+// them are checked in order. Each check is a span of trace, if given.
+template <class Check>
+std::vector<std::unique_ptr<Inst>> CheckReachable(Compiler<Tags<Tag>> & compiler, const std::vector<std::string> & names,
+    bool lazy, trace::Recorder * trace, Check check) {
+  std::vector<std::unique_ptr<Inst>> program(names.size());
+  std::unordered_map<std::string, size_t> index;
+  for (size_t i = 0 ; i < names.size() ; ++i)
+    index.insert(std::make_pair(names[i], i));
+  auto main = index.find("main");
+  if (! lazy || main == index.end()) {
+    for (size_t i = 0 ; i < names.size() ; ++i) {
+      trace::Span span(trace, "check", names[i]);
+      program[i] = check(i);
+    }
+    return program;
+  }
+
+  std::vector<bool> queued(names.size(), false);
+  std::vector<size_t> work(1, main->second);
+  queued[main->second] = true;
+  while (! work.empty()) {
+    const size_t i = work.back();
+    work.pop_back();
+    {
+      trace::Span span(trace, "check", names[i]);
+      program[i] = check(i);
+    }
+    for (auto & name : compiler.callees) {
+      auto callee = index.find(name);
+      if (callee != index.end() && ! queued[callee->second]) {
+        queued[callee->second] = true;
+        work.push_back(callee->second);
+      }
+    }
+  }
+  return program;
+}
+
+// Parses the functions of source on threads, see chunk::Parse, and checks
+// each with its own tags swapped in. No tags table holds more than one
+// function, so the size of the program is not limited by them.
+bool CompileProgram(const std::string & source, const std::vector<interface::Function> & imports, size_t threads,
+    bool lazy, trace::Recorder * trace, Result & result) {
+  std::vector<std::unique_ptr<chunk::Function>> functions;
+  parser::ParseError error;
+  bool parsed;
+  {
+    trace::Span span(trace, "phase", "parse");
+    parsed = chunk::Parse(source, threads, functions, error, trace);
+  }
+  if (! parsed) {
+    AddParseError(result, error);
+    return false;
+  }
+
+  trace::Span span(trace, "phase", "check");
+  Tags<Tag> tags;
+  Compiler<Tags<Tag>> compiler(tags);
+  for (auto & f : imports)
+    compiler.Import(f);
+
+  // As InstructionBlock does for the program.
+  compiler.symbols.BeginContext();
+  std::vector<std::string> names;
+  for (auto & f : functions) {
+    tags.tags.swap(f->tags.tags);
+    compiler.FunctionDeclaration(f->tree);
+    names.push_back(compiler.GetSymbol(f->tree[1]));
+    tags.tags.swap(f->tags.tags);
+  }
+  auto program = CheckReachable(compiler, names, lazy, trace, [&](size_t i) {
+    tags.tags.swap(functions[i]->tags.tags);
+    auto fundef = compiler.Instruction(functions[i]->tree);
+    functions[i].reset();
+    return fundef;
+  });
+  compiler.symbols.EndContext();
+
+  if (! AddCompileErrors(result, compiler.diagnostics))
+    return false;
+  for (auto & i : program)
+    if (i)
+      result.ast.AddFunction(dynamic_cast<FunDef &>(*i));
+  return true;
+}
+
+bool CompileStreaming(const std::string & source, const std::vector<interface::Function> & imports,
+    trace::Recorder * trace, Result & result) {
+  trace::Span span(trace, "phase", "parse and check");
+  StreamingCompiler<iterator_type> compiler(trace);
+  const bool parsed = compiler.Run(source, result.ast, imports);
+  const bool checked = AddCompileErrors(result, compiler.diagnostics);
+  if (! parsed)
+    AddParseError(result, compiler.error);
+  return parsed && checked;
+}
+
+std::string ReadObject(const std::string & path) {
+  std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+  if (! in)
+    throw elf::LinkError("cannot read " + path);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// With prune, drops the functions that inlining and specialization left
+// unreachable from main.
+void Optimize(const Options & options, const profile::Profile * profile, bool prune, Result & result) {
+  {
+    trace::Span span(options.trace, "phase", "lower");
+    result.module = ir::Lower(result.ast, &result.tail_calls, options.trace);
+  }
+
+  ir::PassOptions pass_options = options.pass_options;
+  pass_options.profile = profile;
+  pass_options.remarks = &result.remarks;
+  ir::PassManager passes;
+  passes.AddPipeline(options.passes, pass_options);
+  {
+    trace::Span span(options.trace, "phase", "passes");
+    passes.Run(result.module, options.trace);
+    result.timings = passes.Timings();
+  }
+  if (prune) {
+    trace::Span span(options.trace, "phase", "prune");
+    result.module.KeepFunctions(result.module.Reachable("main"));
+  }
+}
+
+}
+
+Result Compile(const std::string & source, const Options & options) {
+  Result result;
+
+  try {
+    std::unique_ptr<profile::Profile> profile;
+    if (! options.profile_use.empty())
+      profile.reset(new profile::Profile(options.profile_use));
+
+    std::vector<interface::Function> imports;
+    for (auto & path : options.imports) {
+      auto functions = interface::Read(path);
+      imports.insert(imports.end(), functions.begin(), functions.end());
+    }
+
+    // A module with an interface is called into by others.
+    const bool prune = ! options.keep_unreachable && ! options.interface;
+    const bool lazy = prune && options.lazy_check;
+    if (options.stream)
+      result.ok = CompileStreaming(source, imports, options.trace, result);
+    else
+      result.ok = CompileProgram(source, imports, options.parse_threads, lazy, options.trace, result);
+    if (result.ok && prune) {
+      trace::Span span(options.trace, "phase", "prune");
+      result.ast.KeepFunctions(result.ast.Reachable("main"));
+    }
+    if (result.ok && options.lower)
+      Optimize(options, profile.get(), prune, result);
+    if (result.ok && (options.object || options.link)) {
+      trace::Span span(options.trace, "phase", "emit");
+      x86::EmitOptions emit;
+      emit.profile_generate = options.profile_generate;
+      emit.profile = profile.get();
+      emit.source_file = options.source_file;
+      emit.trace = options.trace;
+      // Instrumentation needs the checked program, see profile.hh; the
+      // self tail calls of the IR were counted when lowering.
+      if (options.lower && options.profile_generate.empty()) {
+        result.object = x86::EmitObject(result.module, &result.tail_calls, emit);
+      } else {
+        result.tail_calls = TailCallStats();
+        result.object = x86::EmitObject(result.ast, &result.tail_calls, emit);
+      }
+    }
+    if (result.ok && options.link) {
+      trace::Span span(options.trace, "phase", "link");
+      std::vector<std::string> objects = {result.object, elf::RuntimeObject()};
+      for (auto & path : options.link_objects)
+        objects.push_back(ReadObject(path));
+      result.executable = elf::Link(objects);
+    }
+    if (result.ok && options.interface) {
+      trace::Span span(options.trace, "phase", "interface");
+      result.interface = interface::Encode(interface::Exports(result.ast));
+    }
+  } catch (Exception & e) {
+    result.ok = false;
+    result.diagnostics.push_back(Diagnostic{Diagnostic::Kind::internal_error, e.what(), 0, e.message()});
+  }
+
+  return result;
+}
+
+}
@@ -0,0 +1,143 @@
+#include "passes.hh"
+
+#include <algorithm>
+#include <set>
+
+namespace ir {
+
+namespace {
+
+class LICM {
+ public:
+  LICM(Function & function, const std::vector<const Effects *> & callee_effects) :
+    f(function),
+    callees(callee_effects)
+  {
+  }
+
+  bool Run() {
+    bool changed = false;
+    std::set<BlockId> done;
+    // Splitting an edge for a preheader changes the CFG, so the loops are
+    // found again until every header has been handled.
+    for (bool again = true ; again ;) {
+      again = false;
+      auto idom = f.Dominators();
+      for (auto & loop : FindLoops(f, idom)) {
+        if (! done.insert(loop.header).second)
+          continue;
+        bool split = false;
+        BlockId preheader = Preheader(loop, split);
+        if (preheader != kNoBlock)
+          changed |= Hoist(loop, preheader);
+        if (split) {
+          changed = again = true;
+          break;
+        }
+      }
+    }
+    return changed;
+  }
+
+ private:
+  // The block that control enters the loop from, created on the entering
+  // edge if needed. kNoBlock if the loop is entered from several blocks.
+  BlockId Preheader(Loop & loop, bool & split) {
+    BlockId outside = kNoBlock;
+    for (auto p : f.blocks[loop.header].preds) {
+      if (loop.body[p])
+        continue;
+      if (outside != kNoBlock)
+        return kNoBlock;
+      outside = p;
+    }
+    if (outside == kNoBlock)
+      return kNoBlock;
+    if (f.Successors(outside).size() == 1)
+      return outside;
+
+    BlockId b = f.AddBlock();
+    loop.body.push_back(false);
+    Value t = f.Terminator(outside);
+    auto & targets = f.insts[t].targets;
+    *std::find(targets.begin(), targets.end(), loop.header) = b;
+    auto & preds = f.blocks[loop.header].preds;
+    *std::find(preds.begin(), preds.end(), outside) = b;
+    f.blocks[b].preds.push_back(outside);
+    Value br = f.Append(b, Opcode::br, basic_type::void_, f.insts[t].line_pos);
+    f.insts[br].targets.push_back(loop.header);
+    split = true;
+    return b;
+  }
+
+  bool Invariant(const Loop & loop, Value v) const {
+    const Inst & inst = f.insts[v];
+    // A call may only run before the loop's test if it returns whatever
+    // its arguments.
+    if (inst.op == Opcode::call) {
+      const Effects * e = callees[inst.imm];
+      if (! e || ! e->speculatable)
+        return false;
+    } else if (! IsPure(inst.op)) {
+      return false;
+    }
+    // Only divisions that cannot trap may run before the loop's test.
+    if ((inst.op == Opcode::div || inst.op == Opcode::mod) && inst.type != basic_type::double_) {
+      const Inst & d = f.insts[inst.operands[1]];
+      if (d.op != Opcode::const_int || d.imm == 0 || d.imm == -1)
+        return false;
+    }
+    for (auto o : inst.operands)
+      if (loop.body[f.insts[o].block])
+        return false;
+    return true;
+  }
+
+  bool Hoist(const Loop & loop, BlockId preheader) {
+    bool changed = false;
+    for (auto b : f.ReversePostOrder()) {
+      if (! loop.body[b])
+        continue;
+      const auto list = f.blocks[b].insts;
+      for (auto v : list) {
+        if (Invariant(loop, v)) {
+          f.MoveBeforeTerminator(v, preheader);
+          changed = true;
+        }
+      }
+    }
+    return changed;
+  }
+
+  Function & f;
+  const std::vector<const Effects *> & callees;
+};
+
+class LICMPass : public FunctionPass {
+ public:
+  const char * Name() const {
+    return "licm";
+  }
+
+  bool Run(Module & m) {
+    callees = m.CalleeEffects();
+    return FunctionPass::Run(m);
+  }
+
+  bool RunOnFunction(Module &, Function & f) {
+    if (f.blocks.empty())
+      return false;
+    return LICM(f, callees).Run();
+  }
+
+ private:
+  std::vector<const Effects *> callees;
+};
+
+}
+
+std::unique_ptr<Pass> CreateLICMPass() {
+  return std::unique_ptr<Pass>(new LICMPass);
+}
+
+}
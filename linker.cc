@@ -0,0 +1,389 @@
+#include "linker.hh"
+
+#include <elf.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+// Bounds of runtime.o, from runtime_image.S.
+extern "C" const char jlc_runtime_image[];
+extern "C" const char jlc_runtime_image_end[];
+
+namespace elf {
+
+namespace {
+
+const uint64_t kBase = 0x400000;
+const uint64_t kPageSize = 0x1000;
+
+enum Segment {
+  kRead,
+  kExecute,
+  kWrite,
+  kSegments,
+};
+
+// The three loadable segments and the non-executable stack.
+const size_t kProgramHeaders = kSegments + 1;
+
+// A symbol of one of the objects: object and symbol index.
+typedef std::pair<size_t, uint32_t> SymbolRef;
+// Symbols that no object defines.
+const size_t kUndefinedWeak = ~size_t(0);
+const size_t kGlobalOffsetTable = ~size_t(1);
+
+uint64_t Align(uint64_t v, uint64_t alignment) {
+  return alignment > 1 ? (v + alignment - 1) / alignment * alignment : v;
+}
+
+template <class T>
+T Read(const std::string & image, uint64_t offset) {
+  if (offset > image.size() || image.size() - offset < sizeof(T))
+    throw LinkError("truncated object");
+  T v;
+  std::memcpy(&v, image.data() + offset, sizeof(T));
+  return v;
+}
+
+template <class T>
+void Write(std::string & out, uint64_t offset, T v) {
+  std::memcpy(&out[offset], &v, sizeof(T));
+}
+
+bool UsesGot(uint32_t type) {
+  return type == R_X86_64_GOTPCREL || type == R_X86_64_GOTPCRELX || type == R_X86_64_REX_GOTPCRELX;
+}
+
+struct Object {
+  const std::string * image;
+  std::vector<Elf64_Shdr> sections;
+  std::vector<Elf64_Sym> symbols;
+  // Section holding the symbol names.
+  uint32_t strtab;
+  // Where each section goes in the executable, 0 if it is left out.
+  std::vector<uint64_t> address;
+  std::vector<uint64_t> file_offset;
+};
+
+// An allocated section of an object and its offset in its segment.
+struct Placement {
+  size_t object;
+  uint32_t section;
+  uint64_t offset;
+};
+
+class Linker {
+ public:
+  explicit Linker(const std::vector<std::string> & images) : objects(images.size()) {
+    for (size_t k = 0 ; k < images.size() ; ++k)
+      Parse(images[k], objects[k]);
+  }
+
+  std::string Run() {
+    Resolve();
+    Layout();
+    std::string out(file_size, '\0');
+    WriteHeaders(out);
+    for (auto & p : placements) {
+      const Object & o = objects[p.object];
+      const Elf64_Shdr & s = o.sections[p.section];
+      if (s.sh_type == SHT_NOBITS)
+        continue;
+      if (s.sh_offset > o.image->size() || o.image->size() - s.sh_offset < s.sh_size)
+        throw LinkError("truncated object");
+      std::memcpy(&out[o.file_offset[p.section]], o.image->data() + s.sh_offset, s.sh_size);
+    }
+    for (auto & slot : got)
+      Write<uint64_t>(out, got_file_offset + 8 * slot.second, Address(slot.first));
+    for (size_t k = 0 ; k < objects.size() ; ++k)
+      Relocate(out, k);
+    return out;
+  }
+
+ private:
+  void Parse(const std::string & image, Object & o) {
+    const auto header = Read<Elf64_Ehdr>(image, 0);
+    if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_ident[EI_DATA] != ELFDATA2LSB || header.e_type != ET_REL || header.e_machine != EM_X86_64)
+      throw LinkError("not an x86-64 relocatable object");
+    o.image = &image;
+    for (uint16_t i = 0 ; i < header.e_shnum ; ++i)
+      o.sections.push_back(Read<Elf64_Shdr>(image, header.e_shoff + i * sizeof(Elf64_Shdr)));
+    o.strtab = 0;
+    for (auto & s : o.sections) {
+      if (s.sh_type != SHT_SYMTAB)
+        continue;
+      for (uint64_t i = 0 ; i < s.sh_size / sizeof(Elf64_Sym) ; ++i)
+        o.symbols.push_back(Read<Elf64_Sym>(image, s.sh_offset + i * sizeof(Elf64_Sym)));
+      o.strtab = s.sh_link;
+    }
+    o.address.assign(o.sections.size(), 0);
+    o.file_offset.assign(o.sections.size(), 0);
+  }
+
+  std::string Name(const Object & o, const Elf64_Sym & s) const {
+    if (o.strtab >= o.sections.size())
+      throw LinkError("bad symbol table");
+    const Elf64_Shdr & strtab = o.sections[o.strtab];
+    if (s.st_name >= strtab.sh_size || strtab.sh_offset + strtab.sh_size > o.image->size())
+      throw LinkError("bad symbol name");
+    const char * begin = o.image->data() + strtab.sh_offset + s.st_name;
+    return std::string(begin, std::find(begin, o.image->data() + strtab.sh_offset + strtab.sh_size, '\0'));
+  }
+
+  // Picks the definition of each global symbol: the strong one, or the
+  // first weak one.
+  void Resolve() {
+    for (size_t k = 0 ; k < objects.size() ; ++k) {
+      const Object & o = objects[k];
+      for (uint32_t i = 1 ; i < o.symbols.size() ; ++i) {
+        const Elf64_Sym & s = o.symbols[i];
+        if (ELF64_ST_BIND(s.st_info) == STB_LOCAL || s.st_shndx == SHN_UNDEF)
+          continue;
+        const std::string name = Name(o, s);
+        if (s.st_shndx == SHN_COMMON)
+          throw LinkError("common symbol " + name);
+        auto r = globals.insert(std::make_pair(name, SymbolRef(k, i)));
+        if (r.second || ELF64_ST_BIND(s.st_info) == STB_WEAK)
+          continue;
+        const Elf64_Sym & other = Symbol(r.first->second);
+        if (ELF64_ST_BIND(other.st_info) != STB_WEAK)
+          throw LinkError("duplicate symbol " + name);
+        r.first->second = SymbolRef(k, i);
+      }
+    }
+  }
+
+  // Places the allocated sections, the GOT after the read-only ones and
+  // the zero-filled ones at the end, and gives each segment its pages.
+  void Layout() {
+    uint64_t size[kSegments] = {sizeof(Elf64_Ehdr) + kProgramHeaders * sizeof(Elf64_Phdr), 0, 0};
+    std::vector<Placement> bss;
+    std::vector<Segment> segment_of;
+    for (size_t k = 0 ; k < objects.size() ; ++k) {
+      const Object & o = objects[k];
+      for (uint32_t i = 1 ; i < o.sections.size() ; ++i) {
+        const Elf64_Shdr & s = o.sections[i];
+        if (! (s.sh_flags & SHF_ALLOC))
+          continue;
+        if (s.sh_type == SHT_NOBITS) {
+          bss.push_back(Placement{k, i, 0});
+          continue;
+        }
+        const Segment g = s.sh_flags & SHF_EXECINSTR ? kExecute : s.sh_flags & SHF_WRITE ? kWrite : kRead;
+        const uint64_t offset = Align(size[g], s.sh_addralign);
+        size[g] = offset + s.sh_size;
+        placements.push_back(Placement{k, i, offset});
+        segment_of.push_back(g);
+      }
+    }
+
+    for (size_t k = 0 ; k < objects.size() ; ++k) {
+      ForEachRelocation(k, [&](const Elf64_Rela & r) {
+        if (UsesGot(ELF64_R_TYPE(r.r_info)))
+          got.insert(std::make_pair(Lookup(k, ELF64_R_SYM(r.r_info)), got.size()));
+      });
+    }
+    const uint64_t got_offset = Align(size[kRead], 8);
+    size[kRead] = got_offset + 8 * got.size();
+
+    const uint64_t write_file_size = size[kWrite];
+    for (auto & p : bss) {
+      const Elf64_Shdr & s = objects[p.object].sections[p.section];
+      p.offset = Align(size[kWrite], s.sh_addralign);
+      size[kWrite] = p.offset + s.sh_size;
+      placements.push_back(p);
+      segment_of.push_back(kWrite);
+    }
+
+    for (int g = 0 ; g < kSegments ; ++g) {
+      const uint64_t file_offset = g == 0 ? 0 : Align(segments[g - 1].p_offset + segments[g - 1].p_filesz, kPageSize);
+      Elf64_Phdr & p = segments[g];
+      std::memset(&p, 0, sizeof(p));
+      p.p_type = PT_LOAD;
+      p.p_flags = g == kRead ? PF_R : g == kExecute ? PF_R | PF_X : PF_R | PF_W;
+      p.p_offset = file_offset;
+      p.p_vaddr = p.p_paddr = kBase + file_offset;
+      p.p_filesz = g == kWrite ? write_file_size : size[g];
+      p.p_memsz = size[g];
+      p.p_align = kPageSize;
+    }
+    file_size = segments[kWrite].p_offset + segments[kWrite].p_filesz;
+
+    for (size_t j = 0 ; j < placements.size() ; ++j) {
+      const Placement & p = placements[j];
+      objects[p.object].address[p.section] = segments[segment_of[j]].p_vaddr + p.offset;
+      objects[p.object].file_offset[p.section] = segments[segment_of[j]].p_offset + p.offset;
+    }
+    got_address = segments[kRead].p_vaddr + got_offset;
+    got_file_offset = got_offset;
+  }
+
+  // Calls f on the relocations of the allocated sections of object k.
+  template <class F>
+  void ForEachRelocation(size_t k, F f) const {
+    const Object & o = objects[k];
+    for (auto & s : o.sections) {
+      if (s.sh_type == SHT_REL)
+        throw LinkError("relocations without addends");
+      if (s.sh_type != SHT_RELA || s.sh_info >= o.sections.size() || ! (o.sections[s.sh_info].sh_flags & SHF_ALLOC))
+        continue;
+      for (uint64_t i = 0 ; i < s.sh_size / sizeof(Elf64_Rela) ; ++i)
+        f(Read<Elf64_Rela>(*o.image, s.sh_offset + i * sizeof(Elf64_Rela)));
+    }
+  }
+
+  const Elf64_Sym & Symbol(SymbolRef r) const {
+    return objects[r.first].symbols[r.second];
+  }
+
+  // The definition of symbol i of object k.
+  SymbolRef Lookup(size_t k, uint32_t i) const {
+    const Object & o = objects[k];
+    if (i >= o.symbols.size())
+      throw LinkError("bad symbol index");
+    const Elf64_Sym & s = o.symbols[i];
+    if (ELF64_ST_BIND(s.st_info) == STB_LOCAL)
+      return SymbolRef(k, i);
+    const std::string name = Name(o, s);
+    auto d = globals.find(name);
+    if (d != globals.end())
+      return d->second;
+    if (name == "_GLOBAL_OFFSET_TABLE_")
+      return SymbolRef(kGlobalOffsetTable, 0);
+    if (ELF64_ST_BIND(s.st_info) == STB_WEAK)
+      return SymbolRef(kUndefinedWeak, 0);
+    throw LinkError("undefined symbol " + name);
+  }
+
+  uint64_t Address(SymbolRef r) const {
+    if (r.first == kUndefinedWeak)
+      return 0;
+    if (r.first == kGlobalOffsetTable)
+      return got_address;
+    const Object & o = objects[r.first];
+    const Elf64_Sym & s = Symbol(r);
+    if (s.st_shndx == SHN_ABS)
+      return s.st_value;
+    if (s.st_shndx >= o.sections.size() || ! o.address[s.st_shndx])
+      throw LinkError("symbol " + Name(o, s) + " in a section left out");
+    return o.address[s.st_shndx] + s.st_value;
+  }
+
+  void Relocate(std::string & out, size_t k) const {
+    const Object & o = objects[k];
+    for (auto & s : o.sections) {
+      if (s.sh_type != SHT_RELA || s.sh_info >= o.sections.size() || ! o.address[s.sh_info])
+        continue;
+      const Elf64_Shdr & target = o.sections[s.sh_info];
+      for (uint64_t i = 0 ; i < s.sh_size / sizeof(Elf64_Rela) ; ++i) {
+        const auto r = Read<Elf64_Rela>(*o.image, s.sh_offset + i * sizeof(Elf64_Rela));
+        const uint32_t type = ELF64_R_TYPE(r.r_info);
+        if (type == R_X86_64_NONE)
+          continue;
+        const size_t width = type == R_X86_64_64 || type == R_X86_64_PC64 ? 8 : 4;
+        if (target.sh_type == SHT_NOBITS || r.r_offset > target.sh_size || target.sh_size - r.r_offset < width)
+          throw LinkError("relocation outside of its section");
+        const SymbolRef symbol = Lookup(k, ELF64_R_SYM(r.r_info));
+        const uint64_t place = o.address[s.sh_info] + r.r_offset;
+        const uint64_t at = o.file_offset[s.sh_info] + r.r_offset;
+        const uint64_t value = Address(symbol) + r.r_addend;
+        switch (type) {
+          case R_X86_64_64:
+            Write<uint64_t>(out, at, value);
+            break;
+          case R_X86_64_PC64:
+            Write<uint64_t>(out, at, value - place);
+            break;
+          case R_X86_64_PC32:
+          case R_X86_64_PLT32:
+            Write32(out, at, value - place, true);
+            break;
+          case R_X86_64_GOTPCREL:
+          case R_X86_64_GOTPCRELX:
+          case R_X86_64_REX_GOTPCRELX:
+            Write32(out, at, got_address + 8 * got.at(symbol) + r.r_addend - place, true);
+            break;
+          case R_X86_64_GOTPC32:
+            Write32(out, at, got_address + r.r_addend - place, true);
+            break;
+          case R_X86_64_32:
+            Write32(out, at, value, false);
+            break;
+          case R_X86_64_32S:
+            Write32(out, at, value, true);
+            break;
+          default:
+            throw LinkError("unsupported relocation type " + std::to_string(type));
+        }
+      }
+    }
+  }
+
+  void Write32(std::string & out, uint64_t at, uint64_t v, bool is_signed) const {
+    const bool fits = is_signed ? static_cast<int64_t>(v) == static_cast<int32_t>(v) : v == static_cast<uint32_t>(v);
+    if (! fits)
+      throw LinkError("relocation out of range");
+    Write<uint32_t>(out, at, v);
+  }
+
+  void WriteHeaders(std::string & out) const {
+    auto entry = globals.find("_start");
+    if (entry == globals.end())
+      throw LinkError("undefined symbol _start");
+
+    std::vector<Elf64_Phdr> headers;
+    for (auto & p : segments)
+      if (p.p_memsz)
+        headers.push_back(p);
+    Elf64_Phdr stack;
+    std::memset(&stack, 0, sizeof(stack));
+    stack.p_type = PT_GNU_STACK;
+    stack.p_flags = PF_R | PF_W;
+    headers.push_back(stack);
+
+    Elf64_Ehdr header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_EXEC;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_entry = Address(entry->second);
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = headers.size();
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    Write(out, 0, header);
+    for (size_t i = 0 ; i < headers.size() ; ++i)
+      Write(out, sizeof(Elf64_Ehdr) + i * sizeof(Elf64_Phdr), headers[i]);
+  }
+
+  std::vector<Object> objects;
+  std::unordered_map<std::string, SymbolRef> globals;
+  std::vector<Placement> placements;
+  // GOT slot of each symbol referred to through it.
+  std::map<SymbolRef, size_t> got;
+  uint64_t got_address;
+  uint64_t got_file_offset;
+  Elf64_Phdr segments[kSegments];
+  uint64_t file_size;
+};
+
+}
+
+std::string RuntimeObject() {
+  return std::string(jlc_runtime_image, jlc_runtime_image_end);
+}
+
+std::string Link(const std::vector<std::string> & objects) {
+  return Linker(objects).Run();
+}
+
+}
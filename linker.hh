@@ -0,0 +1,33 @@
+#ifndef JLC_LINKER_HH_
+#define JLC_LINKER_HH_
+
+#include <string>
+#include <vector>
+
+#include "exception.hh"
+
+// Static linker for x86-64 ELF relocatable objects, enough for a program
+// and the runtime to become an executable without an external linker.
+namespace elf {
+
+// A symbol is undefined or defined twice, an object is not one this
+// linker reads, or a relocation does not fit.
+struct LinkError : Exception {
+  LinkError(const std::string & message) : Exception(": " + message) {}
+};
+
+// The runtime library, runtime.cc, as the relocatable object built into
+// the compiler.
+std::string RuntimeObject();
+
+// Links objects, given by their contents, into a static executable that
+// starts at _start, as the runtime defines it. The allocated sections go
+// into a read-only, an executable and a writable segment, in that order;
+// others, such as debugging information, are left out. Weak symbols that
+// stay undefined are 0, and references through the GOT get a slot in the
+// read-only segment.
+std::string Link(const std::vector<std::string> & objects);
+
+}
+
+#endif // JLC_LINKER_HH_
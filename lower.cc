@@ -0,0 +1,506 @@
+#include "lower.hh"
+
+#include <unordered_map>
+
+namespace ir {
+
+namespace {
+
+// Builds SSA form directly while walking the AST, following Braun et al.,
+// "Simple and Efficient Construction of Static Single Assignment Form".
+// Variable definitions are tracked per block; reads in blocks whose
+// predecessors are not all known yet create incomplete phis that are
+// completed when the block is sealed.
+class Lowering {
+ public:
+  Lowering(const FlatAST & a, size_t index, Module & module, TailCallStats * stats) :
+    ast(a), m(module), tail_calls(stats), line(0), start(kNoBlock)
+  {
+    m.functions.resize(m.functions.size() + 1);
+    f = &m.functions.back();
+    fun = ast.functions[index];
+    f->name = ast.strings[ast.data[fun]];
+    f->type = ast.type[fun];
+    f->arg_types = ast.function_args[index];
+    f->line_pos = ast.line_pos[fun];
+    var_types.resize(ast.function_vars[index], basic_type::void_);
+    begin = ast.FunctionBegin(index);
+  }
+
+  void Run() {
+    line = f->line_pos;
+    current = NewBlock();
+    Seal(current);
+    for (size_t i = 0 ; i < f->arg_types.size() ; ++i) {
+      var_types[i] = f->arg_types[i];
+      Value v = Emit(Opcode::arg, f->arg_types[i]);
+      f->insts[v].imm = i;
+      WriteVariable(i, current, v);
+    }
+
+    // Self tail calls jump back to a loop header after the arguments; it is
+    // sealed once all of them are known.
+    if (HasSelfTailCall()) {
+      start = NewBlock();
+      Jump(start);
+      current = start;
+    }
+
+    Statement(ast.Child(fun, 0));
+
+    if (! f->Terminated(current))
+      Emit(f->type == basic_type::void_ ? Opcode::ret : Opcode::unreachable, basic_type::void_);
+    if (start != kNoBlock)
+      Seal(start);
+
+    f->RemoveUnreachableBlocks();
+    RemoveTrivialPhis(*f);
+  }
+
+ private:
+  BlockId NewBlock() {
+    BlockId b = f->AddBlock();
+    defs.resize(f->blocks.size());
+    sealed.resize(f->blocks.size(), false);
+    incomplete.resize(f->blocks.size());
+    return b;
+  }
+
+  bool IsSelfTailCall(NodeId ret) const {
+    NodeId call = ast.TailCall(ret);
+    return call != kNoNode && ast.strings[ast.data[call]] == f->name;
+  }
+
+  bool HasSelfTailCall() const {
+    for (NodeId n = begin ; n < fun ; ++n)
+      if (ast.kind[n] == NodeKind::inst_return && IsSelfTailCall(n))
+        return true;
+    return false;
+  }
+
+  // return f(args) in f: rebinds the arguments and loops.
+  void SelfTailCall(NodeId call) {
+    std::vector<Value> args;
+    for (const NodeId * c = ast.ChildrenBegin(call) ; c != ast.ChildrenEnd(call) ; ++c)
+      args.push_back(Expression(*c));
+    for (size_t i = 0 ; i < args.size() ; ++i)
+      WriteVariable(i, current, args[i]);
+    line = ast.line_pos[call];
+    Jump(start);
+    StartUnreachable();
+    if (tail_calls)
+      ++tail_calls->self;
+  }
+
+  Value Emit(Opcode op, Type type) {
+    return f->Append(current, op, type, line);
+  }
+
+  Value Constant(Opcode op, Type type, int64_t imm) {
+    Value v = f->InsertBeforeTerminator(current, op, type, line);
+    f->insts[v].imm = imm;
+    return v;
+  }
+
+  Value Default(BlockId b, Type type) {
+    Value v;
+    if (IsArray(type)) {
+      Value n = f->InsertBeforeTerminator(b, Opcode::const_int, basic_type::int_, line);
+      v = f->InsertBeforeTerminator(b, Opcode::new_array, type, line);
+      f->insts[v].operands.push_back(n);
+      return v;
+    }
+    switch (type) {
+      case basic_type::double_:
+        v = f->InsertBeforeTerminator(b, Opcode::const_double, type, line);
+        break;
+      case basic_type::boolean_:
+        v = f->InsertBeforeTerminator(b, Opcode::const_bool, type, line);
+        break;
+      case basic_type::string_:
+        v = f->InsertBeforeTerminator(b, Opcode::const_string, type, line);
+        f->insts[v].imm = m.AddString("");
+        break;
+      default:
+        v = f->InsertBeforeTerminator(b, Opcode::const_int, type, line);
+        break;
+    }
+    return v;
+  }
+
+  void AddEdge(BlockId target) {
+    f->blocks[target].preds.push_back(current);
+  }
+
+  void Jump(BlockId target) {
+    if (f->Terminated(current))
+      return;
+    Value v = Emit(Opcode::br, basic_type::void_);
+    f->insts[v].targets.push_back(target);
+    AddEdge(target);
+  }
+
+  void Branch(Value cond, BlockId then_block, BlockId else_block) {
+    Value v = Emit(Opcode::cond_br, basic_type::void_);
+    f->insts[v].operands.push_back(cond);
+    f->insts[v].targets = {then_block, else_block};
+    AddEdge(then_block);
+    AddEdge(else_block);
+  }
+
+  // Continues in a fresh block without predecessors, e.g. after a return.
+  void StartUnreachable() {
+    current = NewBlock();
+    Seal(current);
+  }
+
+  Value NewPhi(BlockId b, Type type) {
+    Value v = f->Append(b, Opcode::phi, type, line);
+    auto & list = f->blocks[b].insts;
+    size_t i = list.size() - 1;
+    while (i > 0 && f->insts[list[i - 1]].op != Opcode::phi) {
+      std::swap(list[i - 1], list[i]);
+      --i;
+    }
+    return v;
+  }
+
+  void WriteVariable(int var, BlockId b, Value v) {
+    defs[b][var] = v;
+  }
+
+  Value ReadVariable(int var, BlockId b) {
+    auto i = defs[b].find(var);
+    if (i != defs[b].end())
+      return i->second;
+
+    Value v;
+    const auto & preds = f->blocks[b].preds;
+    if (! sealed[b]) {
+      v = NewPhi(b, var_types[var]);
+      incomplete[b].push_back(std::make_pair(var, v));
+    } else if (preds.size() == 1) {
+      v = ReadVariable(var, preds[0]);
+    } else if (preds.empty()) {
+      // Only unreachable blocks have no predecessors.
+      v = Default(b, var_types[var]);
+    } else {
+      v = NewPhi(b, var_types[var]);
+      WriteVariable(var, b, v);
+      AddPhiOperands(var, v);
+    }
+    WriteVariable(var, b, v);
+    return v;
+  }
+
+  void AddPhiOperands(int var, Value phi) {
+    BlockId b = f->insts[phi].block;
+    for (size_t i = 0 ; i < f->blocks[b].preds.size() ; ++i) {
+      Value v = ReadVariable(var, f->blocks[b].preds[i]);
+      f->insts[phi].operands.push_back(v);
+    }
+  }
+
+  void Seal(BlockId b) {
+    sealed[b] = true;
+    auto pending = std::move(incomplete[b]);
+    for (auto & i : pending)
+      AddPhiOperands(i.first, i.second);
+  }
+
+  void Statement(NodeId n) {
+    if (n == kNoNode)
+      return;
+    line = ast.line_pos[n];
+
+    switch (ast.kind[n]) {
+      case NodeKind::inst_block:
+      case NodeKind::inst_decl:
+        for (const NodeId * c = ast.ChildrenBegin(n) ; c != ast.ChildrenEnd(n) ; ++c)
+          Statement(*c);
+        break;
+      case NodeKind::inst_if:
+        If(n);
+        break;
+      case NodeKind::inst_while:
+        Loop(kNoNode, ast.Child(n, 0), kNoNode, ast.Child(n, 1));
+        break;
+      case NodeKind::inst_for:
+        Loop(ast.Child(n, 0), ast.Child(n, 1), ast.Child(n, 2), ast.Child(n, 3));
+        break;
+      case NodeKind::inst_return: {
+        if (IsSelfTailCall(n)) {
+          SelfTailCall(ast.TailCall(n));
+          break;
+        }
+        NodeId e = ast.Child(n, 0);
+        Value v = e == kNoNode ? kNoValue : Expression(e);
+        line = ast.line_pos[n];
+        Value r = Emit(Opcode::ret, basic_type::void_);
+        if (v != kNoValue)
+          f->insts[r].operands.push_back(v);
+        StartUnreachable();
+        break;
+      }
+      case NodeKind::inst_assign_exp:
+        WriteVariable(ast.data[n], current, Expression(ast.Child(n, 0)));
+        break;
+      case NodeKind::inst_assign_incdec: {
+        const int var = ast.data[n];
+        const Type t = ast.type[n];
+        Value old = ReadVariable(var, current);
+        Value one;
+        if (t == basic_type::double_) {
+          one = Constant(Opcode::const_double, t, 0);
+          f->insts[one].fimm = 1;
+        } else {
+          one = Constant(Opcode::const_int, t, 1);
+        }
+        Value v = Emit(ast.op[n] == op::inc_ ? Opcode::add : Opcode::sub, t);
+        f->insts[v].operands = {old, one};
+        WriteVariable(var, current, v);
+        break;
+      }
+      case NodeKind::inst_assign_index: {
+        Value index = Expression(ast.Child(n, 0));
+        Value value = Expression(ast.Child(n, 1));
+        line = ast.line_pos[n];
+        Value array = ReadVariable(ast.data[n], current);
+        Check(array, index);
+        Value v = Emit(Opcode::store, basic_type::void_);
+        f->insts[v].operands = {array, index, value};
+        break;
+      }
+      case NodeKind::decl_var: {
+        const int var = ast.data[n];
+        var_types[var] = ast.type[n];
+        NodeId init = ast.Child(n, 0);
+        WriteVariable(var, current, init == kNoNode ? Default(current, ast.type[n]) : Expression(init));
+        break;
+      }
+      case NodeKind::inst_exp:
+        Expression(ast.Child(n, 0));
+        break;
+      default:
+        throw CompilerError();
+    }
+  }
+
+  void If(NodeId n) {
+    Value cond = Expression(ast.Child(n, 0));
+    NodeId else_inst = ast.Child(n, 2);
+
+    BlockId then_block = NewBlock();
+    BlockId else_block = else_inst == kNoNode ? kNoBlock : NewBlock();
+    BlockId merge = NewBlock();
+
+    line = ast.line_pos[n];
+    Branch(cond, then_block, else_inst == kNoNode ? merge : else_block);
+    Seal(then_block);
+
+    current = then_block;
+    Statement(ast.Child(n, 1));
+    Jump(merge);
+
+    if (else_inst != kNoNode) {
+      Seal(else_block);
+      current = else_block;
+      Statement(else_inst);
+      Jump(merge);
+    }
+
+    Seal(merge);
+    current = merge;
+  }
+
+  void Loop(NodeId pre, NodeId test, NodeId post, NodeId body) {
+    const int loop_line = line;
+    Statement(pre);
+
+    BlockId header = NewBlock();
+    line = loop_line;
+    Jump(header);
+    current = header;
+
+    Value cond = Expression(test);
+    BlockId body_block = NewBlock();
+    BlockId exit = NewBlock();
+    line = loop_line;
+    Branch(cond, body_block, exit);
+    Seal(body_block);
+
+    current = body_block;
+    Statement(body);
+    Statement(post);
+    line = loop_line;
+    Jump(header);
+
+    Seal(header);
+    Seal(exit);
+    current = exit;
+  }
+
+  Value Expression(NodeId n) {
+    line = ast.line_pos[n];
+    const Type t = ast.type[n];
+
+    switch (ast.kind[n]) {
+      case NodeKind::lit_int:
+        return Constant(Opcode::const_int, t, ast.ints[ast.data[n]]);
+      case NodeKind::lit_double: {
+        Value v = Constant(Opcode::const_double, t, 0);
+        f->insts[v].fimm = ast.doubles[ast.data[n]];
+        return v;
+      }
+      case NodeKind::lit_bool:
+        return Constant(Opcode::const_bool, t, ast.data[n]);
+      case NodeKind::lit_string: {
+        // The parser keeps the quotes of string literals.
+        const std::string & s = ast.strings[ast.data[n]];
+        std::string value = s.size() >= 2 && s[0] == '"' ? s.substr(1, s.size() - 2) : s;
+        return Constant(Opcode::const_string, t, m.AddString(value));
+      }
+      case NodeKind::var_ref:
+        return ReadVariable(ast.data[n], current);
+      case NodeKind::fun_call: {
+        std::vector<Value> args;
+        for (const NodeId * c = ast.ChildrenBegin(n) ; c != ast.ChildrenEnd(n) ; ++c)
+          args.push_back(Expression(*c));
+        line = ast.line_pos[n];
+        Value v = Emit(Opcode::call, t);
+        f->insts[v].imm = m.AddString(ast.strings[ast.data[n]]);
+        f->insts[v].operands = std::move(args);
+        return v;
+      }
+      case NodeKind::unary: {
+        Value e = Expression(ast.Child(n, 0));
+        if (ast.op[n] == op::plus_)
+          return e;
+        line = ast.line_pos[n];
+        Value v = Emit(ast.op[n] == op::not_ ? Opcode::not_ : Opcode::neg, t);
+        f->insts[v].operands.push_back(e);
+        return v;
+      }
+      case NodeKind::array_index: {
+        Value array = Expression(ast.Child(n, 0));
+        Value index = Expression(ast.Child(n, 1));
+        line = ast.line_pos[n];
+        Check(array, index);
+        Value v = Emit(Opcode::load, t);
+        f->insts[v].operands = {array, index};
+        return v;
+      }
+      case NodeKind::array_length: {
+        Value array = Expression(ast.Child(n, 0));
+        line = ast.line_pos[n];
+        Value v = Emit(Opcode::length, t);
+        f->insts[v].operands.push_back(array);
+        return v;
+      }
+      case NodeKind::new_array: {
+        Value length = Expression(ast.Child(n, 0));
+        line = ast.line_pos[n];
+        Value v = Emit(Opcode::new_array, t);
+        f->insts[v].operands.push_back(length);
+        return v;
+      }
+      case NodeKind::binary:
+        if (ast.op[n] == op::and_ || ast.op[n] == op::or_)
+          return ShortCircuit(n);
+        else {
+          Value lhs = Expression(ast.Child(n, 0));
+          Value rhs = Expression(ast.Child(n, 1));
+          line = ast.line_pos[n];
+          Value v = Emit(BinaryOpcode(ast.op[n]), t);
+          f->insts[v].operands = {lhs, rhs};
+          return v;
+        }
+      default:
+        throw CompilerError();
+    }
+  }
+
+  // Bounds check of array[index], which bce removes where it is proven.
+  void Check(Value array, Value index) {
+    Value v = Emit(Opcode::check, basic_type::void_);
+    f->insts[v].operands = {array, index};
+  }
+
+  // a && b and a || b: b is only evaluated when a does not decide the
+  // result, which is merged with a phi.
+  Value ShortCircuit(NodeId n) {
+    const bool is_and = ast.op[n] == op::and_;
+    Value lhs = Expression(ast.Child(n, 0));
+
+    line = ast.line_pos[n];
+    Value decided = Constant(Opcode::const_bool, basic_type::boolean_, ! is_and);
+    BlockId rhs_block = NewBlock();
+    BlockId merge = NewBlock();
+    if (is_and)
+      Branch(lhs, rhs_block, merge);
+    else
+      Branch(lhs, merge, rhs_block);
+    Seal(rhs_block);
+
+    current = rhs_block;
+    Value rhs = Expression(ast.Child(n, 1));
+    line = ast.line_pos[n];
+    Jump(merge);
+
+    Seal(merge);
+    current = merge;
+    Value phi = NewPhi(merge, basic_type::boolean_);
+    f->insts[phi].operands = {decided, rhs};
+    return phi;
+  }
+
+  static Opcode BinaryOpcode(Op o) {
+    switch (o) {
+      case op::mul_: return Opcode::mul;
+      case op::div_: return Opcode::div;
+      case op::mod_: return Opcode::mod;
+      case op::plus_: return Opcode::add;
+      case op::minus_: return Opcode::sub;
+      case op::gt_: return Opcode::gt;
+      case op::gte_: return Opcode::ge;
+      case op::lt_: return Opcode::lt;
+      case op::lte_: return Opcode::le;
+      case op::eq_: return Opcode::eq;
+      case op::neq_: return Opcode::ne;
+    }
+    throw CompilerError();
+  }
+
+  const FlatAST & ast;
+  Module & m;
+  TailCallStats * tail_calls;
+  Function * f;
+  NodeId fun;
+  NodeId begin;
+  int line;
+  // Loop header for self tail calls, or kNoBlock.
+  BlockId start;
+
+  BlockId current;
+  std::vector<Type> var_types;
+  std::vector<std::unordered_map<int, Value>> defs;
+  std::vector<bool> sealed;
+  std::vector<std::vector<std::pair<int, Value>>> incomplete;
+};
+
+}
+
+void LowerFunction(const FlatAST & ast, size_t i, Module & m, TailCallStats * tail_calls) {
+  Lowering(ast, i, m, tail_calls).Run();
+}
+
+Module Lower(const FlatAST & ast, TailCallStats * tail_calls, trace::Recorder * trace) {
+  Module m;
+  for (size_t i = 0 ; i < ast.functions.size() ; ++i) {
+    trace::Span span(trace, "lower", ast.strings[ast.data[ast.functions[i]]]);
+    LowerFunction(ast, i, m, tail_calls);
+  }
+  return m;
+}
+
+}
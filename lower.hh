@@ -0,0 +1,21 @@
+#ifndef JLC_LOWER_HH_
+#define JLC_LOWER_HH_
+
+#include "flat_ast.hh"
+#include "ir.hh"
+#include "trace.hh"
+
+namespace ir {
+
+// Translates the checked program to SSA form, one ir::Function per
+// function in ast.functions and in the same order. Self tail calls become
+// loops and are counted in tail_calls, if given. Each function is a span
+// of trace, if given.
+Module Lower(const FlatAST & ast, TailCallStats * tail_calls = 0, trace::Recorder * trace = 0);
+
+// Lowers the i-th function of ast and appends it to m.
+void LowerFunction(const FlatAST & ast, size_t i, Module & m, TailCallStats * tail_calls = 0);
+
+}
+
+#endif // JLC_LOWER_HH_
@@ -30,19 +30,25 @@ const Op not_ = 14;
 const Op inc_ = 15;
 const Op dec_ = 16;
 
-bool NumericArgs(Op op) {
+// Postfix array operations, a[i] and a.length, and new T[n]; only in the
+// parse tree.
+const Op index_ = 17;
+const Op length_ = 18;
+const Op new_ = 19;
+
+inline bool NumericArgs(Op op) {
   return op <= neq_;
 }
 
-bool BooleanArgs(Op op) {
+inline bool BooleanArgs(Op op) {
   return op >= eq_ && op <= not_;
 }
 
-bool BooleanResult(Op op) {
+inline bool BooleanResult(Op op) {
   return op >= gt_;
 }
 
-bool NumericResult(Op op) {
+inline bool NumericResult(Op op) {
   return op <= minus_;
 }
 
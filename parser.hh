@@ -16,6 +16,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -24,8 +25,8 @@
 #include "ast.hh"
 #include "tags.hh"
 
-#include "keyword.hh"
 #include "save_line_pos.hh"
+#include "scanner.hh"
 
 namespace parser {
 
@@ -59,7 +60,6 @@ struct CopyTag {
   struct result { typedef void type; };
 
   void operator()(utree & from, utree & to) const {
-    //std::cerr << "Copying tag " << from.tag() << " to tag " << to.tag() << "\n";
     to.tag(from.tag());
   }
 };
@@ -80,6 +80,16 @@ struct PushBack {
   }
 };
 
+// T to T[] in a type's utree.
+struct MakeArrayType {
+  template <class>
+  struct result { typedef void type; };
+
+  void operator()(utree & u) const {
+    u = utree(ArrayOf(u.get<int>()));
+  }
+};
+
 struct DropInvalid {
   template <class, class=void, class=void, class=void>
   struct result { typedef void type; };
@@ -90,53 +100,108 @@ struct DropInvalid {
   }
 };
 
+// Where and why the last parse failed.
+struct ParseError {
+  ParseError() : line(0) {}
+
+  std::string message;
+  int line;
+};
+
+struct RecordError {
+  template <class, class, class, class>
+  struct result { typedef void type; };
+
+  template <typename Iterator>
+  void operator()(ParseError & error, const boost::spirit::info & what, Iterator where, Iterator last) const {
+    using boost::spirit::get_line;
+
+    Iterator eol = where;
+    while (eol != last && *eol != '\n' && *eol != '\r')
+      ++eol;
+
+    std::ostringstream ss;
+    ss << "Expecting " << what << " here: \"" << std::string(where, eol) << "\"";
+    error.message = ss.str();
+    error.line = get_line(where);
+  }
+};
+
 template <typename Iterator>
 class JavaletteSkipper : public qi::grammar<Iterator> {
  public:
-  JavaletteSkipper() : JavaletteSkipper::base_type(start)
+  JavaletteSkipper() :
+    JavaletteSkipper::base_type(start),
+    unterminated_comment(false)
   {
     using namespace boost::spirit::qi;
     using boost::phoenix::val;
 
     start =
-      space
-      | (lit("//")|lit("#")) >> *(char_ - eol) >> -eol
-      | ("/*" >> *(char_ - "*/") > "*/")
+      space_run
+      | (lit("//")|lit("#")) >> line_rest >> -eol
+      | (lit("/*") >> comment_rest > "*/")
       ;
     on_error<rethrow> (
         start,
-        std::cout
-          << val("Error! Unterminated /* comment\n")
-          << std::endl
+        boost::phoenix::ref(unterminated_comment) = true
     );
   }
 
   qi::rule<Iterator, unused_type> start;
+
+  // Set when a /* comment runs to the end of the input.
+  bool unterminated_comment;
+
+ private:
+  scanner::SpaceRun space_run;
+  scanner::LineRest line_rest;
+  scanner::CommentRest comment_rest;
 };
 
 
+// What a single phrase_parse call with the grammar consumes: the whole
+// program, one function definition, or just a function signature (return
+// type, name and argument list, without the body).
+enum class ParseUnit {
+  program,
+  function,
+  signature,
+};
+
 template <class Iterator, class Tags>
 class JavaletteParser : public qi::grammar<Iterator, utree(), JavaletteSkipper<Iterator>> {
  public:
-  JavaletteParser(Tags & t);
+  JavaletteParser(Tags & t, ParseUnit unit = ParseUnit::program);
+
+  // Filled in when a parse fails.
+  ParseError error;
 
  private:
   const boost::phoenix::function<Uprooter> up;
   const boost::phoenix::function<CopyTag> copy_tag;
   const boost::phoenix::function<PushBack> pb;
   const boost::phoenix::function<DropInvalid> di;
+  const boost::phoenix::function<MakeArrayType> array_of;
+  const boost::phoenix::function<RecordError> record_error;
 
   SaveLinePos<Iterator, Tags> pos;
   const boost::phoenix::function<CopyLinePos<Tags>> copy_pos;
   const boost::phoenix::function<CodeTagger<Tags>> code_tag;
 
   typedef JavaletteSkipper<Iterator> Skipper;
-  TypeSymbols types;
+
+  typedef boost::proto::terminal<scanner::KeywordParser>::type KeywordTerminal;
+  typedef boost::proto::terminal<scanner::TypeNameParser>::type TypeNameTerminal;
+  scanner::WordClassifier words;
+  const KeywordTerminal kw_if, kw_else, kw_while, kw_for, kw_return, kw_new;
+  const TypeNameTerminal type_name;
 
   qi::rule<Iterator, utf8_symbol_type()> id;
-  qi::rule<Iterator, utree()> type;
+  qi::rule<Iterator, utree(), Skipper> type;
   qi::rule<Iterator, utree()> literal;
   qi::rule<Iterator, utf8_string_type()> literal_string;
+  scanner::StringRest string_rest;
 
   OpAndSymbols op_and;
   OpOrSymbols op_or;
@@ -149,10 +214,8 @@ class JavaletteParser : public qi::grammar<Iterator, utree(), JavaletteSkipper<I
 
   typedef qi::rule<Iterator, utree::list_type(), Skipper> ListRule;
 
-  qi::rule<Iterator, utf8_symbol_type(std::string)> symbol;
-
   qi::rule<Iterator, utree(), Skipper> start;
-  qi::rule<Iterator, utree(), Skipper> fundecl;
+  qi::rule<Iterator, utree(), Skipper> fundecl, fundef;
   ListRule arglist;
 
   qi::rule<Iterator, utree::list_type(), Skipper> inst;
@@ -162,11 +225,20 @@ class JavaletteParser : public qi::grammar<Iterator, utree(), JavaletteSkipper<I
   qi::rule<Iterator, utree(), Skipper> inst_assign;
 
   ListRule exp, explist, exp_or, exp_and, exp_equality, exp_relational,
-    exp_additive, exp_multiplicative, exp_unary;
+    exp_additive, exp_multiplicative, exp_unary, exp_postfix;
   qi::rule<Iterator, utree::list_type(), Skipper> exp_primary;
   qi::rule<Iterator, utree(), Skipper> funcall;
 };
 
+// The error of the last failed parse with p and s.
+template <class Iterator, class Tags>
+ParseError LastError(const JavaletteParser<Iterator, Tags> & p, const JavaletteSkipper<Iterator> & s) {
+  ParseError error = p.error;
+  if (s.unterminated_comment)
+    error.message = "Unterminated /* comment";
+  return error;
+}
+
 template <class T>
 utree::list_type & operator+=(utree::list_type & u, const T & a) {
   u.push_back(a);
@@ -174,11 +246,18 @@ utree::list_type & operator+=(utree::list_type & u, const T & a) {
 }
 
 template <class Iterator, class Tags>
-JavaletteParser<Iterator, Tags>::JavaletteParser(Tags & t) :
+JavaletteParser<Iterator, Tags>::JavaletteParser(Tags & t, ParseUnit unit) :
   JavaletteParser::base_type(start, "javalette"),
   pos(t),
   copy_pos(CopyLinePos<Tags>(t)),
-  code_tag(CodeTagger<Tags>(t))
+  code_tag(CodeTagger<Tags>(t)),
+  kw_if(KeywordTerminal::make(scanner::KeywordParser(words, reserved::if_))),
+  kw_else(KeywordTerminal::make(scanner::KeywordParser(words, reserved::else_))),
+  kw_while(KeywordTerminal::make(scanner::KeywordParser(words, reserved::while_))),
+  kw_for(KeywordTerminal::make(scanner::KeywordParser(words, reserved::for_))),
+  kw_return(KeywordTerminal::make(scanner::KeywordParser(words, reserved::return_))),
+  kw_new(KeywordTerminal::make(scanner::KeywordParser(words, reserved::new_))),
+  type_name(TypeNameTerminal::make(scanner::TypeNameParser(words)))
 {
   using namespace boost::spirit;
   using namespace boost::spirit::qi;
@@ -190,22 +269,31 @@ JavaletteParser<Iterator, Tags>::JavaletteParser(Tags & t) :
   using phoenix::val;
   using phoenix::construct;
   using phoenix::push_back;
-  using distinct::keyword;
 
   typedef as<utf8_symbol_type> as_symbol_type;
   as_symbol_type const as_symbol = as_symbol_type();
 
-  start %= +(fundecl[code_tag(_1, CodeTag::fun_decl)]);
+  switch (unit) {
+    case ParseUnit::program:
+      start %= +(fundecl[code_tag(_1, CodeTag::fun_decl)]);
+      break;
+    case ParseUnit::function:
+      start %= fundecl[code_tag(_1, CodeTag::fun_decl)];
+      break;
+    case ParseUnit::signature:
+      start = type > id > '(' > arglist > ')';
+      break;
+  }
 
   real_parser<double, strict_real_policies<double>> strict_double;
 
   id = as_symbol[raw[alpha >> *(alnum | '_')]];
   literal = strict_double | int_ | bool_ | literal_string;
-  literal_string = raw['"' > *(char_ - '"') > '"'];
-  type = keyword[val(types)];
-  symbol = keyword[string(_r1)];
+  literal_string = raw[lit('"') > string_rest > '"'];
+  type = type_name[_val = _1] >> -(lit('[') >> ']')[array_of(_val)];
 
-  fundecl = type > id > '(' > arglist > ')' > inst_block;
+  fundecl = pos(_val) >> fundef[copy_tag(_val, _1), _val = _1];
+  fundef = type > id > '(' > arglist > ')' > inst_block;
   arglist = -((type > id) % ',');
 
   inst =
@@ -227,18 +315,22 @@ JavaletteParser<Iterator, Tags>::JavaletteParser(Tags & t) :
   decl %= as_symbol[id] > -(as_symbol["="] > exp)[pb(_val, _1, _2)] > eps[di(_val)];
   inst_assign = assign[_val = _1] > ';';
 
+  // a = e, a++ and a[i] = e.
   assign =
     pos(_val) >> id[pb(_val, _1)] >>
       ( (as_symbol[val("=")][pb(_val, _1)] > &(char_ - '=') > exp[pb(_val, _1)])
         | op_incdec[pb(_val, _1)]
+        | ( '[' >> exp[pb(_val, _1)] >> ']' >> as_symbol[val("=")][pb(_val, _1)]
+            > &(char_ - '=') > exp[pb(_val, _1)]
+          )
       )
     ;
 
-  inst_if %= symbol(val("if")) > '(' > exp > ')' > inst
-    > -(symbol(val("else")) > inst)[pb(_val, _1, _2)] > eps[di(_val)];
-  inst_while %= symbol(val("while")) > '(' > exp > ')' > inst;
-  inst_for %= symbol(val("for")) > '(' > assign > ';' > exp > ';' > assign > ')' > inst;
-  inst_ret %= symbol(val("return")) > -exp > ';' > eps[di(_val)];
+  inst_if %= kw_if > '(' > exp > ')' > inst
+    > -(kw_else > inst)[pb(_val, _1, _2)] > eps[di(_val)];
+  inst_while %= kw_while > '(' > exp > ')' > inst;
+  inst_for %= kw_for > '(' > assign > ';' > exp > ';' > assign > ')' > inst;
+  inst_ret %= kw_return > -exp > ';' > eps[di(_val)];
   inst_exp = exp[_val = _1] > ';';
 
   auto exp_binary = [&up, &copy_pos](const ListRule & subrule, qi::symbols<char, Op> & op) {
@@ -267,7 +359,7 @@ JavaletteParser<Iterator, Tags>::JavaletteParser(Tags & t) :
 
   exp_unary =
     ( -op_unary[pb(_val, _1)]
-      >> exp_primary
+      >> exp_postfix
     )[if_(_1)[
       pb(_val, _2), copy_pos(_val[1], _val)
      ].else_[
@@ -275,11 +367,21 @@ JavaletteParser<Iterator, Tags>::JavaletteParser(Tags & t) :
      ]]
     ;
 
+  // a[i] is [a, index_, i] and a.length is [a, length_].
+  exp_postfix =
+    exp_primary[_val = _1] >>
+    *( ('[' > exp[up(_val, val(op::index_), _1)] > ']')[copy_pos(_val[0], _val)]
+     | (lit('.') > lit("length") > !(alnum | '_'))[up(_val, val(op::length_))][copy_pos(_val[0], _val)]
+     )
+    ;
+
+  // new T[n] is [new_, T, n].
   exp_primary =
     pos(_val) >>
     ( ( funcall    [copy_tag(_val, _1), _val = _1]
       | ('(' > exp [copy_tag(_val, _1), _val = _1] > ')')
       )
+    | (omit[kw_new] > type_name > '[' > exp > ']')[pb(_val, val(op::new_)), pb(_val, _1, _2)]
     | literal  [pb(_val, _1)]
     | id       [pb(_val, _1)]
     )
@@ -305,17 +407,12 @@ JavaletteParser<Iterator, Tags>::JavaletteParser(Tags & t) :
   exp_additive.name("additive-expression");
   exp_multiplicative.name("multiplicative-expression");
   exp_unary.name("unary-expression");
+  exp_postfix.name("postfix-expression");
   exp_primary.name("primary-expression");
 
   on_error<fail> (
       start,
-      std::cout
-      << val("Error! Expecting ")
-      << _4
-      << val(" here: \"")
-      << construct<std::string>(_3, _2)   // iterators to error-pos, end
-      << val("\"")
-      << std::endl
+      record_error(ref(error), _4, _3, _2)   // iterators to error-pos, end
   );
 }
 }
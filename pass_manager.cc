@@ -0,0 +1,68 @@
+#include "pass_manager.hh"
+
+#include <chrono>
+
+#include "exception.hh"
+#include "passes.hh"
+
+namespace ir {
+
+const char * const kDefaultPipeline = "inline,specialize,effects,sccp,gvn,licm,dce,bce,unroll,dce";
+const int kDefaultInlineThreshold = 40;
+
+std::unique_ptr<Pass> CreatePass(const std::string & name, const PassOptions & options) {
+  if (name == "inline")
+    return CreateInlinePass(options.inline_threshold, options.profile);
+  if (name == "sccp")
+    return CreateSCCPPass();
+  if (name == "gvn")
+    return CreateGVNPass();
+  if (name == "dce")
+    return CreateDCEPass();
+  if (name == "licm")
+    return CreateLICMPass();
+  if (name == "specialize")
+    return CreateSpecializePass(options.remarks);
+  if (name == "effects")
+    return CreateEffectsPass();
+  if (name == "unroll")
+    return CreateUnrollPass(options.remarks);
+  if (name == "bce")
+    return CreateBCEPass(options.remarks);
+  return std::unique_ptr<Pass>();
+}
+
+void PassManager::Add(std::unique_ptr<Pass> pass) {
+  passes.push_back(std::move(pass));
+}
+
+void PassManager::AddPipeline(const std::string & pipeline, const PassOptions & options) {
+  size_t begin = 0;
+  while (begin < pipeline.size()) {
+    size_t end = pipeline.find(',', begin);
+    if (end == std::string::npos)
+      end = pipeline.size();
+    std::string name = pipeline.substr(begin, end - begin);
+    if (! name.empty()) {
+      auto pass = CreatePass(name, options);
+      if (! pass)
+        throw UnknownPass(name);
+      Add(std::move(pass));
+    }
+    begin = end + 1;
+  }
+}
+
+void PassManager::Run(Module & m, trace::Recorder * trace) {
+  typedef std::chrono::steady_clock clock;
+
+  for (auto & pass : passes) {
+    trace::Span span(trace, "pass", pass->Name());
+    auto start = clock::now();
+    bool changed = pass->Run(m);
+    std::chrono::duration<double> elapsed = clock::now() - start;
+    timings.push_back(PassTiming{pass->Name(), elapsed.count(), changed});
+  }
+}
+
+}
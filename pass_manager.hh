@@ -0,0 +1,103 @@
+#ifndef JLC_PASS_MANAGER_HH_
+#define JLC_PASS_MANAGER_HH_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ir.hh"
+#include "trace.hh"
+
+namespace profile {
+class Profile;
+}
+
+namespace ir {
+
+class Pass {
+ public:
+  virtual ~Pass() {}
+
+  virtual const char * Name() const = 0;
+  // Returns true if the module changed.
+  virtual bool Run(Module & m) = 0;
+};
+
+// A pass that transforms each function independently.
+class FunctionPass : public Pass {
+ public:
+  bool Run(Module & m) {
+    bool changed = false;
+    for (auto & f : m.functions)
+      changed |= RunOnFunction(m, f);
+    return changed;
+  }
+
+  virtual bool RunOnFunction(Module & m, Function & f) = 0;
+};
+
+// The passes run by -O, before native code is generated from the IR.
+extern const char * const kDefaultPipeline;
+extern const int kDefaultInlineThreshold;
+
+// What a pass did or did not do to a piece of source, like clang's
+// -Rpass, -Rpass-missed and -Rpass-analysis remarks.
+struct Remark {
+  enum class Kind {
+    passed,
+    missed,
+    analysis,
+  };
+
+  Kind kind;
+  std::string pass;
+  std::string function;
+  int line;
+  std::string message;
+};
+
+// Tuning of the passes created by name.
+struct PassOptions {
+  PassOptions() : inline_threshold(kDefaultInlineThreshold), profile(0), remarks(0) {}
+
+  // Largest cost of a call site that is inlined, see CreateInlinePass.
+  int inline_threshold;
+  // Execution profile of the program, if any; not owned.
+  const profile::Profile * profile;
+  // Where passes that explain themselves add their remarks, if anywhere;
+  // not owned.
+  std::vector<Remark> * remarks;
+};
+
+struct PassTiming {
+  std::string name;
+  double seconds;
+  bool changed;
+};
+
+// Runs a pipeline of passes in order and records how long each one took.
+class PassManager {
+ public:
+  void Add(std::unique_ptr<Pass> pass);
+  // Adds the passes of a comma-separated list of pass names. Throws
+  // UnknownPass for names that are not registered.
+  void AddPipeline(const std::string & pipeline, const PassOptions & options = PassOptions());
+
+  // Each pass is a span of trace, if given.
+  void Run(Module & m, trace::Recorder * trace = 0);
+
+  const std::vector<PassTiming> & Timings() const {
+    return timings;
+  }
+
+ private:
+  std::vector<std::unique_ptr<Pass>> passes;
+  std::vector<PassTiming> timings;
+};
+
+// The pass registered as name, or a null pointer.
+std::unique_ptr<Pass> CreatePass(const std::string & name, const PassOptions & options = PassOptions());
+
+}
+
+#endif // JLC_PASS_MANAGER_HH_
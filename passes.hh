@@ -0,0 +1,74 @@
+#ifndef JLC_PASSES_HH_
+#define JLC_PASSES_HH_
+
+#include <memory>
+
+#include "pass_manager.hh"
+
+namespace ir {
+
+// Sparse conditional constant propagation (Wegman and Zadeck). Folds
+// constant values and branches and drops the blocks that become dead.
+std::unique_ptr<Pass> CreateSCCPPass();
+// The same on one function, for passes that simplify code they create.
+bool PropagateConstants(Function & f);
+
+// Dominator-based global value numbering. Replaces pure instructions that
+// recompute a value available in a dominating block.
+std::unique_ptr<Pass> CreateGVNPass();
+
+// Dead code elimination: removes instructions whose results are unused
+// and that have no side effects, and unreachable blocks. Straight-line
+// chains of blocks are merged.
+std::unique_ptr<Pass> CreateDCEPass();
+
+// Loop-invariant code motion: hoists pure computations whose operands are
+// defined outside a loop into the loop's preheader.
+std::unique_ptr<Pass> CreateLICMPass();
+
+// Unrolls counted loops (see FindCountedLoop) whose body is one block and
+// whose trip count is a constant, by the largest factor up to 8 that
+// divides the trip count and keeps the body small. int sum and product
+// reductions in the unrolled body are then split over one accumulator
+// per copy, combined after the loop, so that the copies do not wait on
+// each other; double reductions are left alone, as reassociating them
+// would change their rounding. Reports each loop in remarks, if given.
+std::unique_ptr<Pass> CreateUnrollPass(std::vector<Remark> * remarks = 0);
+
+// Bounds check elimination: removes the checks of a[i] where i is the
+// induction variable of a counted loop (see FindCountedLoop) that keeps it
+// within [0, a.length), counting up by one from a non-negative start while
+// i < a.length, or down by one from below a.length while i >= 0. Lengths
+// are known from a.length and from new T[n]. Reports each loop with
+// checks on its variable in remarks, if given.
+std::unique_ptr<Pass> CreateBCEPass(std::vector<Remark> * remarks = 0);
+
+// Clones functions for the constant arguments of their call sites, folds
+// the constants into the clone and points the calls at it, when the clone
+// saves enough instructions per call, weighted up for calls in loops, for
+// its size. Callees are cloned at most 4 times and the clones may grow
+// the module by half. Calls in a clone with the same constants call the
+// clone. Reports each decision in remarks, if given.
+std::unique_ptr<Pass> CreateSpecializePass(std::vector<Remark> * remarks = 0);
+
+// Infers the Effects of each function over the call graph, bottom-up.
+// Calls to functions the module does not define, such as printInt, have
+// side effects. GVN then merges equal calls to readnone functions, and
+// LICM hoists and DCE removes calls to speculatable ones.
+std::unique_ptr<Pass> CreateEffectsPass();
+
+// Inliner over the whole program. Functions are visited bottom-up over the
+// strongly connected components of the call graph, so callees are inlined
+// into before their callers. A call site is inlined when the callee's size,
+// less the call overhead and bonuses for constant arguments and for calls
+// inside loops, is at most threshold. Self calls are never inlined and a
+// recursive function is inlined at most once along a chain of inlined
+// calls. Inlined instructions keep their source lines.
+//
+// With a profile, calls to functions that never ran are left alone and
+// calls to hot functions get a further bonus.
+std::unique_ptr<Pass> CreateInlinePass(int threshold, const profile::Profile * profile = 0);
+
+}
+
+#endif // JLC_PASSES_HH_
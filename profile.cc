@@ -0,0 +1,158 @@
+#include "profile.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+#include "exception.hh"
+
+namespace profile {
+
+namespace {
+
+void PutUleb(std::string & out, uint64_t v) {
+  do {
+    uint8_t b = v & 0x7F;
+    v >>= 7;
+    out.push_back(static_cast<char>(v ? b | 0x80 : b));
+  } while (v);
+}
+
+class Reader {
+ public:
+  Reader(const std::string & d, const std::string & p) : data(d), path(p), pos(0) {}
+
+  uint64_t U64() {
+    Need(8);
+    uint64_t v;
+    std::memcpy(&v, &data[pos], 8);
+    pos += 8;
+    return v;
+  }
+
+  uint64_t Uleb() {
+    uint64_t v = 0;
+    for (int shift = 0 ; shift < 64 ; shift += 7) {
+      Need(1);
+      uint8_t b = data[pos++];
+      v |= uint64_t(b & 0x7F) << shift;
+      if (! (b & 0x80))
+        return v;
+    }
+    throw BadProfile(path);
+  }
+
+  // A number of items that each take at least a byte.
+  uint64_t Count() {
+    uint64_t n = Uleb();
+    Need(n);
+    return n;
+  }
+
+  std::string Bytes(uint64_t n) {
+    Need(n);
+    pos += n;
+    return data.substr(pos - n, n);
+  }
+
+  void Need(uint64_t n) const {
+    if (data.size() - pos < n)
+      throw BadProfile(path);
+  }
+
+  size_t Position() const {
+    return pos;
+  }
+
+ private:
+  const std::string & data;
+  const std::string & path;
+  size_t pos;
+};
+
+}
+
+uint32_t Keys::Add(const Key & key) {
+  keys.push_back(key);
+  return keys.size() - 1;
+}
+
+// Function names once, then per key: function index, line, node and kind.
+std::string Keys::Encode() const {
+  std::unordered_map<std::string, uint64_t> names;
+  std::string table, records;
+  for (auto & k : keys) {
+    auto n = names.find(k.function);
+    if (n == names.end()) {
+      n = names.insert(std::make_pair(k.function, names.size())).first;
+      PutUleb(table, k.function.size());
+      table += k.function;
+    }
+    PutUleb(records, n->second);
+    PutUleb(records, k.line);
+    PutUleb(records, k.node);
+    records.push_back(static_cast<char>(k.kind));
+  }
+  std::string out;
+  PutUleb(out, names.size());
+  return out + table + records;
+}
+
+Profile::Profile(const std::string & path) : max_entries(0) {
+  std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+  if (! in)
+    throw BadProfile(path);
+  const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  Reader r(data, path);
+  if (r.Bytes(sizeof(kMagic) - 1) != kMagic)
+    throw BadProfile(path);
+  const uint64_t count = r.U64();
+  const uint64_t keys_size = r.U64();
+  r.Need(keys_size);
+  const size_t keys_end = r.Position() + keys_size;
+
+  std::vector<std::string> functions(r.Count());
+  for (auto & f : functions)
+    f = r.Bytes(r.Uleb());
+  std::vector<Key> keys;
+  for (uint64_t i = 0 ; i < count ; ++i) {
+    Key k;
+    uint64_t f = r.Uleb();
+    if (f >= functions.size())
+      throw BadProfile(path);
+    k.function = functions[f];
+    k.line = r.Uleb();
+    k.node = r.Uleb();
+    uint8_t kind = r.Bytes(1)[0];
+    if (kind > static_cast<uint8_t>(Counter::body))
+      throw BadProfile(path);
+    k.kind = static_cast<Counter>(kind);
+    keys.push_back(k);
+  }
+  if (r.Position() != keys_end)
+    throw BadProfile(path);
+
+  for (auto & k : keys) {
+    uint64_t c = r.U64();
+    counts[k] += c;
+    if (k.kind == Counter::entry) {
+      entries[k.function] += c;
+      max_entries = std::max(max_entries, entries[k.function]);
+    }
+  }
+}
+
+uint64_t Profile::Count(const Key & key) const {
+  auto i = counts.find(key);
+  return i == counts.end() ? 0 : i->second;
+}
+
+uint64_t Profile::Entries(const std::string & function) const {
+  auto i = entries.find(function);
+  return i == entries.end() ? 0 : i->second;
+}
+
+}
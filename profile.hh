@@ -0,0 +1,91 @@
+#ifndef JLC_PROFILE_HH_
+#define JLC_PROFILE_HH_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Execution profiles for profile-guided optimization.
+//
+// An instrumented program (jlc -c --profile-generate) counts how often
+// functions, if statements, then branches, loops and loop bodies run. The
+// counters live in the object's data section behind the symbol
+// jlc_profile, laid out as
+//
+//   uint64_t count, keys_size, path_size;
+//   uint64_t counters[count];
+//   char keys[keys_size];      // Keys::Encode
+//   char path[path_size];      // NUL-terminated
+//
+// and the runtime library writes them to path at exit as
+//
+//   "JLCPROF1" uint64_t count, keys_size; keys; counters
+//
+// Counters are keyed by function, line and the node's position within its
+// function in the FlatAST, so a profile matches the program it was
+// generated from.
+namespace profile {
+
+enum class Counter : uint8_t {
+  entry, // function entries
+  if_,   // if statements run
+  then_, // then branches taken
+  loop,  // loops entered
+  body,  // loop iterations
+};
+
+struct Key {
+  std::string function;
+  int line;
+  uint32_t node; // relative to the function's first node
+  Counter kind;
+
+  bool operator<(const Key & other) const {
+    return std::tie(function, line, node, kind) < std::tie(other.function, other.line, other.node, other.kind);
+  }
+};
+
+// Assigns counter indices to keys and encodes them for the object file.
+class Keys {
+ public:
+  uint32_t Add(const Key & key);
+
+  size_t size() const {
+    return keys.size();
+  }
+
+  std::string Encode() const;
+
+ private:
+  std::vector<Key> keys;
+};
+
+const char kMagic[] = "JLCPROF1";
+
+class Profile {
+ public:
+  // Reads a profile written by an instrumented program. Throws BadProfile.
+  explicit Profile(const std::string & path);
+
+  // The count of key, 0 if the profile does not have it.
+  uint64_t Count(const Key & key) const;
+
+  // Entries into function, 0 if it never ran or is not in the profile.
+  uint64_t Entries(const std::string & function) const;
+
+  // The most entries of any function.
+  uint64_t MaxEntries() const {
+    return max_entries;
+  }
+
+ private:
+  std::map<Key, uint64_t> counts;
+  std::map<std::string, uint64_t> entries;
+  uint64_t max_entries;
+};
+
+}
+
+#endif // JLC_PROFILE_HH_
@@ -0,0 +1,56 @@
+#ifndef JLC_QUEUE_HH_
+#define JLC_QUEUE_HH_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Fixed-capacity FIFO connecting a producer and a consumer thread. Push
+// blocks while the queue is full, Pop blocks while it is empty. Close wakes
+// up both sides: later pushes are dropped and Pop drains what is left.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) :
+    capacity(capacity), closed(false)
+  {
+  }
+
+  bool Push(T && t) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+    if (closed)
+      return false;
+    items.push_back(std::move(t));
+    not_empty.notify_one();
+    return true;
+  }
+
+  bool Pop(T & t) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this] { return closed || ! items.empty(); });
+    if (items.empty())
+      return false;
+    t = std::move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+
+ private:
+  const size_t capacity;
+  bool closed;
+  std::deque<T> items;
+  std::mutex mutex;
+  std::condition_variable not_full, not_empty;
+};
+
+#endif // JLC_QUEUE_HH_
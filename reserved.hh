@@ -0,0 +1,114 @@
+#ifndef JLC_RESERVED_HH_
+#define JLC_RESERVED_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "types.hh"
+
+// Reserved words: keywords and basic type names. They are
+// recognized with a perfect hash computed at compile time, so classifying
+// an identifier costs one hash and one string compare.
+namespace reserved {
+
+enum class Kind : unsigned char {
+  keyword,
+  type,
+};
+
+enum Keyword {
+  if_ = 1,
+  else_,
+  while_,
+  for_,
+  return_,
+  new_,
+};
+
+struct Word {
+  const char * name;
+  Kind kind;
+  int value; // Keyword for keywords, Type for type names
+};
+
+// To reserve another word, add it here; the hash adapts on its own.
+constexpr Word kWords[] = {
+  {"if", Kind::keyword, if_},
+  {"else", Kind::keyword, else_},
+  {"while", Kind::keyword, while_},
+  {"for", Kind::keyword, for_},
+  {"return", Kind::keyword, return_},
+  {"new", Kind::keyword, new_},
+  {"void", Kind::type, basic_type::void_},
+  {"int", Kind::type, basic_type::int_},
+  {"double", Kind::type, basic_type::double_},
+  {"boolean", Kind::type, basic_type::boolean_},
+};
+
+constexpr size_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+constexpr size_t SlotCount() {
+  size_t n = 1;
+  while (n < 4 * kWordCount)
+    n *= 2;
+  return n;
+}
+
+constexpr size_t kSlots = SlotCount();
+
+constexpr size_t Length(const char * s) {
+  size_t n = 0;
+  while (s[n])
+    ++n;
+  return n;
+}
+
+constexpr uint32_t Hash(const char * s, size_t n, uint32_t seed) {
+  uint32_t h = seed;
+  for (size_t i = 0 ; i < n ; ++i)
+    h = (h ^ static_cast<unsigned char>(s[i])) * 16777619u;
+  return (h ^ (h >> 15)) & (kSlots - 1);
+}
+
+struct Table {
+  uint32_t seed;
+  signed char slots[kSlots];
+};
+
+constexpr bool Fill(Table & table) {
+  for (size_t i = 0 ; i < kSlots ; ++i)
+    table.slots[i] = -1;
+  for (size_t i = 0 ; i < kWordCount ; ++i) {
+    uint32_t slot = Hash(kWords[i].name, Length(kWords[i].name), table.seed);
+    if (table.slots[slot] != -1)
+      return false;
+    table.slots[slot] = i;
+  }
+  return true;
+}
+
+constexpr Table MakeTable() {
+  Table table = {2166136261u, {}};
+  while (! Fill(table))
+    ++table.seed;
+  return table;
+}
+
+constexpr Table kTable = MakeTable();
+
+// The reserved word spelled by [first, last), or 0.
+inline const Word * Classify(const char * first, const char * last) {
+  const size_t n = last - first;
+  const int i = kTable.slots[Hash(first, n, kTable.seed)];
+  if (i < 0)
+    return 0;
+  const Word & word = kWords[i];
+  if (std::strncmp(word.name, first, n) != 0 || word.name[n] != '\0')
+    return 0;
+  return &word;
+}
+
+}
+
+#endif // JLC_RESERVED_HH_
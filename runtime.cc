@@ -0,0 +1,490 @@
+// Runtime library for compiled Javalette programs: the built-in functions
+// and the helpers the code generators call.
+//
+// It is freestanding, x86-64 Linux only, and talks to the kernel through
+// raw system calls, so it links into a program without libc and brings its
+// own _start for that. Output goes through a large buffer flushed at exit,
+// on error, and before blocking on input. Numbers are formatted and parsed
+// by hand. Instrumented programs get their profile written at exit as well.
+// Arrays are bump-allocated from arenas mapped from the kernel and never
+// freed.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Counters of a program compiled with --profile-generate, see profile.hh;
+// null in other programs.
+extern "C" __attribute__((weak)) uint64_t jlc_profile[];
+
+namespace {
+
+const size_t kBufferSize = 1 << 16;
+// Longest printDouble output: sign, 309 integer digits, ".0" and newline.
+const size_t kMaxNumber = 320;
+
+const int kStdin = 0;
+const int kStdout = 1;
+const int kStderr = 2;
+
+const long kRead = 0;
+const long kWrite = 1;
+const long kOpen = 2;
+const long kClose = 3;
+const long kMmap = 9;
+const long kExitGroup = 231;
+const long kEINTR = 4;
+// O_WRONLY | O_CREAT | O_TRUNC
+const long kCreate = 01 | 0100 | 01000;
+// PROT_READ | PROT_WRITE and MAP_PRIVATE | MAP_ANONYMOUS
+const long kReadWrite = 1 | 2;
+const long kPrivateAnonymous = 0x02 | 0x20;
+
+// Arrays are carved out of arenas of this size; those larger than a
+// quarter of it get a mapping of their own.
+const size_t kArenaSize = 1 << 20;
+
+char out[kBufferSize];
+size_t out_size;
+
+char in[kBufferSize];
+size_t in_pos;
+size_t in_size;
+bool in_eof;
+
+char * arena;
+size_t arena_left;
+
+// An array's length comes first, its elements 8 bytes in. Empty arrays
+// are all this one.
+uint64_t empty_array[1];
+
+long Syscall3(long n, long a, long b, long c) {
+  long ret;
+  __asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+  return ret;
+}
+
+long Syscall6(long n, long a, long b, long c, long d, long e, long f) {
+  long ret;
+  register long r10 __asm__("r10") = d;
+  register long r8 __asm__("r8") = e;
+  register long r9 __asm__("r9") = f;
+  __asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+                    : "rcx", "r11", "memory");
+  return ret;
+}
+
+void WriteAll(int fd, const char * data, size_t size) {
+  while (size > 0) {
+    long n = Syscall3(kWrite, fd, reinterpret_cast<long>(data), size);
+    if (n == -kEINTR)
+      continue;
+    if (n < 0)
+      return;
+    data += n;
+    size -= n;
+  }
+}
+
+[[noreturn]] void Exit(int status) {
+  for (;;)
+    Syscall3(kExitGroup, status, 0, 0);
+}
+
+void Flush() {
+  WriteAll(kStdout, out, out_size);
+  out_size = 0;
+}
+
+// Writes jlc_profile to its path as "JLCPROF1", count, keys_size, the keys
+// and the counters.
+void WriteProfile() {
+  const uint64_t * p = jlc_profile;
+  if (! p)
+    return;
+  const uint64_t count = p[0];
+  const uint64_t keys_size = p[1];
+  const char * keys = reinterpret_cast<const char *>(p + 3 + count);
+  const char * path = keys + keys_size;
+  long fd = Syscall3(kOpen, reinterpret_cast<long>(path), kCreate, 0644);
+  if (fd < 0)
+    return;
+  WriteAll(fd, "JLCPROF1", 8);
+  WriteAll(fd, reinterpret_cast<const char *>(p), 16);
+  WriteAll(fd, keys, keys_size);
+  WriteAll(fd, reinterpret_cast<const char *>(p + 3), 8 * count);
+  Syscall3(kClose, fd, 0, 0);
+}
+
+// Makes room for n more bytes of output, n <= kBufferSize.
+char * Reserve(size_t n) {
+  if (kBufferSize - out_size < n)
+    Flush();
+  return out + out_size;
+}
+
+// Writes the decimal digits of v backwards, ending just before end.
+char * FormatDigits(char * end, uint64_t v) {
+  do {
+    *--end = '0' + v % 10;
+    v /= 10;
+  } while (v != 0);
+  return end;
+}
+
+// Prints "<message> at line <line>" to stderr and exits with status 1,
+// after the output so far.
+[[noreturn]] void Fail(const char * message, int line) {
+  Flush();
+  WriteProfile();
+  char buf[256];
+  char * p = buf;
+  while (*message)
+    *p++ = *message++;
+  static const char at[] = " at line ";
+  for (const char * a = at ; *a ; ++a)
+    *p++ = *a;
+  char digits[16];
+  char * end = digits + sizeof(digits);
+  const char * d = FormatDigits(end, line < 0 ? 0 : line);
+  while (d != end)
+    *p++ = *d++;
+  *p++ = '\n';
+  WriteAll(kStderr, buf, p - buf);
+  Exit(1);
+}
+
+// Zeroed memory from the kernel.
+char * Map(size_t size, int line) {
+  long p = Syscall6(kMmap, 0, size, kReadWrite, kPrivateAnonymous, -1, 0);
+  if (p < 0 && p > -4096)
+    Fail("out of memory for an array", line);
+  return reinterpret_cast<char *>(p);
+}
+
+// size bytes of zeroed memory, 8-byte aligned.
+char * Allocate(size_t size, int line) {
+  size = (size + 7) & ~size_t(7);
+  if (size > kArenaSize / 4)
+    return Map(size, line);
+  if (size > arena_left) {
+    arena = Map(kArenaSize, line);
+    arena_left = kArenaSize;
+  }
+  char * p = arena;
+  arena += size;
+  arena_left -= size;
+  return p;
+}
+
+void Append(const char * begin, const char * end) {
+  char * p = Reserve(end - begin);
+  while (begin != end)
+    *p++ = *begin++;
+  out_size = p - out;
+}
+
+void Put(char c) {
+  *Reserve(1) = c;
+  ++out_size;
+}
+
+// Exact decimal digits of an integral double v >= 2^52.
+char * FormatLargeIntegral(char * end, uint64_t mantissa, int exponent) {
+  // v = mantissa * 2^exponent held in 32-bit limbs, least significant first.
+  uint32_t limbs[36] = {0};
+  limbs[exponent / 32] = static_cast<uint32_t>(mantissa << (exponent % 32));
+  limbs[exponent / 32 + 1] = static_cast<uint32_t>((mantissa << (exponent % 32)) >> 32);
+  limbs[exponent / 32 + 2] = exponent % 32 ? static_cast<uint32_t>(mantissa >> (64 - exponent % 32)) : 0;
+  int count = exponent / 32 + 3;
+  while (count > 0 && limbs[count - 1] == 0)
+    --count;
+
+  while (count > 0) {
+    uint64_t remainder = 0;
+    for (int i = count - 1 ; i >= 0 ; --i) {
+      uint64_t cur = (remainder << 32) | limbs[i];
+      limbs[i] = static_cast<uint32_t>(cur / 1000000000);
+      remainder = cur % 1000000000;
+    }
+    while (count > 0 && limbs[count - 1] == 0)
+      --count;
+    char * chunk = FormatDigits(end, remainder);
+    if (count > 0)
+      while (chunk != end - 9)
+        *--chunk = '0';
+    end = chunk;
+  }
+  return end;
+}
+
+// Same output as printf("%.1f\n"): the exact binary value rounded to one
+// decimal, ties to even.
+char * FormatDouble(char * end, double v) {
+  union {
+    double d;
+    uint64_t u;
+  } bits;
+  bits.d = v;
+  const bool negative = bits.u >> 63;
+  const int biased = (bits.u >> 52) & 0x7FF;
+  const uint64_t fraction = bits.u & ((uint64_t(1) << 52) - 1);
+
+  char * p;
+  if (biased == 0x7FF) {
+    const char * s = fraction ? "nan" : "inf";
+    p = end - 3;
+    for (int i = 0 ; i < 3 ; ++i)
+      p[i] = s[i];
+  } else if (biased >= 1023 + 52) {
+    *--end = '0';
+    *--end = '.';
+    p = FormatLargeIntegral(end, fraction | (uint64_t(1) << 52), biased - 1023 - 52);
+  } else {
+    const double a = negative ? -v : v;
+    uint64_t integral = static_cast<uint64_t>(a);
+    const double f = a - static_cast<double>(integral);
+    // y + e is exactly 10 * f: both products are exact and TwoSum recovers
+    // the rounding error of their sum.
+    const double a8 = f * 8, a2 = f * 2;
+    const double y = a8 + a2;
+    const double b = y - a8;
+    const double e = (a8 - (y - b)) + (a2 - b);
+    uint64_t tenths = static_cast<uint64_t>(y);
+    const double h = y - static_cast<double>(tenths);
+    if (h > 0.5 || (h == 0.5 && (e > 0 || (e == 0 && (tenths & 1)))))
+      ++tenths;
+    if (tenths == 10) {
+      tenths = 0;
+      ++integral;
+    }
+    *--end = '0' + tenths;
+    *--end = '.';
+    p = FormatDigits(end, integral);
+  }
+  if (negative)
+    *--p = '-';
+  return p;
+}
+
+// Refills the input buffer; false at end of input.
+bool Fill() {
+  if (in_eof)
+    return false;
+  // The program may have printed a prompt.
+  Flush();
+  for (;;) {
+    long n = Syscall3(kRead, kStdin, reinterpret_cast<long>(in), kBufferSize);
+    if (n == -kEINTR)
+      continue;
+    if (n <= 0) {
+      in_eof = true;
+      return false;
+    }
+    in_pos = 0;
+    in_size = n;
+    return true;
+  }
+}
+
+// Next input character without consuming it, -1 at end of input.
+int Peek() {
+  if (in_pos == in_size && !Fill())
+    return -1;
+  return static_cast<unsigned char>(in[in_pos]);
+}
+
+bool IsSpace(int c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool IsDigit(int c) {
+  return c >= '0' && c <= '9';
+}
+
+void SkipSpace() {
+  while (IsSpace(Peek()))
+    ++in_pos;
+}
+
+bool Sign() {
+  int c = Peek();
+  if (c == '-' || c == '+')
+    ++in_pos;
+  return c == '-';
+}
+
+const double kExactPowers[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+long double Pow10(int n) {
+  long double result = 1, base = 10;
+  for (unsigned e = n < 0 ? -n : n ; e != 0 ; e >>= 1, base *= base)
+    if (e & 1)
+      result *= base;
+  return n < 0 ? 1 / result : result;
+}
+
+// mantissa * 10^exponent. Exact when both fit the powers table, otherwise
+// computed in extended precision.
+double ScaleDecimal(uint64_t mantissa, int exponent) {
+  if (mantissa == 0)
+    return 0;
+  if (mantissa < (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+    double m = static_cast<double>(mantissa);
+    return exponent < 0 ? m / kExactPowers[-exponent] : m * kExactPowers[exponent];
+  }
+  if (exponent < -400)
+    return 0;
+  if (exponent > 400)
+    return 1e308 * 10;
+  long double m = mantissa;
+  return static_cast<double>(exponent < 0 ? m / Pow10(-exponent) : m * Pow10(exponent));
+}
+
+}
+
+extern "C" {
+
+void printInt(int v) {
+  char buf[16];
+  char * end = buf + sizeof(buf);
+  *--end = '\n';
+  uint64_t magnitude = v < 0 ? -static_cast<int64_t>(v) : v;
+  char * p = FormatDigits(end, magnitude);
+  if (v < 0)
+    *--p = '-';
+  Append(p, buf + sizeof(buf));
+}
+
+void printDouble(double v) {
+  char buf[kMaxNumber];
+  char * end = buf + sizeof(buf);
+  *--end = '\n';
+  Append(FormatDouble(end, v), buf + sizeof(buf));
+}
+
+void printString(const char * s) {
+  size_t size = 0;
+  while (s[size])
+    ++size;
+  if (size >= kBufferSize) {
+    Flush();
+    WriteAll(kStdout, s, size);
+  } else {
+    Append(s, s + size);
+  }
+  Put('\n');
+}
+
+int readInt() {
+  SkipSpace();
+  bool negative = Sign();
+  uint32_t v = 0;
+  while (IsDigit(Peek()))
+    v = v * 10 + (in[in_pos++] - '0');
+  return static_cast<int32_t>(negative ? -v : v);
+}
+
+double readDouble() {
+  SkipSpace();
+  bool negative = Sign();
+  // Up to 19 significant digits; the rest only move the exponent.
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool point = false;
+  for (int c = Peek() ; IsDigit(c) || (c == '.' && !point) ; c = Peek()) {
+    ++in_pos;
+    if (c == '.') {
+      point = true;
+    } else if (digits < 19) {
+      mantissa = mantissa * 10 + (c - '0');
+      if (mantissa != 0)
+        ++digits;
+      exponent -= point;
+    } else {
+      exponent += !point;
+    }
+  }
+  int c = Peek();
+  if (c == 'e' || c == 'E') {
+    ++in_pos;
+    bool exponent_negative = Sign();
+    int e = 0;
+    while (IsDigit(Peek())) {
+      int d = in[in_pos++] - '0';
+      if (e < 100000)
+        e = e * 10 + d;
+    }
+    exponent += exponent_negative ? -e : e;
+  }
+  double v = ScaleDecimal(mantissa, exponent);
+  return negative ? -v : v;
+}
+
+void error() {
+  Flush();
+  WriteProfile();
+  static const char message[] = "runtime error\n";
+  WriteAll(kStderr, message, sizeof(message) - 1);
+  Exit(1);
+}
+
+// new T[length] at line, with elements of element_size bytes, all zero.
+void * jlc_new_array(int length, int element_size, int line) {
+  if (length < 0)
+    Fail("negative array length", line);
+  if (length == 0)
+    return empty_array;
+  uint64_t * array = reinterpret_cast<uint64_t *>(Allocate(8 + size_t(length) * element_size, line));
+  array[0] = length;
+  return array;
+}
+
+// Called with the stack in any alignment, from the middle of an
+// expression.
+[[noreturn]] __attribute__((force_align_arg_pointer)) void jlc_bounds_error(int line) {
+  Fail("array index out of bounds", line);
+}
+
+// Double remainder with the sign of the dividend, exact like C's fmod.
+double jlc_fmod(double a, double b) {
+  long double x = a;
+  long double y = b;
+  __asm__ ("1: fprem\n\t"
+           "fnstsw %%ax\n\t"
+           "testb $4, %%ah\n\t"
+           "jnz 1b"
+           : "+t"(x) : "u"(y) : "ax", "cc");
+  return static_cast<double>(x);
+}
+
+// Writes out buffered output and the profile; called at exit.
+__attribute__((destructor)) void jlc_flush() {
+  Flush();
+  WriteProfile();
+}
+
+// Exit of programs without libc, whose exit would call jlc_flush.
+[[noreturn]] void jlc_exit(int status) {
+  jlc_flush();
+  Exit(status);
+}
+
+}
+
+// Entry point of programs without libc, such as those elf::Link makes:
+// runs main and exits with its result. libc's own _start takes precedence
+// over this weak one.
+__asm__(".pushsection .text\n"
+        ".weak _start\n"
+        ".type _start, @function\n"
+        "_start:\n\t"
+        "xorl %ebp, %ebp\n\t"
+        "call main\n\t"
+        "movl %eax, %edi\n\t"
+        "call jlc_exit\n"
+        ".size _start, . - _start\n"
+        ".popsection");
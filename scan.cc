@@ -0,0 +1,228 @@
+#include "scan.hh"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define JLC_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+bool IsSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+const char * SkipSpaceScalar(const char * p, const char * end) {
+  while (p < end && IsSpace(*p))
+    ++p;
+  return p;
+}
+
+const char * FindNewlineScalar(const char * p, const char * end) {
+  while (p < end && *p != '\n' && *p != '\r')
+    ++p;
+  return p;
+}
+
+const char * FindQuoteScalar(const char * p, const char * end) {
+  while (p < end && *p != '"')
+    ++p;
+  return p;
+}
+
+const char * FindCommentEndScalar(const char * p, const char * end) {
+  for ( ; p + 1 < end ; ++p)
+    if (p[0] == '*' && p[1] == '/')
+      return p;
+  return end;
+}
+
+size_t CountLinesScalar(const char * p, const char * end, char prev) {
+  size_t lines = 0;
+  for ( ; p < end ; ++p) {
+    const char c = *p;
+    if ((c == '\r' && prev != '\n') || (c == '\n' && prev != '\r'))
+      ++lines;
+    prev = c;
+  }
+  return lines;
+}
+
+#ifdef JLC_SCAN_X86
+
+// Whitespace is ' ' or a byte in '\t'..'\r'; the range test is done as an
+// unsigned saturating subtract.
+inline __m128i IsSpace128(__m128i v) {
+  const __m128i range = _mm_subs_epu8(_mm_sub_epi8(v, _mm_set1_epi8('\t')), _mm_set1_epi8('\r' - '\t'));
+  return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(range, _mm_setzero_si128()));
+}
+
+inline __m128i Load128(const char * p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+const char * SkipSpaceSse2(const char * p, const char * end) {
+  for ( ; p + 16 <= end ; p += 16) {
+    unsigned mask = ~_mm_movemask_epi8(IsSpace128(Load128(p))) & 0xffff;
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return SkipSpaceScalar(p, end);
+}
+
+const char * FindNewlineSse2(const char * p, const char * end) {
+  for ( ; p + 16 <= end ; p += 16) {
+    __m128i v = Load128(p);
+    unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+          _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return FindNewlineScalar(p, end);
+}
+
+const char * FindQuoteSse2(const char * p, const char * end) {
+  for ( ; p + 16 <= end ; p += 16) {
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(Load128(p), _mm_set1_epi8('"')));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return FindQuoteScalar(p, end);
+}
+
+const char * FindCommentEndSse2(const char * p, const char * end) {
+  for ( ; p + 17 <= end ; p += 16) {
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+          _mm_cmpeq_epi8(Load128(p), _mm_set1_epi8('*')),
+          _mm_cmpeq_epi8(Load128(p + 1), _mm_set1_epi8('/'))));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return FindCommentEndScalar(p, end);
+}
+
+// Blocks without \r only need their \n counted; the rare blocks with \r go
+// through the scalar rules for \r\n and \n\r pairs.
+size_t CountLinesSse2(const char * p, const char * end, char prev) {
+  size_t lines = 0;
+  for ( ; p + 16 <= end ; p += 16) {
+    __m128i v = Load128(p);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')))) {
+      lines += CountLinesScalar(p, p + 16, prev);
+    } else {
+      lines += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+      if (prev == '\r' && p[0] == '\n')
+        --lines;
+    }
+    prev = p[15];
+  }
+  return lines + CountLinesScalar(p, end, prev);
+}
+
+#define JLC_AVX2 __attribute__((target("avx2")))
+
+JLC_AVX2 inline __m256i Load256(const char * p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+JLC_AVX2 const char * SkipSpaceAvx2(const char * p, const char * end) {
+  for ( ; p + 32 <= end ; p += 32) {
+    __m256i v = Load256(p);
+    __m256i range = _mm256_subs_epu8(_mm256_sub_epi8(v, _mm256_set1_epi8('\t')), _mm256_set1_epi8('\r' - '\t'));
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+        _mm256_cmpeq_epi8(range, _mm256_setzero_si256()));
+    unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(space));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return SkipSpaceSse2(p, end);
+}
+
+JLC_AVX2 const char * FindNewlineAvx2(const char * p, const char * end) {
+  for ( ; p + 32 <= end ; p += 32) {
+    __m256i v = Load256(p);
+    unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return FindNewlineSse2(p, end);
+}
+
+JLC_AVX2 const char * FindQuoteAvx2(const char * p, const char * end) {
+  for ( ; p + 32 <= end ; p += 32) {
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(Load256(p), _mm256_set1_epi8('"')));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return FindQuoteSse2(p, end);
+}
+
+JLC_AVX2 const char * FindCommentEndAvx2(const char * p, const char * end) {
+  for ( ; p + 33 <= end ; p += 32) {
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+          _mm256_cmpeq_epi8(Load256(p), _mm256_set1_epi8('*')),
+          _mm256_cmpeq_epi8(Load256(p + 1), _mm256_set1_epi8('/'))));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+  return FindCommentEndSse2(p, end);
+}
+
+#undef JLC_AVX2
+
+#endif // JLC_SCAN_X86
+
+struct Kernels {
+  const char * name;
+  const char * (*skip_space)(const char *, const char *);
+  const char * (*find_newline)(const char *, const char *);
+  const char * (*find_quote)(const char *, const char *);
+  const char * (*find_comment_end)(const char *, const char *);
+  size_t (*count_lines)(const char *, const char *, char);
+};
+
+Kernels Select() {
+#ifdef JLC_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Kernels{"avx2", SkipSpaceAvx2, FindNewlineAvx2, FindQuoteAvx2, FindCommentEndAvx2, CountLinesSse2};
+  return Kernels{"sse2", SkipSpaceSse2, FindNewlineSse2, FindQuoteSse2, FindCommentEndSse2, CountLinesSse2};
+#else
+  return Kernels{"scalar", SkipSpaceScalar, FindNewlineScalar, FindQuoteScalar, FindCommentEndScalar, CountLinesScalar};
+#endif
+}
+
+const Kernels & Selected() {
+  static const Kernels kernels = Select();
+  return kernels;
+}
+
+}
+
+const char * SkipSpace(const char * p, const char * end) {
+  return Selected().skip_space(p, end);
+}
+
+const char * FindNewline(const char * p, const char * end) {
+  return Selected().find_newline(p, end);
+}
+
+const char * FindQuote(const char * p, const char * end) {
+  return Selected().find_quote(p, end);
+}
+
+const char * FindCommentEnd(const char * p, const char * end) {
+  return Selected().find_comment_end(p, end);
+}
+
+size_t CountLines(const char * p, const char * end, char prev) {
+  return Selected().count_lines(p, end, prev);
+}
+
+const char * Implementation() {
+  return Selected().name;
+}
+
+}
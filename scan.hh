@@ -0,0 +1,33 @@
+#ifndef JLC_SCAN_HH_
+#define JLC_SCAN_HH_
+
+#include <cstddef>
+
+// Byte scanning kernels used by the skipper and string literals. Each Find
+// and Skip function returns the first position in [p, end) that stops the
+// scan, or end. The SSE2 or AVX2 implementation is picked once at startup
+// from what the CPU supports, with a scalar fallback for everything else.
+namespace scan {
+
+// First byte that is not whitespace (space, \t, \n, \v, \f, \r).
+const char * SkipSpace(const char * p, const char * end);
+
+// First \r or \n, i.e. where qi::eol could match.
+const char * FindNewline(const char * p, const char * end);
+
+// First '"'.
+const char * FindQuote(const char * p, const char * end);
+
+// First "*/".
+const char * FindCommentEnd(const char * p, const char * end);
+
+// Number of line breaks in [p, end) as counted by line_pos_iterator: \r\n
+// and \n\r pairs count once. prev is the byte before p, or 0.
+size_t CountLines(const char * p, const char * end, char prev);
+
+// Name of the selected implementation: "avx2", "sse2" or "scalar".
+const char * Implementation();
+
+}
+
+#endif // JLC_SCAN_HH_
@@ -0,0 +1,186 @@
+#ifndef JLC_SCANNER_HH_
+#define JLC_SCANNER_HH_
+
+#include <cctype>
+
+#include <boost/spirit/include/qi.hpp>
+#include <boost/spirit/include/support_utree.hpp>
+
+#include "reserved.hh"
+#include "scan.hh"
+#include "source_iterator.hh"
+#include "types.hh"
+
+// Qi parsers that consume a run of bytes with one scan kernel instead of
+// matching them one character at a time. They work on iterators that expose
+// their position in the source buffer: SourceIterator and plain pointers.
+namespace scanner {
+
+inline const char * Position(const SourceIterator & i) {
+  return i.base();
+}
+
+inline void Advance(SourceIterator & i, const char * p) {
+  i.Jump(p);
+}
+
+inline const char * Position(const char * p) {
+  return p;
+}
+
+inline void Advance(const char * & i, const char * p) {
+  i = p;
+}
+
+struct SpaceKernel {
+  static const char * Scan(const char * p, const char * end) { return scan::SkipSpace(p, end); }
+  static const char * Name() { return "space"; }
+};
+
+struct LineKernel {
+  static const char * Scan(const char * p, const char * end) { return scan::FindNewline(p, end); }
+  static const char * Name() { return "line-comment"; }
+};
+
+struct QuoteKernel {
+  static const char * Scan(const char * p, const char * end) { return scan::FindQuote(p, end); }
+  static const char * Name() { return "string"; }
+};
+
+struct CommentEndKernel {
+  static const char * Scan(const char * p, const char * end) { return scan::FindCommentEnd(p, end); }
+  static const char * Name() { return "block-comment"; }
+};
+
+// Matches everything up to where Kernel stops, and fails if that is fewer
+// than Min bytes. Has no attribute; wrap it in raw[] to get the text.
+template <class Kernel, size_t Min>
+struct RunParser : boost::spirit::qi::primitive_parser<RunParser<Kernel, Min>> {
+  template <typename Context, typename Iterator>
+  struct attribute {
+    typedef boost::spirit::unused_type type;
+  };
+
+  template <typename Iterator, typename Context, typename Skipper, typename Attribute>
+  bool parse(Iterator & first, const Iterator & last, Context &, const Skipper & skipper, Attribute &) const {
+    boost::spirit::qi::skip_over(first, last, skipper);
+    const char * p = Position(first);
+    const char * q = Kernel::Scan(p, Position(last));
+    if (static_cast<size_t>(q - p) < Min)
+      return false;
+    Advance(first, q);
+    return true;
+  }
+
+  template <typename Context>
+  boost::spirit::info what(Context &) const {
+    return boost::spirit::info(Kernel::Name());
+  }
+};
+
+// One or more whitespace characters: +space.
+typedef RunParser<SpaceKernel, 1> SpaceRun;
+// Rest of a line comment: *(char_ - eol).
+typedef RunParser<LineKernel, 0> LineRest;
+// Body of a string literal: *(char_ - '"').
+typedef RunParser<QuoteKernel, 0> StringRest;
+// Body of a block comment: *(char_ - "*/").
+typedef RunParser<CommentEndKernel, 0> CommentRest;
+
+// Classifies the identifier-like run starting at a position as a reserved
+// word. The last result is kept, so the grammar's alternatives backtracking
+// to the same token do not look it up again. One instance per grammar, and
+// the grammar must not outlive the source buffer it parses.
+class WordClassifier {
+ public:
+  WordClassifier() : at(0), end(0), word(0)
+  {
+  }
+
+  // Sets run_end to the end of the [0-9a-zA-Z_] run at p.
+  const reserved::Word * Classify(const char * p, const char * last, const char * & run_end) const {
+    if (p != at) {
+      const char * q = p;
+      while (q != last && (std::isalnum(static_cast<unsigned char>(*q)) || *q == '_'))
+        ++q;
+      at = p;
+      end = q;
+      word = reserved::Classify(p, q);
+    }
+    run_end = end;
+    return word;
+  }
+
+ private:
+  mutable const char * at, * end;
+  mutable const reserved::Word * word;
+};
+
+// Matches one keyword as a whole word; the attribute is its spelling.
+struct KeywordParser : boost::spirit::qi::primitive_parser<KeywordParser> {
+  KeywordParser(const WordClassifier & c, reserved::Keyword k) :
+    classifier(c), keyword(k)
+  {
+  }
+
+  template <typename Context, typename Iterator>
+  struct attribute {
+    typedef boost::spirit::utf8_symbol_type type;
+  };
+
+  template <typename Iterator, typename Context, typename Skipper, typename Attribute>
+  bool parse(Iterator & first, const Iterator & last, Context &, const Skipper & skipper, Attribute & attr) const {
+    boost::spirit::qi::skip_over(first, last, skipper);
+    const char * p = Position(first);
+    const char * end;
+    const reserved::Word * word = classifier.Classify(p, Position(last), end);
+    if (! word || word->kind != reserved::Kind::keyword || word->value != keyword)
+      return false;
+    boost::spirit::traits::assign_to(boost::spirit::utf8_symbol_type(p, end), attr);
+    Advance(first, end);
+    return true;
+  }
+
+  template <typename Context>
+  boost::spirit::info what(Context &) const {
+    return boost::spirit::info("keyword");
+  }
+
+  const WordClassifier & classifier;
+  reserved::Keyword keyword;
+};
+
+// Matches a type name; the attribute is its Type.
+struct TypeNameParser : boost::spirit::qi::primitive_parser<TypeNameParser> {
+  explicit TypeNameParser(const WordClassifier & c) : classifier(c)
+  {
+  }
+
+  template <typename Context, typename Iterator>
+  struct attribute {
+    typedef Type type;
+  };
+
+  template <typename Iterator, typename Context, typename Skipper, typename Attribute>
+  bool parse(Iterator & first, const Iterator & last, Context &, const Skipper & skipper, Attribute & attr) const {
+    boost::spirit::qi::skip_over(first, last, skipper);
+    const char * end;
+    const reserved::Word * word = classifier.Classify(Position(first), Position(last), end);
+    if (! word || word->kind != reserved::Kind::type)
+      return false;
+    boost::spirit::traits::assign_to(Type(word->value), attr);
+    Advance(first, end);
+    return true;
+  }
+
+  template <typename Context>
+  boost::spirit::info what(Context &) const {
+    return boost::spirit::info("type");
+  }
+
+  const WordClassifier & classifier;
+};
+
+}
+
+#endif // JLC_SCANNER_HH_
@@ -0,0 +1,313 @@
+#include "passes.hh"
+
+#include <climits>
+#include <cstring>
+#include <set>
+
+namespace ir {
+
+namespace {
+
+struct Lattice {
+  enum State {
+    top,
+    constant,
+    bottom,
+  };
+
+  Lattice() : state(top), i(0), d(0) {}
+
+  static Lattice Int(int64_t v) {
+    Lattice l;
+    l.state = constant;
+    l.i = v;
+    return l;
+  }
+
+  static Lattice Double(double v) {
+    Lattice l;
+    l.state = constant;
+    l.d = v;
+    return l;
+  }
+
+  static Lattice Bottom() {
+    Lattice l;
+    l.state = bottom;
+    return l;
+  }
+
+  bool operator==(const Lattice & o) const {
+    return state == o.state && i == o.i && std::memcmp(&d, &o.d, sizeof(d)) == 0;
+  }
+
+  bool operator!=(const Lattice & o) const {
+    return ! (*this == o);
+  }
+
+  State state;
+  int64_t i; // int and boolean values
+  double d;
+};
+
+Lattice Meet(const Lattice & a, const Lattice & b) {
+  if (a.state == Lattice::top)
+    return b;
+  if (b.state == Lattice::top)
+    return a;
+  if (a != b)
+    return Lattice::Bottom();
+  return a;
+}
+
+// Javalette ints are 32 bits wide and wrap around.
+int64_t Wrap(int64_t v) {
+  return static_cast<int32_t>(static_cast<uint32_t>(v));
+}
+
+Lattice FoldInt(Opcode op, int64_t a, int64_t b) {
+  switch (op) {
+    case Opcode::neg: return Lattice::Int(Wrap(-a));
+    case Opcode::add: return Lattice::Int(Wrap(a + b));
+    case Opcode::sub: return Lattice::Int(Wrap(a - b));
+    case Opcode::mul: return Lattice::Int(Wrap(a * b));
+    case Opcode::div:
+    case Opcode::mod:
+      // Leave trapping divisions to run time.
+      if (b == 0 || (a == INT_MIN && b == -1))
+        return Lattice::Bottom();
+      return Lattice::Int(op == Opcode::div ? a / b : a % b);
+    case Opcode::lt: return Lattice::Int(a < b);
+    case Opcode::le: return Lattice::Int(a <= b);
+    case Opcode::gt: return Lattice::Int(a > b);
+    case Opcode::ge: return Lattice::Int(a >= b);
+    case Opcode::eq: return Lattice::Int(a == b);
+    case Opcode::ne: return Lattice::Int(a != b);
+    case Opcode::not_: return Lattice::Int(! a);
+    default: return Lattice::Bottom();
+  }
+}
+
+Lattice FoldDouble(Opcode op, double a, double b) {
+  switch (op) {
+    case Opcode::neg: return Lattice::Double(-a);
+    case Opcode::add: return Lattice::Double(a + b);
+    case Opcode::sub: return Lattice::Double(a - b);
+    case Opcode::mul: return Lattice::Double(a * b);
+    case Opcode::div: return Lattice::Double(a / b);
+    case Opcode::lt: return Lattice::Int(a < b);
+    case Opcode::le: return Lattice::Int(a <= b);
+    case Opcode::gt: return Lattice::Int(a > b);
+    case Opcode::ge: return Lattice::Int(a >= b);
+    case Opcode::eq: return Lattice::Int(a == b);
+    case Opcode::ne: return Lattice::Int(a != b);
+    default: return Lattice::Bottom();
+  }
+}
+
+class SCCP {
+ public:
+  explicit SCCP(Function & function) :
+    f(function),
+    values(f.insts.size()),
+    executable(f.blocks.size(), false),
+    uses(f.Uses())
+  {
+  }
+
+  bool Run() {
+    MarkEdge(kNoBlock, 0);
+    while (! block_work.empty() || ! value_work.empty()) {
+      while (! block_work.empty()) {
+        BlockId b = block_work.back();
+        block_work.pop_back();
+        for (auto v : f.blocks[b].insts)
+          Visit(v);
+      }
+      while (! value_work.empty()) {
+        Value v = value_work.back();
+        value_work.pop_back();
+        for (auto u : uses[v])
+          if (executable[f.insts[u].block])
+            Visit(u);
+      }
+    }
+    return Rewrite();
+  }
+
+ private:
+  void MarkEdge(BlockId from, BlockId to) {
+    if (! edges.insert(std::make_pair(from, to)).second)
+      return;
+    if (! executable[to]) {
+      executable[to] = true;
+      block_work.push_back(to);
+    } else {
+      // A new edge into a visited block only affects its phis.
+      for (auto v : f.blocks[to].insts) {
+        if (f.insts[v].op != Opcode::phi)
+          break;
+        Visit(v);
+      }
+    }
+  }
+
+  void Update(Value v, const Lattice & l) {
+    if (values[v] == l)
+      return;
+    values[v] = l;
+    value_work.push_back(v);
+  }
+
+  void Visit(Value v) {
+    const Inst & inst = f.insts[v];
+    switch (inst.op) {
+      case Opcode::const_int:
+      case Opcode::const_bool:
+        Update(v, Lattice::Int(inst.imm));
+        break;
+      case Opcode::const_double:
+        Update(v, Lattice::Double(inst.fimm));
+        break;
+      case Opcode::const_string:
+      case Opcode::arg:
+      case Opcode::call:
+        Update(v, Lattice::Bottom());
+        break;
+      case Opcode::phi: {
+        Lattice l;
+        const auto & preds = f.blocks[inst.block].preds;
+        for (size_t i = 0 ; i < preds.size() ; ++i)
+          if (edges.count(std::make_pair(preds[i], inst.block)))
+            l = Meet(l, values[inst.operands[i]]);
+        Update(v, l);
+        break;
+      }
+      case Opcode::br:
+        MarkEdge(inst.block, inst.targets[0]);
+        break;
+      case Opcode::cond_br: {
+        const Lattice & c = values[inst.operands[0]];
+        if (c.state == Lattice::bottom || (c.state == Lattice::constant && c.i))
+          MarkEdge(inst.block, inst.targets[0]);
+        if (c.state == Lattice::bottom || (c.state == Lattice::constant && ! c.i))
+          MarkEdge(inst.block, inst.targets[1]);
+        break;
+      }
+      case Opcode::ret:
+      case Opcode::unreachable:
+        break;
+      default:
+        Update(v, Evaluate(inst));
+        break;
+    }
+  }
+
+  Lattice Evaluate(const Inst & inst) {
+    const Lattice & a = values[inst.operands[0]];
+    const Lattice & b = inst.operands.size() > 1 ? values[inst.operands[1]] : a;
+    if (a.state == Lattice::bottom || b.state == Lattice::bottom)
+      return Lattice::Bottom();
+    if (a.state == Lattice::top || b.state == Lattice::top)
+      return Lattice();
+
+    if (f.insts[inst.operands[0]].type == basic_type::double_)
+      return FoldDouble(inst.op, a.d, b.d);
+    return FoldInt(inst.op, a.i, b.i);
+  }
+
+  bool Rewrite() {
+    bool changed = false;
+    std::vector<Value> map(f.insts.size(), kNoValue);
+    std::vector<Value> replaced;
+
+    for (BlockId b = 0 ; b < f.blocks.size() ; ++b) {
+      if (! executable[b])
+        continue;
+      const auto list = f.blocks[b].insts;
+      size_t phis = 0;
+      while (phis < list.size() && f.insts[list[phis]].op == Opcode::phi)
+        ++phis;
+      for (auto v : list) {
+        Inst & inst = f.insts[v];
+        if (IsConstant(inst.op) || IsTerminator(inst.op) || values[v].state != Lattice::constant)
+          continue;
+
+        // Phis are replaced by a new constant after the block's phis, other
+        // instructions become constants in place.
+        Value c = v;
+        if (inst.op == Opcode::phi) {
+          c = f.Append(b, Opcode::const_int, inst.type, inst.line_pos);
+          auto & insts = f.blocks[b].insts;
+          insts.pop_back();
+          insts.insert(insts.begin() + phis, c);
+          map[v] = c;
+          replaced.push_back(v);
+        }
+        Inst & k = f.insts[c];
+        k.operands.clear();
+        if (k.type == basic_type::double_) {
+          k.op = Opcode::const_double;
+          k.fimm = values[v].d;
+        } else {
+          k.op = k.type == basic_type::boolean_ ? Opcode::const_bool : Opcode::const_int;
+          k.imm = values[v].i;
+        }
+        changed = true;
+      }
+
+      Value t = f.Terminator(b);
+      if (t != kNoValue && f.insts[t].op == Opcode::cond_br &&
+          values[f.insts[t].operands[0]].state == Lattice::constant) {
+        Inst & inst = f.insts[t];
+        const bool taken = values[inst.operands[0]].i;
+        BlockId keep = inst.targets[taken ? 0 : 1];
+        BlockId drop = inst.targets[taken ? 1 : 0];
+        f.RemoveEdge(b, drop);
+        inst.op = Opcode::br;
+        inst.operands.clear();
+        inst.targets = {keep};
+        changed = true;
+      }
+    }
+
+    map.resize(f.insts.size(), kNoValue);
+    f.Rewrite(map);
+    f.Remove(replaced);
+    changed |= f.RemoveUnreachableBlocks();
+    return changed;
+  }
+
+  Function & f;
+  std::vector<Lattice> values;
+  std::vector<bool> executable;
+  std::vector<std::vector<Value>> uses;
+  std::set<std::pair<BlockId, BlockId>> edges;
+  std::vector<BlockId> block_work;
+  std::vector<Value> value_work;
+};
+
+class SCCPPass : public FunctionPass {
+ public:
+  const char * Name() const {
+    return "sccp";
+  }
+
+  bool RunOnFunction(Module &, Function & f) {
+    return PropagateConstants(f);
+  }
+};
+
+}
+
+bool PropagateConstants(Function & f) {
+  if (f.blocks.empty())
+    return false;
+  return SCCP(f).Run();
+}
+
+std::unique_ptr<Pass> CreateSCCPPass() {
+  return std::unique_ptr<Pass>(new SCCPPass);
+}
+
+}
@@ -0,0 +1,62 @@
+#ifndef JLC_SOURCE_ITERATOR_HH_
+#define JLC_SOURCE_ITERATOR_HH_
+
+#include <cstddef>
+
+#include <boost/iterator/iterator_adaptor.hpp>
+
+#include "scan.hh"
+
+// Line counting iterator over an in-memory source buffer. It counts lines
+// like boost::spirit::line_pos_iterator, but it can also Jump forward over a
+// stretch found by one of the scan kernels without visiting every byte.
+class SourceIterator : public boost::iterator_adaptor<
+    SourceIterator,
+    const char *,
+    boost::use_default,
+    boost::forward_traversal_tag>
+{
+ public:
+  SourceIterator() :
+    SourceIterator::iterator_adaptor_(0), line(1), prev(0)
+  {
+  }
+
+  explicit SourceIterator(const char * p, size_t first_line = 1) :
+    SourceIterator::iterator_adaptor_(p), line(first_line), prev(0)
+  {
+  }
+
+  size_t position() const {
+    return line;
+  }
+
+  // Moves to p, which must not be before the current position.
+  void Jump(const char * p) {
+    if (p == base())
+      return;
+    line += scan::CountLines(base(), p, prev);
+    prev = p[-1];
+    base_reference() = p;
+  }
+
+ private:
+  friend class boost::iterator_core_access;
+
+  void increment() {
+    const char c = *base();
+    if ((c == '\r' && prev != '\n') || (c == '\n' && prev != '\r'))
+      ++line;
+    prev = c;
+    ++base_reference();
+  }
+
+  size_t line;
+  char prev;
+};
+
+inline size_t get_line(const SourceIterator & i) {
+  return i.position();
+}
+
+#endif // JLC_SOURCE_ITERATOR_HH_
@@ -0,0 +1,253 @@
+#include "passes.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+namespace ir {
+
+namespace {
+
+// Cost model, in instructions. A specialization must save at least
+// kMinSaved instructions per call, and its calls, weighted by kLoopWeight
+// inside loops, must save half its size.
+const int kMinSaved = 3;
+const int kLoopWeight = 8;
+// Larger callees are not cloned.
+const int kMaxCalleeSize = 400;
+// Clones of one function.
+const int kMaxClones = 4;
+// The clones may add this fraction of the module's size, or kMinBudget
+// instructions.
+const double kMaxGrowth = 0.5;
+const int kMinBudget = 200;
+
+// A constant argument: its index and value.
+struct Constant {
+  size_t arg;
+  Opcode op;
+  int64_t imm;
+  uint64_t fimm; // bit pattern, as in GVN
+
+  bool operator<(const Constant & o) const {
+    if (arg != o.arg)
+      return arg < o.arg;
+    if (op != o.op)
+      return op < o.op;
+    if (imm != o.imm)
+      return imm < o.imm;
+    return fimm < o.fimm;
+  }
+};
+
+// A callee with constants for some of its arguments.
+typedef std::pair<int, std::vector<Constant>> Key;
+
+class Specializer {
+ public:
+  Specializer(Module & module, std::vector<Remark> * r) : m(module), remarks(r), clones(m.functions.size(), 0) {}
+
+  bool Run() {
+    for (size_t i = 0 ; i < m.functions.size() ; ++i)
+      index[m.functions[i].name] = i;
+
+    // How much each specialization would be called.
+    int size = 0;
+    for (size_t i = 0 ; i < m.functions.size() ; ++i) {
+      const Function & f = m.functions[i];
+      size += CodeSize(f);
+      if (f.blocks.empty())
+        continue;
+      const auto in_loop = InLoop(f);
+      for (auto b : f.ReversePostOrder()) {
+        for (auto v : f.blocks[b].insts) {
+          Key key;
+          if (SiteKey(f, v, key))
+            weights[key] += in_loop[b] ? kLoopWeight : 1;
+        }
+      }
+    }
+    budget = std::max(kMinBudget, static_cast<int>(size * kMaxGrowth));
+
+    // Clones are appended and visited in turn, so that their calls with
+    // the same constants go to themselves.
+    bool changed = false;
+    for (size_t i = 0 ; i < m.functions.size() ; ++i) {
+      if (m.functions[i].blocks.empty())
+        continue;
+      const auto order = m.functions[i].ReversePostOrder();
+      for (auto b : order) {
+        const auto list = m.functions[i].blocks[b].insts;
+        for (auto v : list)
+          changed |= Redirect(i, v);
+      }
+    }
+    return changed;
+  }
+
+ private:
+  // The key of call v in f, if it calls a function of the module with
+  // some constant arguments.
+  bool SiteKey(const Function & f, Value v, Key & key) const {
+    const Inst & call = f.insts[v];
+    if (call.op != Opcode::call)
+      return false;
+    auto callee = index.find(m.strings[call.imm]);
+    if (callee == index.end() || m.functions[callee->second].blocks.empty())
+      return false;
+    key.first = callee->second;
+    key.second.clear();
+    for (size_t a = 0 ; a < call.operands.size() ; ++a) {
+      const Inst & arg = f.insts[call.operands[a]];
+      if (! IsConstant(arg.op))
+        continue;
+      Constant c{a, arg.op, arg.imm, 0};
+      std::memcpy(&c.fimm, &arg.fimm, sizeof(c.fimm));
+      key.second.push_back(c);
+    }
+    return ! key.second.empty();
+  }
+
+  // Points call v of function caller at the specialization for its
+  // constant arguments, made first if it pays off.
+  bool Redirect(size_t caller, Value v) {
+    Key key;
+    if (! SiteKey(m.functions[caller], v, key))
+      return false;
+    auto s = specializations.find(key);
+    if (s == specializations.end()) {
+      const int clone = Specialize(key, m.functions[caller].name, m.functions[caller].insts[v].line_pos);
+      s = specializations.insert(std::make_pair(key, clone)).first;
+    }
+    if (s->second < 0)
+      return false;
+
+    Function & f = m.functions[caller];
+    Inst & call = f.insts[v];
+    std::vector<Value> operands;
+    auto c = key.second.begin();
+    for (size_t a = 0 ; a < call.operands.size() ; ++a) {
+      if (c != key.second.end() && c->arg == a)
+        ++c;
+      else
+        operands.push_back(call.operands[a]);
+    }
+    call.operands.swap(operands);
+    call.imm = m.AddString(m.functions[s->second].name);
+    return true;
+  }
+
+  // Clones the callee of key with its constants propagated. Returns the
+  // index of the clone, or -1 if it does not pay off.
+  int Specialize(const Key & key, const std::string & caller, int line) {
+    const int callee = key.first;
+    const std::string name = m.functions[callee].name;
+    const int size = CodeSize(m.functions[callee]);
+    if (size > kMaxCalleeSize) {
+      Report(Remark::Kind::missed, caller, line, name + " not specialized: too large");
+      return -1;
+    }
+    if (clones[callee] >= kMaxClones) {
+      Report(Remark::Kind::missed, caller, line, name + " not specialized: too many specializations already");
+      return -1;
+    }
+
+    Function clone = m.functions[callee];
+    std::ostringstream s;
+    s << name << ".spec" << clones[callee];
+    clone.name = s.str();
+    clone.local = true;
+    clone.arg_types.clear();
+    std::vector<size_t> new_index(m.functions[callee].arg_types.size());
+    auto c = key.second.begin();
+    for (size_t a = 0 ; a < new_index.size() ; ++a) {
+      if (c != key.second.end() && c->arg == a) {
+        ++c;
+      } else {
+        new_index[a] = clone.arg_types.size();
+        clone.arg_types.push_back(m.functions[callee].arg_types[a]);
+      }
+    }
+    for (auto & inst : clone.insts) {
+      if (inst.block == kNoBlock || inst.op != Opcode::arg)
+        continue;
+      auto constant = std::find_if(key.second.begin(), key.second.end(),
+        [&](const Constant & k) { return k.arg == static_cast<size_t>(inst.imm); });
+      if (constant == key.second.end()) {
+        inst.imm = new_index[inst.imm];
+      } else {
+        inst.op = constant->op;
+        inst.imm = constant->imm;
+        std::memcpy(&inst.fimm, &constant->fimm, sizeof(inst.fimm));
+      }
+    }
+    PropagateConstants(clone);
+    RemoveTrivialPhis(clone);
+
+    const int clone_size = CodeSize(clone);
+    const int saved = size - clone_size;
+    auto w = weights.find(key);
+    const int weight = w == weights.end() ? 1 : w->second;
+    std::ostringstream message;
+    if (saved < kMinSaved || 2 * saved * weight < clone_size) {
+      message << name << " not specialized: saves " << saved << " of " << size << " instructions";
+      Report(Remark::Kind::missed, caller, line, message.str());
+      return -1;
+    }
+    if (clone_size > budget) {
+      Report(Remark::Kind::missed, caller, line, name + " not specialized: the program grew too much");
+      return -1;
+    }
+
+    message << name << " specialized for constant arguments as " << clone.name << ", " << clone_size << " of "
+      << size << " instructions left";
+    Report(Remark::Kind::passed, caller, line, message.str());
+    budget -= clone_size;
+    ++clones[callee];
+    clones.push_back(kMaxClones);
+    index[clone.name] = m.functions.size();
+    m.functions.push_back(std::move(clone));
+    return m.functions.size() - 1;
+  }
+
+  void Report(Remark::Kind kind, const std::string & function, int line, const std::string & message) {
+    if (remarks)
+      remarks->push_back(Remark{kind, "specialize", function, line, message});
+  }
+
+  Module & m;
+  std::vector<Remark> * remarks;
+  std::unordered_map<std::string, int> index;
+  std::map<Key, int> weights;
+  // Index of the clone for each key, or -1.
+  std::map<Key, int> specializations;
+  // Clones made of each function; clones are not cloned again.
+  std::vector<int> clones;
+  int budget;
+};
+
+class SpecializePass : public Pass {
+ public:
+  explicit SpecializePass(std::vector<Remark> * r) : remarks(r) {}
+
+  const char * Name() const {
+    return "specialize";
+  }
+
+  bool Run(Module & m) {
+    return Specializer(m, remarks).Run();
+  }
+
+ private:
+  std::vector<Remark> * remarks;
+};
+
+}
+
+std::unique_ptr<Pass> CreateSpecializePass(std::vector<Remark> * remarks) {
+  return std::unique_ptr<Pass>(new SpecializePass(remarks));
+}
+
+}
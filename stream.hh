@@ -0,0 +1,235 @@
+#ifndef JLC_STREAM_HH_
+#define JLC_STREAM_HH_
+
+#include <cctype>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/spirit/include/qi.hpp>
+#include <boost/spirit/include/support_utree.hpp>
+
+#include "parser.hh"
+#include "compiler.hh"
+#include "flat_ast.hh"
+#include "queue.hh"
+#include "scan.hh"
+#include "tags.hh"
+#include "trace.hh"
+
+// Location of one top-level function definition: [begin, body) holds the
+// signature and [body, end) the brace-delimited body. line is the line the
+// signature starts on.
+struct FunctionExtent {
+  size_t begin, body, end;
+  int line;
+};
+
+// Finds the top-level function definitions by matching braces, skipping
+// comments and string literals the same way JavaletteSkipper and
+// literal_string do, and counting line breaks as SourceIterator does.
+// Stops at the first construct it cannot close (an
+// unterminated comment, string or body); the grammar reports those.
+inline std::vector<FunctionExtent> ScanFunctions(const std::string & source) {
+  std::vector<FunctionExtent> functions;
+  const size_t n = source.size();
+  int depth = 0;
+  int line = 1;
+  // The byte before i.
+  char prev = 0;
+  FunctionExtent current = {std::string::npos, 0, 0, 0};
+
+  for (size_t i = 0 ; i < n ; prev = source[i++]) {
+    const char c = source[i];
+    if (c == '\n' || c == '\r') {
+      line += scan::CountLines(&source[i], &source[i] + 1, prev);
+    } else if ((c == '/' && i + 1 < n && source[i + 1] == '/') || c == '#') {
+      while (i + 1 < n && source[i + 1] != '\n' && source[i + 1] != '\r')
+        ++i;
+    } else if (c == '/' && i + 1 < n && source[i + 1] == '*') {
+      size_t close = source.find("*/", i + 2);
+      if (close == std::string::npos)
+        break;
+      line += scan::CountLines(&source[i], &source[close], prev);
+      i = close + 1;
+    } else if (c == '"') {
+      size_t close = source.find('"', i + 1);
+      if (close == std::string::npos)
+        break;
+      line += scan::CountLines(&source[i], &source[close], prev);
+      i = close;
+    } else if (c == '{') {
+      if (depth++ == 0)
+        current.body = i;
+    } else if (c == '}') {
+      if (--depth == 0) {
+        current.end = i + 1;
+        functions.push_back(current);
+        current.begin = std::string::npos;
+      } else if (depth < 0) {
+        break;
+      }
+    } else if (depth == 0 && current.begin == std::string::npos && ! std::isspace(c)) {
+      current.begin = i;
+      current.line = line;
+    }
+  }
+
+  return functions;
+}
+
+// Checks a program one function at a time. A pre-scan declares every
+// signature so that calls may refer to functions defined later; then a
+// parser thread parses one fundecl per phrase_parse call and hands it over
+// a bounded queue to the checker, which drops each tree as soon as it is
+// checked. Only a few function trees are alive at any time; each checked
+// function is appended to a FlatAST.
+//
+// Run returns false if parsing failed, leaving the reason in error. Type
+// errors go to diagnostics; functions are only added to the FlatAST while
+// there are none. Calls may also go to the imported functions of other
+// modules.
+//
+// Declaring the signatures and parsing and checking each function are
+// spans of trace, if given.
+template <class Iterator>
+class StreamingCompiler {
+ public:
+  typedef parser::JavaletteParser<Iterator, Tags<Tag>> Parser;
+  typedef parser::JavaletteSkipper<Iterator> Skipper;
+
+  explicit StreamingCompiler(trace::Recorder * trace = 0, size_t queue_size = 4) :
+    trace(trace), queue_size(queue_size)
+  {
+  }
+
+  bool Run(const std::string & source, FlatAST & ast, const std::vector<interface::Function> & imports = {});
+
+  parser::ParseError error;
+  diag::Sink diagnostics;
+
+ private:
+  struct Unit {
+    utree tree;
+    Tags<Tag> tags;
+    bool parsed;
+    parser::ParseError error;
+  };
+
+  bool DeclareSignatures(const std::string & source, Compiler<Tags<Tag>> & compiler);
+  void ParseFunctions(const std::string & source, BoundedQueue<std::unique_ptr<Unit>> & queue);
+
+  trace::Recorder * const trace;
+  const size_t queue_size;
+};
+
+template <class Iterator>
+bool StreamingCompiler<Iterator>::Run(const std::string & source, FlatAST & ast,
+    const std::vector<interface::Function> & imports) {
+  Tags<Tag> tags;
+  Compiler<Tags<Tag>> compiler(tags);
+  for (auto & f : imports)
+    compiler.Import(f);
+
+  compiler.symbols.BeginContext();
+  bool declared;
+  {
+    trace::Span span(trace, "check", "declare");
+    declared = DeclareSignatures(source, compiler);
+  }
+  if (! declared) {
+    diagnostics = std::move(compiler.diagnostics);
+    return false;
+  }
+
+  BoundedQueue<std::unique_ptr<Unit>> queue(queue_size);
+  std::thread parser_thread([&] { ParseFunctions(source, queue); });
+
+  bool parsed = true;
+  try {
+    std::unique_ptr<Unit> unit;
+    while (queue.Pop(unit)) {
+      if (! unit->parsed) {
+        error = unit->error;
+        parsed = false;
+        break;
+      }
+      // The compiler looks tags up through its own Tags object, so hand it
+      // this function's tags for the duration of the check.
+      tags.tags.swap(unit->tags.tags);
+      trace::Span span(trace, "check", trace ? compiler.GetSymbol(unit->tree[1]) : std::string());
+      auto fundef = compiler.FunctionDefinition(unit->tree);
+      if (compiler.diagnostics.Empty())
+        ast.AddFunction(*fundef);
+      unit.reset();
+    }
+  } catch (...) {
+    queue.Close();
+    parser_thread.join();
+    throw;
+  }
+  queue.Close();
+  parser_thread.join();
+
+  compiler.symbols.EndContext();
+  diagnostics = std::move(compiler.diagnostics);
+  return parsed;
+}
+
+template <class Iterator>
+bool StreamingCompiler<Iterator>::DeclareSignatures(const std::string & source, Compiler<Tags<Tag>> & compiler) {
+  Parser p(compiler.tags, parser::ParseUnit::signature);
+  Skipper s;
+
+  auto functions = ScanFunctions(source);
+  for (auto i = functions.begin() ; i != functions.end() ; ++i) {
+    Iterator first(source.data() + i->begin, i->line);
+    Iterator last(source.data() + i->body);
+    utree u;
+    if (! boost::spirit::qi::phrase_parse(first, last, p, s, u)) {
+      error = parser::LastError(p, s);
+      return false;
+    }
+    if (first != last) {
+      error.message = "Expecting \"{\"";
+      error.line = get_line(first);
+      return false;
+    }
+    compiler.tags[u].line_pos = i->line;
+    compiler.FunctionDeclaration(u);
+  }
+
+  return true;
+}
+
+template <class Iterator>
+void StreamingCompiler<Iterator>::ParseFunctions(const std::string & source, BoundedQueue<std::unique_ptr<Unit>> & queue) {
+  Tags<Tag> tags;
+  Parser p(tags, parser::ParseUnit::function);
+  Skipper s;
+
+  Iterator iter(source.data());
+  Iterator end(source.data() + source.size());
+
+  // A program has at least one function, so always try to parse one.
+  do {
+    std::unique_ptr<Unit> unit(new Unit);
+    const double begin = trace ? trace->Now() : 0;
+    unit->parsed = boost::spirit::qi::phrase_parse(iter, end, p, s, unit->tree);
+    if (trace && unit->parsed && unit->tree[1].which() == utree_type::symbol_type) {
+      auto symbol = unit->tree[1].template get<boost::spirit::utf8_symbol_range_type>();
+      trace->Add("parse", std::string(symbol.begin(), symbol.end()), begin, trace->Now());
+    }
+    unit->tags.tags.swap(tags.tags);
+    if (! unit->parsed)
+      unit->error = parser::LastError(p, s);
+    const bool parsed = unit->parsed;
+    if (! queue.Push(std::move(unit)) || ! parsed)
+      break;
+  } while (iter != end);
+
+  queue.Close();
+}
+
+#endif // JLC_STREAM_HH_
@@ -0,0 +1,37 @@
+#include "symbols.hh"
+
+Symbols::Symbols() :
+  contexts(1)
+{
+  current_context = &contexts[0];
+}
+
+void Symbols::BeginContext() {
+  contexts.resize(contexts.size() + 1);
+  current_context = &contexts.back();
+}
+
+void Symbols::EndContext() {
+  for (auto i = current_context->begin() ; i != current_context->end() ; ++i)
+    symbols[*i].pop_back();
+  contexts.pop_back();
+  current_context = &contexts.back();
+}
+
+bool Symbols::InContext(const std::string & s) const {
+  return current_context->count(s) > 0;
+}
+
+bool Symbols::Defined(const std::string & s) const {
+  auto i = symbols.find(s);
+  return i != symbols.end() && ! i->second.empty();
+}
+
+const Symbol & Symbols::operator[](const std::string & s) const {
+  return symbols.find(s)->second.back();
+}
+
+void Symbols::Add(const Symbol & s) {
+  current_context->insert(s.name);
+  symbols[s.name].push_back(s);
+}
@@ -0,0 +1,68 @@
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace trace {
+
+namespace {
+
+void WriteString(std::ostream & out, const std::string & s) {
+  out << '"';
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < 0x20) {
+      char escape[8];
+      std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+      out << escape;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+}
+
+Recorder::Recorder() :
+  start(clock::now()),
+  threads(1, std::this_thread::get_id())
+{
+}
+
+int Recorder::ThreadId() {
+  const auto id = std::this_thread::get_id();
+  auto i = std::find(threads.begin(), threads.end(), id);
+  if (i == threads.end())
+    i = threads.insert(threads.end(), id);
+  return i - threads.begin();
+}
+
+void Recorder::Add(const char * category, const std::string & name, double begin, double end) {
+  std::lock_guard<std::mutex> lock(mutex);
+  events.push_back(Event{category, name, begin, end - begin, ThreadId()});
+}
+
+void Recorder::Write(std::ostream & out) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  out << "{\"traceEvents\":[\n";
+  for (size_t t = 0 ; t < threads.size() ; ++t) {
+    out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":";
+    WriteString(out, t ? "worker " + std::to_string(t) : "jlc");
+    out << "}},\n";
+  }
+  for (auto & e : events) {
+    out << "{\"ph\":\"X\",\"cat\":";
+    WriteString(out, e.category);
+    out << ",\"name\":";
+    WriteString(out, e.name);
+    // Microseconds, to the nanosecond.
+    char times[64];
+    std::snprintf(times, sizeof(times), ",\"ts\":%.3f,\"dur\":%.3f", e.begin, e.duration);
+    out << times << ",\"pid\":1,\"tid\":" << e.tid << "},\n";
+  }
+  out << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"jlc\"}}\n]}\n";
+}
+
+}
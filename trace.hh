@@ -0,0 +1,92 @@
+#ifndef JLC_TRACE_HH_
+#define JLC_TRACE_HH_
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Timelines of a compilation in the Chrome Trace Event Format, for
+// chrome://tracing or Perfetto. Every phase and every function parsed,
+// checked, lowered or emitted is a complete ("X") event on the thread that
+// did the work.
+//
+// Code that records takes a Recorder pointer, null when tracing is off;
+// a Span then only tests the pointer.
+namespace trace {
+
+class Recorder {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  // The constructing thread is tid 0, "jlc".
+  Recorder();
+
+  // Microseconds since the recorder was made.
+  double Now() const {
+    return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+  }
+
+  // Thread-safe.
+  void Add(const char * category, const std::string & name, double begin, double end);
+
+  // {"traceEvents": [...]} with the events in the order they ended.
+  void Write(std::ostream & out) const;
+
+ private:
+  struct Event {
+    const char * category;
+    std::string name;
+    double begin, duration;
+    int tid;
+  };
+
+  int ThreadId();
+
+  const clock::time_point start;
+  mutable std::mutex mutex;
+  std::vector<Event> events;
+  std::vector<std::thread::id> threads;
+};
+
+// Records the time from its construction to its destruction.
+class Span {
+ public:
+  Span(Recorder * recorder, const char * category, const char * name) :
+    recorder(recorder), category(category)
+  {
+    if (recorder) {
+      this->name = name;
+      begin = recorder->Now();
+    }
+  }
+
+  Span(Recorder * recorder, const char * category, const std::string & name) :
+    recorder(recorder), category(category)
+  {
+    if (recorder) {
+      this->name = name;
+      begin = recorder->Now();
+    }
+  }
+
+  ~Span() {
+    if (recorder)
+      recorder->Add(category, name, begin, recorder->Now());
+  }
+
+  Span(const Span &) = delete;
+  Span & operator=(const Span &) = delete;
+
+ private:
+  Recorder * const recorder;
+  const char * const category;
+  std::string name;
+  double begin;
+};
+
+}
+
+#endif // JLC_TRACE_HH_
@@ -0,0 +1,17 @@
+#include "types.hh"
+
+size_t TypeTable::Hash::operator()(const Signature & s) const {
+  size_t h = s.result;
+  for (auto t : s.args)
+    h = h * 31 + t;
+  return h;
+}
+
+Type TypeTable::Function(const Signature & s) {
+  auto i = ids.find(s);
+  if (i != ids.end())
+    return i->second;
+  i = ids.insert(std::make_pair(s, kFirstFunctionType + Type(signatures.size()))).first;
+  signatures.push_back(&i->first);
+  return i->second;
+}
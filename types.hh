@@ -1,45 +1,105 @@
 #ifndef JLC_TYPES_HH_
 #define JLC_TYPES_HH_
 
-#include <boost/mpl/map.hpp>
 #include <string>
-#include <boost/spirit/include/qi_symbols.hpp>
+#include <unordered_map>
+#include <vector>
 
+// A type is a compact id, the same for equal types, so types compare as
+// ints. The basic types and the arrays of them have fixed ids; function
+// signatures get theirs from a TypeTable.
 typedef int Type;
 
 namespace basic_type {
+  // Expressions the checker rejected.
+  const Type error_ = 0;
   const Type void_ = 1;
   const Type int_ = 2;
   const Type double_ = 3;
   const Type boolean_ = 4;
   const Type string_ = 5;
+  // Arrays follow the basic types in the same order: array_ + int_ is
+  // int[]. Arrays are one dimensional and hold ints, doubles or booleans.
+  const Type array_ = 6;
 }
 
-template <typename T>
-struct LiteralToBasicType {
-  template <Type type>
-  struct TypeWrapper {
-    static const Type value = type;
-  };
+constexpr Type ArrayOf(Type element) {
+  return basic_type::array_ + element;
+}
+
+constexpr bool IsArray(Type t) {
+  return t >= basic_type::array_ && t < 2 * basic_type::array_;
+}
+
+constexpr Type ElementType(Type array) {
+  return array - basic_type::array_;
+}
 
-  typedef boost::mpl::map<
-    boost::mpl::pair<int, TypeWrapper<basic_type::int_>>,
-    boost::mpl::pair<double, TypeWrapper<basic_type::double_>>,
-    boost::mpl::pair<bool, TypeWrapper<basic_type::boolean_>>,
-    boost::mpl::pair<std::string, TypeWrapper<basic_type::string_>>
-  > map;
-  typedef typename boost::mpl::at<map, T>::type type;
+// Types arrays can hold.
+constexpr bool IsElementType(Type t) {
+  return t == basic_type::int_ || t == basic_type::double_ || t == basic_type::boolean_;
+}
+
+// The first id of a function type.
+const Type kFirstFunctionType = 2 * basic_type::array_;
+
+constexpr bool IsFunctionType(Type t) {
+  return t >= kFirstFunctionType;
+}
+
+struct Signature {
+  Type result;
+  std::vector<Type> args;
+
+  bool operator==(const Signature & other) const {
+    return result == other.result && args == other.args;
+  }
 };
 
-struct TypeSymbols : boost::spirit::qi::symbols<char, Type> {
-  TypeSymbols() {
-    add
-      ("void", basic_type::void_)
-      ("int", basic_type::int_)
-      ("double", basic_type::double_)
-      ("boolean", basic_type::boolean_)
-      ;
+// Hash-consed function types: each signature is stored once and named by
+// its id, so two functions have the same signature exactly when their
+// types are equal.
+class TypeTable {
+ public:
+  // The type of functions with the signature, added if new.
+  Type Function(const Signature & s);
+
+  const Signature & operator[](Type function) const {
+    return *signatures[function - kFirstFunctionType];
   }
+
+ private:
+  struct Hash {
+    size_t operator()(const Signature & s) const;
+  };
+
+  std::unordered_map<Signature, Type, Hash> ids;
+  // By id; the keys of ids, which do not move.
+  std::vector<const Signature *> signatures;
+};
+
+// The type of literals of T.
+template <typename T>
+struct LiteralToBasicType;
+
+template <>
+struct LiteralToBasicType<int> {
+  static const Type value = basic_type::int_;
+};
+
+template <>
+struct LiteralToBasicType<double> {
+  static const Type value = basic_type::double_;
+};
+
+template <>
+struct LiteralToBasicType<bool> {
+  static const Type value = basic_type::boolean_;
+};
+
+template <>
+struct LiteralToBasicType<std::string> {
+  static const Type value = basic_type::string_;
 };
 
 #endif // JLC_TYPES_HH_
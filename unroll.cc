@@ -0,0 +1,262 @@
+#include "passes.hh"
+
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+
+namespace ir {
+
+namespace {
+
+const int kMaxFactor = 8;
+// Largest number of instructions in the body of an unrolled loop.
+const size_t kMaxUnrolledSize = 64;
+
+Value Lookup(const std::unordered_map<Value, Value> & map, Value v) {
+  auto i = map.find(v);
+  return i == map.end() ? v : i->second;
+}
+
+// Inserts a new instruction into block b at position index.
+Value InsertAt(Function & f, BlockId b, size_t index, Opcode op, Type type, int line_pos) {
+  Value v = f.Append(b, op, type, line_pos);
+  auto & list = f.blocks[b].insts;
+  list.pop_back();
+  list.insert(list.begin() + index, v);
+  return v;
+}
+
+size_t PredIndex(const Function & f, BlockId b, BlockId pred) {
+  auto & preds = f.blocks[b].preds;
+  return std::find(preds.begin(), preds.end(), pred) - preds.begin();
+}
+
+class UnrollPass : public FunctionPass {
+ public:
+  explicit UnrollPass(std::vector<Remark> * r) : remarks(r) {}
+
+  const char * Name() const {
+    return "unroll";
+  }
+
+  bool RunOnFunction(Module &, Function & f) {
+    if (f.blocks.empty())
+      return false;
+    // Unrolling adds no blocks, so the loops stay valid.
+    bool changed = false;
+    for (auto & loop : FindLoops(f, f.Dominators()))
+      changed |= Run(f, loop);
+    return changed;
+  }
+
+ private:
+  bool Run(Function & f, const Loop & loop) {
+    const Value t = f.Terminator(loop.header);
+    const int line = t == kNoValue ? f.line_pos : f.insts[t].line_pos;
+    CountedLoop c;
+    if (! FindCountedLoop(f, loop, c)) {
+      Report(Remark::Kind::missed, f, line, "loop not unrolled: no induction variable found");
+      return false;
+    }
+
+    std::ostringstream analysis;
+    analysis << "induction variable stepped by " << c.step << ", ";
+    if (c.trip_count < 0)
+      analysis << "unknown trip count";
+    else
+      analysis << "trip count " << c.trip_count;
+    Report(Remark::Kind::analysis, f, line, analysis.str());
+
+    const char * reason = 0;
+    size_t size = 0;
+    if (c.trip_count < 0)
+      reason = "trip count is not a constant";
+    else if (loop.size != 2 || c.body != c.latch || f.insts[f.Terminator(c.latch)].op != Opcode::br)
+      reason = "body has control flow";
+    for (auto b : {loop.header, c.latch}) {
+      for (auto v : f.blocks[b].insts) {
+        const Opcode op = f.insts[v].op;
+        if (b == loop.header && op != Opcode::phi && ! IsTerminator(op) && ! IsPure(op) && ! reason)
+          reason = "test has side effects";
+        size += op != Opcode::phi && ! IsTerminator(op);
+      }
+    }
+    int factor = kMaxFactor;
+    while (! reason && factor > 1 && (c.trip_count % factor || size * factor > kMaxUnrolledSize))
+      factor /= 2;
+    if (! reason && factor == 1)
+      reason = c.trip_count < 2 ? "it runs less than twice" : "body too large for a factor dividing the trip count";
+    if (reason) {
+      Report(Remark::Kind::missed, f, line, std::string("loop not unrolled: ") + reason);
+      return false;
+    }
+
+    Unroll(f, c, loop.header, factor);
+    std::ostringstream passed;
+    passed << "unrolled loop by a factor of " << factor << " (trip count " << c.trip_count << ")";
+    Report(Remark::Kind::passed, f, line, passed.str());
+
+    int doubles = 0;
+    int interleaved = Interleave(f, loop, c, factor, line, doubles);
+    if (interleaved) {
+      std::ostringstream s;
+      s << "interleaved " << interleaved << " int reduction" << (interleaved > 1 ? "s" : "")
+        << " over " << factor << " accumulators";
+      Report(Remark::Kind::passed, f, line, s.str());
+    }
+    if (doubles)
+      Report(Remark::Kind::missed, f, line, "double reduction not interleaved: reassociating it would change rounding");
+    return true;
+  }
+
+  // Repeats the header's computations and the body factor - 1 more times
+  // in the body, each copy using the values of the one before.
+  void Unroll(Function & f, const CountedLoop & c, BlockId header, int factor) {
+    std::vector<Value> phis, body;
+    for (auto b : {header, c.latch}) {
+      for (auto v : f.blocks[b].insts) {
+        if (f.insts[v].op == Opcode::phi)
+          phis.push_back(v);
+        else if (! IsTerminator(f.insts[v].op))
+          body.push_back(v);
+      }
+    }
+    const size_t latch_index = PredIndex(f, header, c.latch);
+    std::vector<Value> next;
+    for (auto phi : phis)
+      next.push_back(f.insts[phi].operands[latch_index]);
+
+    // Values of the original body to their values in the last copy.
+    std::unordered_map<Value, Value> map;
+    for (int k = 1 ; k < factor ; ++k) {
+      std::unordered_map<Value, Value> copy;
+      for (size_t i = 0 ; i < phis.size() ; ++i)
+        copy[phis[i]] = Lookup(map, next[i]);
+      for (auto v : body) {
+        const Inst inst = f.insts[v];
+        Value w = f.InsertBeforeTerminator(c.latch, inst.op, inst.type, inst.line_pos);
+        f.insts[w].imm = inst.imm;
+        f.insts[w].fimm = inst.fimm;
+        for (auto o : inst.operands)
+          f.insts[w].operands.push_back(Lookup(copy, o));
+        copy[v] = w;
+      }
+      map.swap(copy);
+    }
+    for (size_t i = 0 ; i < phis.size() ; ++i)
+      f.insts[phis[i]].operands[latch_index] = Lookup(map, next[i]);
+  }
+
+  // Splits the chains of adds or multiplies that carry a header phi
+  // around the unrolled loop over factor accumulators. Returns how many
+  // int reductions were split and counts the double ones in doubles.
+  int Interleave(Function & f, const Loop & loop, const CountedLoop & c, int factor, int line, int & doubles) {
+    if (f.blocks[c.exit].preds.size() != 1)
+      return 0;
+    const BlockId header = loop.header;
+    const size_t latch_index = PredIndex(f, header, c.latch);
+    const size_t preheader_index = PredIndex(f, header, c.preheader);
+    const auto uses = f.Uses();
+    const std::vector<Value> phis(f.blocks[header].insts.begin(), f.blocks[header].insts.end());
+
+    int interleaved = 0;
+    for (auto r : phis) {
+      if (f.insts[r].op != Opcode::phi || r == c.iv)
+        continue;
+      std::vector<Value> chain, outside;
+      if (! Chain(f, loop, c, uses, r, chain, outside) || chain.size() < static_cast<size_t>(factor))
+        continue;
+      const Type type = f.insts[r].type;
+      if (type == basic_type::double_) {
+        ++doubles;
+        continue;
+      }
+      const Opcode op = f.insts[chain[0]].op;
+
+      Value identity = f.InsertBeforeTerminator(c.preheader, Opcode::const_int, type, line);
+      f.insts[identity].imm = op == Opcode::add ? 0 : 1;
+      std::vector<Value> acc(1, r);
+      for (int j = 1 ; j < factor ; ++j) {
+        Value phi = InsertAt(f, header, 0, Opcode::phi, type, line);
+        f.insts[phi].operands.resize(f.blocks[header].preds.size());
+        f.insts[phi].operands[preheader_index] = identity;
+        acc.push_back(phi);
+      }
+      std::vector<Value> last = acc;
+      Value previous = r;
+      for (size_t k = 0 ; k < chain.size() ; ++k) {
+        auto & operands = f.insts[chain[k]].operands;
+        *std::find(operands.begin(), operands.end(), previous) = last[k % factor];
+        previous = chain[k];
+        last[k % factor] = chain[k];
+      }
+      for (int j = 0 ; j < factor ; ++j)
+        f.insts[acc[j]].operands[latch_index] = last[j];
+
+      // The total after the loop, where the phi was used.
+      size_t index = 0;
+      while (f.insts[f.blocks[c.exit].insts[index]].op == Opcode::phi)
+        ++index;
+      Value total = r;
+      for (int j = 1 ; j < factor ; ++j) {
+        Value v = InsertAt(f, c.exit, index++, op, type, line);
+        f.insts[v].operands = {total, acc[j]};
+        total = v;
+      }
+      for (auto u : outside)
+        std::replace(f.insts[u].operands.begin(), f.insts[u].operands.end(), r, total);
+      ++interleaved;
+    }
+    return interleaved;
+  }
+
+  // Follows the uses of the header phi r through the body: the one add or
+  // multiply using it, the one using that, and so on back to r. Other uses
+  // of r must be after the exit block's phis; they go to outside.
+  bool Chain(const Function & f, const Loop & loop, const CountedLoop & c, const std::vector<std::vector<Value>> & uses,
+      Value r, std::vector<Value> & chain, std::vector<Value> & outside) {
+    const Value end = f.insts[r].operands[PredIndex(f, loop.header, c.latch)];
+    Value inside = kNoValue;
+    for (auto u : uses[r]) {
+      const Inst & user = f.insts[u];
+      if (loop.body[user.block]) {
+        if (inside != kNoValue)
+          return false;
+        inside = u;
+      } else if (user.op == Opcode::phi && user.block == c.exit) {
+        return false;
+      } else {
+        outside.push_back(u);
+      }
+    }
+    if (inside == kNoValue)
+      return false;
+    for (Value u = inside ; ; ) {
+      const Inst & inst = f.insts[u];
+      if (inst.block != c.latch || (inst.op != Opcode::add && inst.op != Opcode::mul) || inst.type != f.insts[r].type ||
+          (! chain.empty() && inst.op != f.insts[chain[0]].op) || inst.operands[0] == inst.operands[1])
+        return false;
+      chain.push_back(u);
+      if (uses[u].size() != 1)
+        return false;
+      if (uses[u][0] == r)
+        return u == end;
+      u = uses[u][0];
+    }
+  }
+
+  void Report(Remark::Kind kind, const Function & f, int line, const std::string & message) {
+    if (remarks)
+      remarks->push_back(Remark{kind, Name(), f.name, line, message});
+  }
+
+  std::vector<Remark> * remarks;
+};
+
+}
+
+std::unique_ptr<Pass> CreateUnrollPass(std::vector<Remark> * remarks) {
+  return std::unique_ptr<Pass>(new UnrollPass(remarks));
+}
+
+}
@@ -0,0 +1,380 @@
+#ifndef JLC_X86_HH_
+#define JLC_X86_HH_
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+// Minimal x86-64 instruction encoder: just the instructions the code
+// generators use, always with 32-bit displacements and immediates.
+namespace x86 {
+
+enum Reg {
+  rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+  r8, r9, r10, r11, r12, r13, r14, r15,
+};
+
+enum Xmm {
+  xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7,
+};
+
+enum Cond {
+  below = 0x2,
+  above_equal = 0x3,
+  equal = 0x4,
+  not_equal = 0x5,
+  above = 0x7,
+  parity = 0xA,
+  not_parity = 0xB,
+  less = 0xC,
+  greater_equal = 0xD,
+  less_equal = 0xE,
+  greater = 0xF,
+};
+
+typedef uint32_t Label;
+
+class Assembler {
+ public:
+  std::vector<uint8_t> code;
+
+  size_t Position() const {
+    return code.size();
+  }
+
+  Label NewLabel() {
+    labels.push_back(-1);
+    return labels.size() - 1;
+  }
+
+  void Bind(Label l) {
+    labels[l] = code.size();
+  }
+
+  bool Bound(Label l) const {
+    return labels[l] >= 0;
+  }
+
+  int64_t Offset(Label l) const {
+    return labels[l];
+  }
+
+  // Resolves jumps and calls to labels; every used label must be bound.
+  void Finish() {
+    for (auto & f : fixups)
+      Patch32(f.first, labels[f.second] - (f.first + 4));
+    fixups.clear();
+  }
+
+  void Patch32(size_t pos, int32_t v) {
+    std::memcpy(&code[pos], &v, 4);
+  }
+
+  void Byte(uint8_t b) {
+    code.push_back(b);
+  }
+
+  void Imm32(int32_t v) {
+    uint8_t b[4];
+    std::memcpy(b, &v, 4);
+    code.insert(code.end(), b, b + 4);
+  }
+
+  void Imm64(int64_t v) {
+    uint8_t b[8];
+    std::memcpy(b, &v, 8);
+    code.insert(code.end(), b, b + 8);
+  }
+
+  // Instructions.
+
+  void Push(Reg r) {
+    Rex(false, 0, r);
+    Byte(0x50 + (r & 7));
+  }
+
+  void Pop(Reg r) {
+    Rex(false, 0, r);
+    Byte(0x58 + (r & 7));
+  }
+
+  void Mov(Reg dst, Reg src) {
+    RegReg(true, 0x89, src, dst);
+  }
+
+  void Mov32(Reg dst, Reg src) {
+    RegReg(false, 0x89, src, dst);
+  }
+
+  void MovImm32(Reg dst, int32_t v) {
+    Rex(false, 0, dst);
+    Byte(0xB8 + (dst & 7));
+    Imm32(v);
+  }
+
+  void MovImm64(Reg dst, int64_t v) {
+    Rex(true, 0, dst);
+    Byte(0xB8 + (dst & 7));
+    Imm64(v);
+  }
+
+  void Load(Reg dst, Reg base, int32_t disp) {
+    RegMem(true, {0x8B}, dst, base, disp);
+  }
+
+  void Load32(Reg dst, Reg base, int32_t disp) {
+    RegMem(false, {0x8B}, dst, base, disp);
+  }
+
+  void Store(Reg base, int32_t disp, Reg src) {
+    RegMem(true, {0x89}, src, base, disp);
+  }
+
+  void Store32(Reg base, int32_t disp, Reg src) {
+    RegMem(false, {0x89}, src, base, disp);
+  }
+
+  // The same at [base + index * scale + disp], scale 1, 2, 4 or 8.
+  void Load32(Reg dst, Reg base, Reg index, int scale, int32_t disp) {
+    RegIndexed(false, {0x8B}, dst, base, index, scale, disp);
+  }
+
+  void Store32(Reg base, Reg index, int scale, int32_t disp, Reg src) {
+    RegIndexed(false, {0x89}, src, base, index, scale, disp);
+  }
+
+  void LoadSd(Xmm dst, Reg base, Reg index, int scale, int32_t disp) {
+    Byte(0xF2);
+    RegIndexed(false, {0x0F, 0x10}, Reg(dst), base, index, scale, disp);
+  }
+
+  void StoreSd(Reg base, Reg index, int scale, int32_t disp, Xmm src) {
+    Byte(0xF2);
+    RegIndexed(false, {0x0F, 0x11}, Reg(src), base, index, scale, disp);
+  }
+
+  // lea dst, [rip + disp32]; returns the position of disp32.
+  size_t LeaRip(Reg dst) {
+    Rex(true, dst, 0);
+    Byte(0x8D);
+    Byte(0x05 | ((dst & 7) << 3));
+    Imm32(0);
+    return code.size() - 4;
+  }
+
+  // inc qword [rip + disp32]; returns the position of disp32.
+  size_t IncRip() {
+    Byte(0x48);
+    Byte(0xFF);
+    Byte(0x05);
+    Imm32(0);
+    return code.size() - 4;
+  }
+
+  void LoadSd(Xmm dst, Reg base, int32_t disp) {
+    Byte(0xF2);
+    RegMem(false, {0x0F, 0x10}, Reg(dst), base, disp);
+  }
+
+  void StoreSd(Reg base, int32_t disp, Xmm src) {
+    Byte(0xF2);
+    RegMem(false, {0x0F, 0x11}, Reg(src), base, disp);
+  }
+
+  void MovqToXmm(Xmm dst, Reg src) {
+    Byte(0x66);
+    RegReg(true, {0x0F, 0x6E}, Reg(dst), src);
+  }
+
+  void MovqFromXmm(Reg dst, Xmm src) {
+    Byte(0x66);
+    RegReg(true, {0x0F, 0x7E}, Reg(src), dst);
+  }
+
+  void Movapd(Xmm dst, Xmm src) {
+    Byte(0x66);
+    RegReg(false, {0x0F, 0x28}, Reg(dst), Reg(src));
+  }
+
+  void Addsd(Xmm dst, Xmm src) { Sse(0x58, dst, src); }
+  void Subsd(Xmm dst, Xmm src) { Sse(0x5C, dst, src); }
+  void Mulsd(Xmm dst, Xmm src) { Sse(0x59, dst, src); }
+  void Divsd(Xmm dst, Xmm src) { Sse(0x5E, dst, src); }
+
+  void Ucomisd(Xmm a, Xmm b) {
+    Byte(0x66);
+    RegReg(false, {0x0F, 0x2E}, Reg(a), Reg(b));
+  }
+
+  void Add32(Reg dst, Reg src) { RegReg(false, 0x01, src, dst); }
+  void Sub32(Reg dst, Reg src) { RegReg(false, 0x29, src, dst); }
+  void And32(Reg dst, Reg src) { RegReg(false, 0x21, src, dst); }
+  void Or32(Reg dst, Reg src) { RegReg(false, 0x09, src, dst); }
+  void Xor32(Reg dst, Reg src) { RegReg(false, 0x31, src, dst); }
+  void Cmp32(Reg a, Reg b) { RegReg(false, 0x39, b, a); }
+  void Cmp(Reg a, Reg b) { RegReg(true, 0x39, b, a); }
+  void Test32(Reg a, Reg b) { RegReg(false, 0x85, b, a); }
+
+  // cmp a, dword [base + disp]
+  void Cmp32(Reg a, Reg base, int32_t disp) {
+    RegMem(false, {0x3B}, a, base, disp);
+  }
+
+  void Imul32(Reg dst, Reg src) {
+    RegReg(false, {0x0F, 0xAF}, dst, src);
+  }
+
+  // edx:eax / src
+  void Idiv32(Reg src) {
+    RegReg(false, 0xF7, Reg(7), src);
+  }
+
+  void Cdq() {
+    Byte(0x99);
+  }
+
+  void Neg32(Reg r) {
+    RegReg(false, 0xF7, Reg(3), r);
+  }
+
+  void XorImm32(Reg r, int32_t v) {
+    RegReg(false, 0x81, Reg(6), r);
+    Imm32(v);
+  }
+
+  void AddImm32(Reg r, int32_t v) {
+    RegReg(false, 0x81, Reg(0), r);
+    Imm32(v);
+  }
+
+  void SubImm32(Reg r, int32_t v) {
+    RegReg(false, 0x81, Reg(5), r);
+    Imm32(v);
+  }
+
+  void CmpImm32(Reg r, int32_t v) {
+    RegReg(false, 0x81, Reg(7), r);
+    Imm32(v);
+  }
+
+  void SubImm(Reg r, int32_t v) {
+    RegReg(true, 0x81, Reg(5), r);
+    Imm32(v);
+  }
+
+  void AddImm(Reg r, int32_t v) {
+    RegReg(true, 0x81, Reg(0), r);
+    Imm32(v);
+  }
+
+  // Flips the sign bit of a double held in r.
+  void FlipSign(Reg r) {
+    RegReg(true, {0x0F, 0xBA}, Reg(7), r);
+    Byte(63);
+  }
+
+  // setcc on the low byte of r, which must be one of rax..rbx.
+  void Set(Cond c, Reg r) {
+    RegReg(false, {0x0F, uint8_t(0x90 + c)}, Reg(0), r);
+  }
+
+  void Movzx8(Reg dst, Reg src) {
+    RegReg(false, {0x0F, 0xB6}, dst, src);
+  }
+
+  void Jump(Label l) {
+    Byte(0xE9);
+    Fixup(l);
+  }
+
+  void JumpIf(Cond c, Label l) {
+    Byte(0x0F);
+    Byte(0x80 + c);
+    Fixup(l);
+  }
+
+  void Call(Label l) {
+    Byte(0xE8);
+    Fixup(l);
+  }
+
+  // call rel32 to be relocated; returns the position of rel32.
+  size_t CallExternal() {
+    Byte(0xE8);
+    Imm32(0);
+    return code.size() - 4;
+  }
+
+  void Leave() {
+    Byte(0xC9);
+  }
+
+  void Ret() {
+    Byte(0xC3);
+  }
+
+  void Ud2() {
+    Byte(0x0F);
+    Byte(0x0B);
+  }
+
+ private:
+  void Fixup(Label l) {
+    fixups.push_back(std::make_pair(code.size(), l));
+    Imm32(0);
+  }
+
+  void Rex(bool w, int reg, int rm, int index = 0) {
+    uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (rm >> 3);
+    if (rex != 0x40)
+      Byte(rex);
+  }
+
+  void Opcode(std::initializer_list<uint8_t> opcode) {
+    code.insert(code.end(), opcode.begin(), opcode.end());
+  }
+
+  void RegReg(bool w, std::initializer_list<uint8_t> opcode, Reg reg, Reg rm) {
+    Rex(w, reg, rm);
+    Opcode(opcode);
+    Byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+  }
+
+  void RegReg(bool w, uint8_t opcode, Reg reg, Reg rm) {
+    RegReg(w, {opcode}, reg, rm);
+  }
+
+  void RegMem(bool w, std::initializer_list<uint8_t> opcode, Reg reg, Reg base, int32_t disp) {
+    Rex(w, reg, base);
+    Opcode(opcode);
+    Byte(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == rsp)
+      Byte(0x24);
+    Imm32(disp);
+  }
+
+  // ModRM with a SIB byte and disp32. index must not be rsp.
+  void RegIndexed(bool w, std::initializer_list<uint8_t> opcode, Reg reg, Reg base, Reg index, int scale,
+      int32_t disp) {
+    Rex(w, reg, base, index);
+    Opcode(opcode);
+    Byte(0x84 | ((reg & 7) << 3));
+    const int log2 = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+    Byte((log2 << 6) | ((index & 7) << 3) | (base & 7));
+    Imm32(disp);
+  }
+
+  void Sse(uint8_t op, Xmm dst, Xmm src) {
+    Byte(0xF2);
+    RegReg(false, {0x0F, op}, Reg(dst), Reg(src));
+  }
+
+  std::vector<int64_t> labels;
+  std::vector<std::pair<size_t, Label>> fixups;
+};
+
+}
+
+#endif // JLC_X86_HH_